@@ -0,0 +1,796 @@
+/* sortBench -- measures the hot kernels of the sorts on their own:
+ * partition(), selectPivot(), merge(), swapStr() and the string compare,
+ * each next to an alternative implementation to compare it with.
+ * The kernels are copies of the ones in sortThread, without the -S
+ * telemetry hooks, and are run on generated lines for every key
+ * distribution and line length, with arrays of lines sized to fit in L1
+ * up to well beyond the last level cache.
+ * The benchmark is pinned to one CPU, and each measurement is repeated
+ * numReps times, printing the median and minimum time per element, in
+ * nanoseconds and in cycles of the time stamp counter (on x86).
+ * An element is a line partitioned, a line merged, a swap, a comparison,
+ * or a pivot selected from a range of PIVOT_RANGE lines.
+ * Usage:
+ *   sortBench [-c <cpu>] [-r <numReps>] [-n <maxLines>] [-k <kernel>]
+ *             [-d <distribution>] [-l <lineLength>]
+ *       -c  the CPU to pin to (the one the benchmark starts on by default)
+ *       -r  the number of times to repeat each measurement (5 by default)
+ *       -n  the largest number of lines to measure with (2^20 by default)
+ *       -k, -d, -l  only measure the given kernel, key distribution
+ *           or line length
+*/
+
+#define _GNU_SOURCE
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <sched.h>
+#include <time.h>
+#ifdef __x86_64__
+#include <x86intrin.h>
+#endif
+
+// Macros to define the measurements: the smallest array of lines, which
+// fits in L1, grows SIZE_STEP times until it reaches maxLines, and each
+// sample runs a kernel over at least MIN_SAMPLE_LINES lines in total
+#define MIN_LINES (1 << 10)
+#define SIZE_STEP 8
+#define DEFAULT_MAX_LINES (1 << 20)
+#define DEFAULT_REPS 5
+#define MIN_SAMPLE_LINES (1 << 20)
+
+// Pivots are selected from ranges of this many lines
+#define PIVOT_RANGE 64
+
+// Lines of the prefix distribution share all but this many bytes
+#define PREFIX_TAIL 8
+
+// Lines of the dups distribution are one of this many distinct lines
+#define NUM_DISTINCT 16
+
+/*
+ * benchData -- the lines a kernel is measured with: numLines lines
+ * generated in lines, a copy in workArray that the kernel may reorder,
+ * and outputArray for the merge. pairs holds the indexes of the swaps.
+*/
+struct benchData {
+	char **lines;
+	char **workArray;
+	char **outputArray;
+	long *pairs;
+	long numLines;
+};
+
+/*
+ * benchKernel -- a kernel implementation to measure. prepare() prepares
+ * the data once for each measurement, and setup() before each run, both
+ * outside of the measured time. run() runs the kernel once and returns
+ * the number of elements it handled.
+*/
+struct benchKernel {
+	char *kernel;
+	char *impl;
+	void (*prepare)(struct benchData*);
+	void (*setup)(struct benchData*);
+	long (*run)(struct benchData*);
+};
+
+// Prototype declaration for main program functions
+void usage(char*);
+void pinCpu(int);
+char **makeLines(char*, int, long, char**);
+uint64_t nextRandom();
+void benchKernel(struct benchKernel*, struct benchData*, int, char*, int);
+uint64_t readCycles();
+double elapsedNs(struct timespec*, struct timespec*);
+int compareDoubles(const void*, const void*);
+int compareStrs(const void*, const void*);
+void setupCopy(struct benchData*);
+void setupHalves(struct benchData*);
+void setupPairs(struct benchData*);
+void setupNone(struct benchData*);
+long runPartition(struct benchData*);
+long runHoarePartition(struct benchData*);
+long runMedian3(struct benchData*);
+long runNinther(struct benchData*);
+long runMerge(struct benchData*);
+long runBranchlessMerge(struct benchData*);
+long runSwap(struct benchData*);
+long runStrcmp(struct benchData*);
+long runPrefixCompare(struct benchData*);
+long partition(char**, long, long);
+long hoarePartition(char**, long, long);
+long selectPivot(char**, long, long);
+long selectNinther(char**, long, long);
+long medianOf3(char**, long, long, long);
+void swapStr(char**, long, long);
+void merge(char**, char **, long, long, long);
+void branchlessMerge(char**, char **, long, long, long);
+int comparePrefix(char*, char*);
+uint64_t prefixKey(char*);
+
+// The kernels measured, each followed by its alternatives
+struct benchKernel kernels[] = {
+	{ "partition", "clrs", setupNone, setupCopy, runPartition },
+	{ "partition", "hoare", setupNone, setupCopy, runHoarePartition },
+	{ "pivot", "median3", setupNone, setupCopy, runMedian3 },
+	{ "pivot", "ninther", setupNone, setupCopy, runNinther },
+	{ "merge", "branch", setupHalves, setupNone, runMerge },
+	{ "merge", "branchless", setupHalves, setupNone, runBranchlessMerge },
+	{ "swap", "swapStr", setupPairs, setupNone, runSwap },
+	{ "compare", "strcmp", setupNone, setupNone, runStrcmp },
+	{ "compare", "prefix", setupNone, setupNone, runPrefixCompare }
+};
+#define NUM_KERNELS (sizeof(kernels) / sizeof(kernels[0]))
+
+// The key distributions and line lengths measured
+char *distributions[] = { "random", "sorted", "reverse", "dups", "prefix" };
+#define NUM_DISTRIBUTIONS 5
+int lineLengths[] = { 8, 32, 128 };
+#define NUM_LINE_LENGTHS 3
+
+// Collects the results of the compares, so they are not optimized away
+volatile long compareSink = 0;
+
+// The state of the random number generator, fixed so runs are repeatable
+uint64_t randomState = 88172645463325252ULL;
+
+/*
+ * void usage(char *progName) --
+ * Prints the command-line usage of the program to stderr and exits.
+*/
+void usage(char *progName) {
+	fprintf(stderr, "%s [-c <cpu>] [-r <numReps>] [-n <maxLines>] [-k <kernel>]\n"
+			"    [-d <distribution>] [-l <lineLength>]\n"
+			"  -c  pin to the given CPU instead of the current one\n"
+			"  -r  repeat each measurement numReps times (default %d)\n"
+			"  -n  measure arrays of up to maxLines lines (default %d)\n"
+			"  -k  only measure partition, pivot, merge, swap or compare\n"
+			"  -d  only measure random, sorted, reverse, dups or prefix keys\n"
+			"  -l  only measure lines of 8, 32 or 128 bytes\n",
+			progName, DEFAULT_REPS, DEFAULT_MAX_LINES);
+	exit(1);
+}
+
+int main (int argc, char *argv[]) {
+
+	// Parse command-line options
+	int cpu = sched_getcpu();
+	int numReps = DEFAULT_REPS;
+	long maxLines = DEFAULT_MAX_LINES;
+	char *onlyKernel = NULL;
+	char *onlyDistribution = NULL;
+	int onlyLength = 0;
+	int opt;
+	while ((opt = getopt(argc, argv, "c:r:n:k:d:l:")) != -1) {
+		switch (opt) {
+		case 'c':
+			// Pin to the given CPU
+			cpu = atoi(optarg);
+			break;
+		case 'r':
+			// Repeat each measurement numReps times
+			numReps = atoi(optarg);
+			break;
+		case 'n':
+			// Measure arrays of up to maxLines lines
+			maxLines = atol(optarg);
+			break;
+		case 'k':
+			// Only measure the given kernel
+			onlyKernel = optarg;
+			break;
+		case 'd':
+			// Only measure the given key distribution
+			onlyDistribution = optarg;
+			break;
+		case 'l':
+			// Only measure the given line length
+			onlyLength = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (argc != optind || cpu < 0 || numReps <= 0 || maxLines < MIN_LINES) {
+		usage(argv[0]);
+	}
+
+	pinCpu(cpu);
+	printf("# pinned to cpu %d, %d reps per measurement, times per element\n", cpu, numReps);
+	printf("%-9s %-10s %-7s %4s %8s %10s %10s %10s\n", "kernel", "impl", "keys", "len",
+			"lines", "ns median", "ns min", "cyc median");
+
+	// Arrays shared by every measurement, big enough for the most lines
+	struct benchData data;
+	data.workArray = malloc(maxLines * sizeof(char*));
+	data.outputArray = malloc(maxLines * sizeof(char*));
+	data.pairs = malloc(2 * maxLines * sizeof(long));
+	if (data.workArray == NULL || data.outputArray == NULL || data.pairs == NULL) {
+		fprintf(stderr, "ERROR: Out of memory!\n");
+		exit(1);
+	}
+
+	// Measure each kernel for each key distribution, line length and size
+	int d, l;
+	unsigned k;
+	for (d = 0; d < NUM_DISTRIBUTIONS; d++) {
+		if (onlyDistribution != NULL && strcmp(onlyDistribution, distributions[d]) != 0)
+			continue;
+		for (l = 0; l < NUM_LINE_LENGTHS; l++) {
+			if (onlyLength != 0 && onlyLength != lineLengths[l])
+				continue;
+
+			// Generate the lines once, using a prefix of them for each size
+			char *lineBuffer;
+			data.lines = makeLines(distributions[d], lineLengths[l], maxLines, &lineBuffer);
+
+			long numLines;
+			for (numLines = MIN_LINES; numLines <= maxLines; numLines *= SIZE_STEP) {
+				data.numLines = numLines;
+				for (k = 0; k < NUM_KERNELS; k++) {
+					if (onlyKernel != NULL && strcmp(onlyKernel, kernels[k].kernel) != 0)
+						continue;
+					benchKernel(&kernels[k], &data, numReps, distributions[d], lineLengths[l]);
+				}
+			}
+
+			free(lineBuffer);
+			free(data.lines);
+		}
+	}
+
+	free(data.workArray);
+	free(data.outputArray);
+	free(data.pairs);
+	exit(0);
+}
+
+/*
+ * void pinCpu(int cpu) --
+ * Pins the benchmark to the given CPU, so the measurements are not
+ * disturbed by moving between CPUs and their caches.
+*/
+void pinCpu(int cpu) {
+	cpu_set_t cpuSet;
+	CPU_ZERO(&cpuSet);
+	CPU_SET(cpu, &cpuSet);
+	if (sched_setaffinity(0, sizeof(cpu_set_t), &cpuSet) < 0) {
+		fprintf(stderr, "Error: could not pin to cpu %d: %s\n", cpu, strerror(errno));
+		exit(1);
+	}
+}
+
+/*
+ * char **makeLines(char *distribution, int lineLen, long numLines, char **lineBuffer) --
+ * Generates numLines lines of lineLen bytes with keys of the given
+ * distribution in a buffer, returned in lineBuffer, and returns an array
+ * of pointers to them. Any prefix of the array has the same distribution.
+ *   random   random lowercase letters
+ *   sorted   random lines in increasing order
+ *   reverse  random lines in decreasing order
+ *   dups     random choices of NUM_DISTINCT random lines
+ *   prefix   random lines sharing all but their last PREFIX_TAIL bytes
+*/
+char **makeLines(char *distribution, int lineLen, long numLines, char **lineBuffer) {
+	char *buffer = malloc(numLines * (lineLen + 1));
+	char **lines = malloc(numLines * sizeof(char*));
+	if (buffer == NULL || lines == NULL) {
+		fprintf(stderr, "ERROR: Out of memory!\n");
+		exit(1);
+	}
+
+	// Fill the lines with random letters
+	long i;
+	int j;
+	for (i = 0; i < numLines; i++) {
+		lines[i] = buffer + i * (lineLen + 1);
+		for (j = 0; j < lineLen; j++)
+			lines[i][j] = 'a' + nextRandom() % 26;
+		lines[i][lineLen] = '\0';
+	}
+
+	if (strcmp(distribution, "sorted") == 0 || strcmp(distribution, "reverse") == 0) {
+		qsort(lines, numLines, sizeof(char*), compareStrs);
+		if (strcmp(distribution, "reverse") == 0) {
+			for (i = 0; i < numLines / 2; i++)
+				swapStr(lines, i, numLines - 1 - i);
+		}
+	}
+	else if (strcmp(distribution, "dups") == 0) {
+		for (i = NUM_DISTINCT; i < numLines; i++)
+			memcpy(lines[i], lines[nextRandom() % NUM_DISTINCT], lineLen);
+	}
+	else if (strcmp(distribution, "prefix") == 0) {
+		int prefixLen = lineLen > PREFIX_TAIL ? lineLen - PREFIX_TAIL : 0;
+		for (i = 1; i < numLines; i++)
+			memcpy(lines[i], lines[0], prefixLen);
+	}
+
+	*lineBuffer = buffer;
+	return lines;
+}
+
+/*
+ * uint64_t nextRandom() --
+ * Returns the next number of a xorshift random number generator.
+*/
+uint64_t nextRandom() {
+	randomState ^= randomState << 13;
+	randomState ^= randomState >> 7;
+	randomState ^= randomState << 17;
+	return randomState;
+}
+
+/*
+ * void benchKernel(struct benchKernel *kernel, struct benchData *data, int numReps,
+ *                  char *distribution, int lineLen) --
+ * Measures the kernel numReps times on the lines in data, and prints the
+ * median and minimum time per element. Each measurement runs the kernel
+ * until it has handled at least MIN_SAMPLE_LINES lines, so arrays that
+ * fit in L1 are not measured in a handful of microseconds, and only the
+ * time spent in run() is counted.
+*/
+void benchKernel(struct benchKernel *kernel, struct benchData *data, int numReps,
+				char *distribution, int lineLen) {
+	double nsPerElement[numReps];
+	double cyclesPerElement[numReps];
+	int rep;
+	kernel->prepare(data);
+	for (rep = 0; rep < numReps; rep++) {
+		double ns = 0;
+		uint64_t cycles = 0;
+		long numElements = 0;
+		long linesRun;
+		for (linesRun = 0; linesRun < MIN_SAMPLE_LINES; linesRun += data->numLines) {
+			kernel->setup(data);
+
+			struct timespec startTime, endTime;
+			clock_gettime(CLOCK_MONOTONIC, &startTime);
+			uint64_t startCycles = readCycles();
+			numElements += kernel->run(data);
+			uint64_t endCycles = readCycles();
+			clock_gettime(CLOCK_MONOTONIC, &endTime);
+
+			ns += elapsedNs(&startTime, &endTime);
+			cycles += endCycles - startCycles;
+		}
+		nsPerElement[rep] = ns / numElements;
+		cyclesPerElement[rep] = (double) cycles / numElements;
+	}
+
+	qsort(nsPerElement, numReps, sizeof(double), compareDoubles);
+	qsort(cyclesPerElement, numReps, sizeof(double), compareDoubles);
+	printf("%-9s %-10s %-7s %4d %8ld %10.2f %10.2f", kernel->kernel, kernel->impl,
+			distribution, lineLen, data->numLines, nsPerElement[numReps / 2], nsPerElement[0]);
+	if (readCycles() != 0)
+		printf(" %10.2f\n", cyclesPerElement[numReps / 2]);
+	else
+		printf(" %10s\n", "-");
+	fflush(stdout);
+}
+
+/*
+ * uint64_t readCycles() --
+ * Returns the time stamp counter on x86, which counts cycles at the
+ * nominal clock rate of the CPU, or 0 where there is none.
+*/
+uint64_t readCycles() {
+#ifdef __x86_64__
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+/*
+ * double elapsedNs(struct timespec *startTime, struct timespec *endTime) --
+ * Returns the nanoseconds from startTime to endTime.
+*/
+double elapsedNs(struct timespec *startTime, struct timespec *endTime) {
+	return (endTime->tv_sec - startTime->tv_sec) * 1e9 +
+			(endTime->tv_nsec - startTime->tv_nsec);
+}
+
+/*
+ * int compareDoubles(const void *a, const void *b) --
+ * Compares two doubles, for sorting the measurements with qsort().
+*/
+int compareDoubles(const void *a, const void *b) {
+	double x = *(const double*) a;
+	double y = *(const double*) b;
+	return (x > y) - (x < y);
+}
+
+/*
+ * int compareStrs(const void *a, const void *b) --
+ * Compares two string pointers, for sorting lines with qsort().
+*/
+int compareStrs(const void *a, const void *b) {
+	return strcmp(*(char* const*) a, *(char* const*) b);
+}
+
+/*
+ * void setupCopy(struct benchData *data) --
+ * Copies the lines to workArray, for the kernels that reorder them.
+*/
+void setupCopy(struct benchData *data) {
+	memcpy(data->workArray, data->lines, data->numLines * sizeof(char*));
+}
+
+/*
+ * void setupHalves(struct benchData *data) --
+ * Copies the lines to workArray and sorts each half of it,
+ * for the merge kernels, which only read workArray.
+*/
+void setupHalves(struct benchData *data) {
+	long mid = data->numLines / 2;
+	setupCopy(data);
+	qsort(data->workArray, mid, sizeof(char*), compareStrs);
+	qsort(data->workArray + mid, data->numLines - mid, sizeof(char*), compareStrs);
+}
+
+/*
+ * void setupPairs(struct benchData *data) --
+ * Copies the lines to workArray and chooses random pairs of indexes
+ * to swap, so the swaps touch the whole array like a partition does.
+ * The swaps only reorder workArray, so it needs no setup between runs.
+*/
+void setupPairs(struct benchData *data) {
+	long i;
+	setupCopy(data);
+	for (i = 0; i < 2 * data->numLines; i++)
+		data->pairs[i] = nextRandom() % data->numLines;
+}
+
+/*
+ * void setupNone(struct benchData *data) --
+ * Leaves the data as it is, for the kernels that only read the lines.
+*/
+void setupNone(struct benchData *data) {
+}
+
+/*
+ * long runPartition(struct benchData *data) --
+ * Partitions the lines with partition().
+*/
+long runPartition(struct benchData *data) {
+	partition(data->workArray, 0, data->numLines - 1);
+	return data->numLines;
+}
+
+/*
+ * long runHoarePartition(struct benchData *data) --
+ * Partitions the lines with hoarePartition().
+*/
+long runHoarePartition(struct benchData *data) {
+	hoarePartition(data->workArray, 0, data->numLines - 1);
+	return data->numLines;
+}
+
+/*
+ * long runMedian3(struct benchData *data) --
+ * Selects a pivot with selectPivot() from each range of PIVOT_RANGE lines.
+*/
+long runMedian3(struct benchData *data) {
+	long lower;
+	for (lower = 0; lower + PIVOT_RANGE <= data->numLines; lower += PIVOT_RANGE)
+		compareSink += selectPivot(data->workArray, lower, lower + PIVOT_RANGE - 1);
+	return data->numLines / PIVOT_RANGE;
+}
+
+/*
+ * long runNinther(struct benchData *data) --
+ * Selects a pivot with selectNinther() from each range of PIVOT_RANGE lines.
+*/
+long runNinther(struct benchData *data) {
+	long lower;
+	for (lower = 0; lower + PIVOT_RANGE <= data->numLines; lower += PIVOT_RANGE)
+		compareSink += selectNinther(data->workArray, lower, lower + PIVOT_RANGE - 1);
+	return data->numLines / PIVOT_RANGE;
+}
+
+/*
+ * long runMerge(struct benchData *data) --
+ * Merges the two sorted halves of the lines with merge().
+*/
+long runMerge(struct benchData *data) {
+	merge(data->workArray, data->outputArray, 0, data->numLines / 2, data->numLines - 1);
+	return data->numLines;
+}
+
+/*
+ * long runBranchlessMerge(struct benchData *data) --
+ * Merges the two sorted halves of the lines with branchlessMerge().
+*/
+long runBranchlessMerge(struct benchData *data) {
+	branchlessMerge(data->workArray, data->outputArray, 0, data->numLines / 2,
+					data->numLines - 1);
+	return data->numLines;
+}
+
+/*
+ * long runSwap(struct benchData *data) --
+ * Swaps numLines random pairs of lines with swapStr().
+*/
+long runSwap(struct benchData *data) {
+	long i;
+	for (i = 0; i < data->numLines; i++)
+		swapStr(data->workArray, data->pairs[2 * i], data->pairs[2 * i + 1]);
+	return data->numLines;
+}
+
+/*
+ * long runStrcmp(struct benchData *data) --
+ * Compares each line with the next with strcmp().
+*/
+long runStrcmp(struct benchData *data) {
+	long i;
+	long sum = 0;
+	for (i = 0; i < data->numLines - 1; i++)
+		sum += strcmp(data->lines[i], data->lines[i + 1]) < 0;
+	compareSink += sum;
+	return data->numLines - 1;
+}
+
+/*
+ * long runPrefixCompare(struct benchData *data) --
+ * Compares each line with the next with comparePrefix().
+*/
+long runPrefixCompare(struct benchData *data) {
+	long i;
+	long sum = 0;
+	for (i = 0; i < data->numLines - 1; i++)
+		sum += comparePrefix(data->lines[i], data->lines[i + 1]) < 0;
+	compareSink += sum;
+	return data->numLines - 1;
+}
+
+/* void partition(char **strArray, long lower, long upper) --
+ * Using the partition algorithm from CLRS, partitions all
+ * elements between and including indexes lower and upper
+ * in strArray around a pivot chosen by the 'median of 3'
+ * method (implemented in selectPivot()).
+ * Returns pivot index
+*/
+long partition(char **strArray, long lower, long upper) {
+
+	//Select the optimal pivot index
+  	long pivot = selectPivot(strArray, lower, upper);
+
+	// Move pivot to the end
+  	swapStr(strArray, pivot, upper);
+
+	// Save value of pivot string for comparison
+  	char* pivotStr = strArray[upper];
+
+	// Variable to keep track of how many strings equivalent
+	// to the pivot we encounter
+	long eqLines = 0;
+
+  	long j;
+  	int strcmpRetVal;
+  	long currIndex = lower - 1;
+
+	// Move the values relative to the pivot
+  	for (j = lower; j <= upper - 1; j++) {
+  		strcmpRetVal = strcmp(strArray[j], pivotStr);
+  		if (strcmpRetVal < 0) {
+  			currIndex++;
+  			swapStr(strArray, currIndex, j);
+  		}
+  		else if (strcmpRetVal == 0) {
+			// Alternate which side equivalent lines are moved
+  			eqLines++;
+  			if (eqLines % 2 == 0) {
+  				currIndex++;
+  				swapStr(strArray, currIndex, j);
+  			}
+  		}
+  	}
+
+	// Move pivot back
+  	swapStr(strArray, currIndex + 1, upper);
+
+	// Return picot index
+  	return currIndex + 1;
+}
+
+/* long hoarePartition(char **strArray, long lower, long upper) --
+ * The alternative to partition(): partitions the same elements around
+ * the same pivot, but scans from both ends towards the middle and only
+ * swaps pairs of lines that are both on the wrong side, so it makes
+ * about a third as many swaps on random keys. Lines equal to the pivot
+ * stop both scans, which splits runs of them evenly.
+ * Returns pivot index
+*/
+long hoarePartition(char **strArray, long lower, long upper) {
+
+	// Move the pivot to the end, out of the way of the scans
+	long pivot = selectPivot(strArray, lower, upper);
+	swapStr(strArray, pivot, upper);
+	char *pivotStr = strArray[upper];
+
+	long i = lower;
+	long j = upper - 1;
+	while (1) {
+		while (i <= j && strcmp(strArray[i], pivotStr) < 0)
+			i++;
+		while (i <= j && strcmp(strArray[j], pivotStr) > 0)
+			j--;
+		if (i >= j)
+			break;
+		swapStr(strArray, i, j);
+		i++;
+		j--;
+	}
+
+	// Move pivot back
+	swapStr(strArray, i, upper);
+	return i;
+}
+
+/* selectPivot(char **strArray, long lower, long upper) --
+ * Uses the 'median of 3' approach to select
+ * (and return the index of) an optimal pivot between
+ * and including lower and upperin strArray for partitioning.
+ * Also sorts 3 of the string pointers relative to
+ * each other within the array, which will aid future sorting.
+ * If the range is 10 or smaller, simply returns upper index.
+*/
+long selectPivot(char **strArray, long lower, long upper) {
+
+	// Abort if range is too small
+ 	if (upper - lower <= 10)
+  		return upper;
+
+	// Set midpoint
+  	long mid = (upper + lower) / 2;
+
+	// Sort the three values
+  	if (strcmp(strArray[mid], strArray[lower]) < 0)
+  		swapStr(strArray, lower, mid);
+  	if (strcmp(strArray[upper], strArray[lower]) < 0)
+  		swapStr(strArray, lower, upper);
+  	if (strcmp(strArray[upper], strArray[mid]) < 0)
+  		swapStr(strArray, mid, upper);
+
+	// Return index of median value
+  	return mid;
+}
+
+/* long selectNinther(char **strArray, long lower, long upper) --
+ * The alternative to selectPivot(): returns the index of the median of
+ * the medians of three groups of three lines spread over the range,
+ * which gives a pivot closer to the true median for 4 to 6 more
+ * compares, without moving any lines.
+ * If the range is 10 or smaller, simply returns upper index.
+*/
+long selectNinther(char **strArray, long lower, long upper) {
+	if (upper - lower <= 10)
+		return upper;
+
+	long step = (upper - lower) / 8;
+	long mid = (upper + lower) / 2;
+	return medianOf3(strArray,
+				medianOf3(strArray, lower, lower + step, lower + 2 * step),
+				medianOf3(strArray, mid - step, mid, mid + step),
+				medianOf3(strArray, upper - 2 * step, upper - step, upper));
+}
+
+/* long medianOf3(char **strArray, long a, long b, long c) --
+ * Returns whichever of the indexes a, b and c in strArray
+ * holds the median of their three lines.
+*/
+long medianOf3(char **strArray, long a, long b, long c) {
+	if (strcmp(strArray[a], strArray[b]) < 0) {
+		if (strcmp(strArray[b], strArray[c]) < 0)
+			return b;
+		return strcmp(strArray[a], strArray[c]) < 0 ? c : a;
+	}
+	if (strcmp(strArray[a], strArray[c]) < 0)
+		return a;
+	return strcmp(strArray[b], strArray[c]) < 0 ? c : b;
+}
+
+/* swapStr(char **strArray, long indexA, long indexB) --
+ * Swaps the string pointers at indexA and indexB in
+ * strArray with one another.
+*/
+void swapStr(char **strArray, long indexA, long indexB) {
+	char* temp = strArray[indexA];
+  	strArray[indexA] = strArray[indexB];
+  	strArray[indexB] = temp;
+}
+
+/* void merge(char **inputArray, char **outputArray, long lower, long mid, long upper) --
+ * Precondition: The stirng pointers in the index ranges lower to mid-1 (inclusive)
+ * are sorted relative to each other in inputArray,
+ * and the stirng pointers in the index ranges mid to upper (inclusive)
+ * are sorted relative to each other in inputArray.
+ *
+ * This method copies all pointers in sorted order from each range in inputArray
+ * to the index range lower to upper (inclusive) in outputArray.
+*/
+void merge(char **inputArray, char **outputArray, long lower, long mid, long upper) {
+
+	// Set up loop variables
+	long i = lower;
+	long j = mid;
+	long k;
+
+	// Merge values
+	for (k = lower; k <= upper; k++) {
+		if (i < mid && j <= upper) {
+			if (strcmp(inputArray[i], inputArray[j]) <= 0) {
+				outputArray[k] = inputArray[i];
+				i++;
+			}
+			else {
+				outputArray[k] = inputArray[j];
+				j++;
+			}
+		}
+		else if (i >= mid) {
+			outputArray[k] = inputArray[j];
+			j++;
+		}
+		else {
+			outputArray[k] = inputArray[i];
+			i++;
+		}
+	}
+}
+
+/* void branchlessMerge(char **inputArray, char **outputArray, long lower, long mid, long upper) --
+ * The alternative to merge(), with the same precondition and result.
+ * While both ranges have lines left, picks the next line and advances
+ * the index it came from with arithmetic on the result of the compare
+ * instead of a branch, which the CPU cannot predict on random keys.
+ * Then copies what is left of either range.
+*/
+void branchlessMerge(char **inputArray, char **outputArray, long lower, long mid, long upper) {
+	long i = lower;
+	long j = mid;
+	long k = lower;
+	while (i < mid && j <= upper) {
+		int takeRight = strcmp(inputArray[i], inputArray[j]) > 0;
+		outputArray[k] = takeRight ? inputArray[j] : inputArray[i];
+		j += takeRight;
+		i += 1 - takeRight;
+		k++;
+	}
+	memcpy(outputArray + k, inputArray + i, (mid - i) * sizeof(char*));
+	k += mid - i;
+	memcpy(outputArray + k, inputArray + j, (upper + 1 - j) * sizeof(char*));
+}
+
+/* int comparePrefix(char *strA, char *strB) --
+ * The alternative to strcmp(): compares the first 8 bytes of both
+ * strings as numbers with prefixKey(), and only calls strcmp() when
+ * they are equal. Returns a number with the same sign as strcmp().
+*/
+int comparePrefix(char *strA, char *strB) {
+	uint64_t keyA = prefixKey(strA);
+	uint64_t keyB = prefixKey(strB);
+	if (keyA != keyB)
+		return keyA < keyB ? -1 : 1;
+	return strcmp(strA, strB);
+}
+
+/* uint64_t prefixKey(char *str) --
+ * Returns the first 8 bytes of str as a big-endian number, padded with
+ * zeros after the end of the string, so that keys compare like strcmp()
+ * on the strings' first 8 bytes.
+*/
+uint64_t prefixKey(char *str) {
+	uint64_t key = 0;
+	int i;
+	for (i = 0; i < 8 && str[i] != '\0'; i++)
+		key |= (uint64_t) (unsigned char) str[i] << (56 - 8 * i);
+	return key;
+}
@@ -0,0 +1,981 @@
+/* sortDaemon -- a long-running sort server for many small and medium
+ * jobs, which would otherwise spend most of their time starting a
+ * process, creating threads and faulting in fresh memory.
+ * The daemon listens on a Unix domain socket and hands each connection
+ * to a pool of worker threads created at startup. Each worker keeps its
+ * file buffer and array of line pointers mapped between jobs, so a job
+ * only grows them when it is larger than every job before it.
+ * Each job is sorted with the CLRS quicksort by the worker that takes it,
+ * so concurrent jobs run on separate workers.
+ * Memory is bounded: no job may be larger than maxJobBytes, so each
+ * worker holds at most about 9 * maxJobBytes, and waiting connections
+ * hold no buffers at all.
+ * A client that sends or reads nothing for IO_TIMEOUT_SECS seconds is
+ * dropped, so idle connections cannot hold every worker.
+ * Usage:
+ *   sortDaemon [-m <maxJobMB>] <socketPath> <numWorkers>
+ *       runs the daemon
+ *   sortDaemon -s <socketPath> [<inputFile> [<outputFile>]]
+ *       sends a job to the daemon: sorts inputFile (or standard input
+ *       if none is given) and prints the sorted lines, or writes them
+ *       to outputFile if one is given
+ * Protocol: each connection carries one job. The client sends a header
+ * line, one of
+ *   SORT <inputLen> <outputLen>\n followed by the two paths
+ *   DATA <numBytes>\n followed by numBytes bytes of lines
+ * The paths are sent as raw bytes, inputLen bytes of the input path then
+ * outputLen bytes of the output path, so they may hold any character.
+ * Both must be absolute; an outputLen of 0 means no output file.
+ * The daemon answers with one of
+ *   OK <numBytes> <numLines> <micros>\n followed by numBytes sorted bytes
+ *   OK <numLines> <micros>\n if an output path was given
+ *   ERR <message>\n
+ * where micros is the time the daemon spent on the job.
+*/
+
+#define _GNU_SOURCE
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/un.h>
+
+// Macros to define the limits and buffer sizes of the daemon
+#define DEFAULT_MAX_JOB_MB 64
+#define QUEUE_LEN 64
+#define HEADER_LEN 4096
+#define INIT_BUFFER_BYTES (1 << 20)
+#define INIT_ARRAY_SZ (1 << 16)
+#define OUTPUT_BUFFER_BYTES (1 << 16)
+#define IO_TIMEOUT_SECS 5
+
+/*
+ * jobQueue -- a bounded queue of accepted connections waiting for
+ * a worker, with the time each one was accepted.
+ * The accept loop waits on notFull and the workers wait on notEmpty.
+*/
+struct jobQueue {
+	int fds[QUEUE_LEN];
+	struct timeval acceptTimes[QUEUE_LEN];
+	int head;
+	int count;
+	long nextJob;
+	pthread_mutex_t lock;
+	pthread_cond_t notEmpty;
+	pthread_cond_t notFull;
+};
+
+/*
+ * workerParams -- a struct to hold the state of one worker
+ * to allow it to be run by pthread_create().
+ * buffer and linesArray are kept between jobs; bufferCap and
+ * arrayCap are the sizes they are currently mapped with.
+ * outputBuffer collects sorted lines before they are written.
+*/
+struct workerParams {
+	struct jobQueue *queue;
+	long maxJobBytes;
+	char *buffer;
+	long bufferCap;
+	char **linesArray;
+	long arrayCap;
+	char *outputBuffer;
+};
+
+// Prototype declaration for main program functions
+void usage(char*);
+void runDaemon(char*, int, long);
+void runClient(char*, char*, char*);
+int openSocket(char*, int);
+void *threadWorker(void*);
+void handleJob(struct workerParams*, int, long, struct timeval*);
+int readHeader(int, char*, int);
+int readJobFile(struct workerParams*, char*, long*, char*);
+int readPath(int, long, char*);
+void reserveBuffer(struct workerParams*, long);
+void reserveArray(struct workerParams*, long);
+void *mapWarm(long);
+void *growMapping(void*, long, long);
+long countLines(char*, long);
+void indexLines(char*, long, char**);
+int writeLines(int, char*, char**, long, long*);
+int readAll(int, char*, long);
+int writeAll(int, char*, long);
+void sendError(int, char*);
+long elapsedMicros(struct timeval*, struct timeval*);
+void quicksort(char**, long, long);
+long partition(char**, long, long);
+long selectPivot(char**, long, long);
+void swapStr(char**, long, long);
+
+/*
+ * void usage(char *progName) --
+ * Prints the command-line usage of the program to stderr and exits.
+*/
+void usage(char *progName) {
+	fprintf(stderr, "%s [-m <maxJobMB>] <socketPath> <numWorkers>\n"
+			"%s -s <socketPath> [<inputFile> [<outputFile>]]\n"
+			"  -m  reject jobs larger than maxJobMB megabytes (default %d)\n"
+			"  -s  send a job to a running daemon and print the result\n",
+			progName, progName, DEFAULT_MAX_JOB_MB);
+	exit(1);
+}
+
+int main (int argc, char *argv[]) {
+
+	// Parse command-line options
+	long maxJobMB = DEFAULT_MAX_JOB_MB;
+	int clientMode = 0;
+	int opt;
+	while ((opt = getopt(argc, argv, "m:s")) != -1) {
+		switch (opt) {
+		case 'm':
+			// Limit the size of each job
+			maxJobMB = atol(optarg);
+			if (maxJobMB <= 0) {
+				fprintf(stderr, "Error: -m requires a positive number of megabytes\n");
+				exit(1);
+			}
+			break;
+		case 's':
+			// Send a job instead of running the daemon
+			clientMode = 1;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	// Send a job to the daemon
+	if (clientMode) {
+		if (argc - optind < 1 || argc - optind > 3)
+			usage(argv[0]);
+		runClient(argv[optind],
+				argc - optind > 1 ? argv[optind + 1] : NULL,
+				argc - optind > 2 ? argv[optind + 2] : NULL);
+		exit(0);
+	}
+
+	// Exit if the wrong number of arguments is given
+	if (argc - optind != 2) {
+		fprintf(stderr, "Error: Exactly 2 arguments required:\n");
+		usage(argv[0]);
+	}
+
+	// Exit if the number of workers is not positive
+	int numWorkers = atoi(argv[optind + 1]);
+	if (numWorkers <= 0) {
+		fprintf(stderr, "Error: numWorkers must be positive\n");
+		exit(1);
+	}
+
+	runDaemon(argv[optind], numWorkers, maxJobMB << 20);
+	exit(0);
+}
+
+/*
+ * void runDaemon(char *socketPath, int numWorkers, long maxJobBytes) --
+ * Starts numWorkers worker threads, each with warm buffers, then
+ * accepts connections on socketPath forever, queueing each one for
+ * the next free worker. Jobs larger than maxJobBytes are rejected.
+*/
+void runDaemon(char *socketPath, int numWorkers, long maxJobBytes) {
+
+	// A client that hangs up must not kill the daemon
+	signal(SIGPIPE, SIG_IGN);
+
+	int listenFd = openSocket(socketPath, 1);
+
+	// Set up the queue of accepted connections
+	struct jobQueue queue;
+	queue.head = 0;
+	queue.count = 0;
+	queue.nextJob = 1;
+	pthread_mutex_init(&queue.lock, NULL);
+	pthread_cond_init(&queue.notEmpty, NULL);
+	pthread_cond_init(&queue.notFull, NULL);
+
+	// pthread variable declarations
+	int i, result;
+	pthread_t threadID;
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	pthread_attr_setscope(&attr, PTHREAD_SCOPE_SYSTEM);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+	// Start the workers with buffers that are already faulted in
+	for (i = 0; i < numWorkers; i++) {
+		struct workerParams *params = malloc(sizeof(struct workerParams));
+		char *outputBuffer = malloc(OUTPUT_BUFFER_BYTES);
+		if (params == NULL || outputBuffer == NULL) {
+			fprintf(stderr, "ERROR: Out of memory!\n");
+			exit(1);
+		}
+		params->queue = &queue;
+		params->maxJobBytes = maxJobBytes;
+		params->bufferCap = INIT_BUFFER_BYTES;
+		params->buffer = mapWarm(params->bufferCap);
+		params->arrayCap = INIT_ARRAY_SZ;
+		params->linesArray = mapWarm(params->arrayCap * sizeof(char*));
+		params->outputBuffer = outputBuffer;
+
+		result = pthread_create(&threadID, &attr, threadWorker, (void *) params);
+
+		if (result != 0) {
+			fprintf(stderr, "pthread_create failed, result = %d\n", result);
+			exit(1);
+		}
+	}
+
+	fprintf(stderr, "sortDaemon: listening on %s with %d workers, %ld MB per job\n",
+			socketPath, numWorkers, maxJobBytes >> 20);
+
+	// Queue each connection for a worker, waiting while the queue is full
+	while (1) {
+		int fd = accept(listenFd, NULL, NULL);
+		if (fd < 0) {
+			if (errno != EINTR)
+				perror("accept");
+			continue;
+		}
+
+		// Make the worker's reads and writes on the connection time out
+		struct timeval timeout;
+		timeout.tv_sec = IO_TIMEOUT_SECS;
+		timeout.tv_usec = 0;
+		if (setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) < 0 ||
+				setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout)) < 0) {
+			perror("setsockopt");
+			close(fd);
+			continue;
+		}
+
+		pthread_mutex_lock(&queue.lock);
+		while (queue.count == QUEUE_LEN)
+			pthread_cond_wait(&queue.notFull, &queue.lock);
+		int slot = (queue.head + queue.count) % QUEUE_LEN;
+		queue.fds[slot] = fd;
+		gettimeofday(&queue.acceptTimes[slot], NULL);
+		queue.count++;
+		pthread_cond_signal(&queue.notEmpty);
+		pthread_mutex_unlock(&queue.lock);
+	}
+}
+
+/*
+ * int openSocket(char *socketPath, int listening) --
+ * Creates a Unix domain stream socket for socketPath. If listening is
+ * set, binds it to socketPath, replacing any stale socket file, and
+ * listens on it; otherwise connects it to the daemon at socketPath.
+ * Returns the socket.
+*/
+int openSocket(char *socketPath, int listening) {
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (strlen(socketPath) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "Error: socket path \'%s\' is too long\n", socketPath);
+		exit(1);
+	}
+	strcpy(addr.sun_path, socketPath);
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) {
+		perror("socket");
+		exit(1);
+	}
+
+	if (listening) {
+		unlink(socketPath);
+		if (bind(fd, (struct sockaddr*) &addr, sizeof(addr)) < 0 ||
+				listen(fd, QUEUE_LEN) < 0) {
+			perror("bind");
+			exit(1);
+		}
+	}
+	else if (connect(fd, (struct sockaddr*) &addr, sizeof(addr)) < 0) {
+		fprintf(stderr, "Error: no daemon is listening on \'%s\'\n", socketPath);
+		exit(1);
+	}
+
+	return fd;
+}
+
+/*
+ * void *threadWorker(void *arg) --
+ * Runs one worker of the daemon: takes connections from the queue
+ * in the struct pointer specified by arg and handles their jobs, forever.
+*/
+void *threadWorker(void *arg) {
+	// Cast arg to workerParams*
+	struct workerParams *params = (struct workerParams*) arg;
+	struct jobQueue *queue = params->queue;
+
+	while (1) {
+		// Wait for a connection
+		pthread_mutex_lock(&queue->lock);
+		while (queue->count == 0)
+			pthread_cond_wait(&queue->notEmpty, &queue->lock);
+		int fd = queue->fds[queue->head];
+		struct timeval acceptTime = queue->acceptTimes[queue->head];
+		long jobNum = queue->nextJob;
+		queue->nextJob++;
+		queue->head = (queue->head + 1) % QUEUE_LEN;
+		queue->count--;
+		pthread_cond_signal(&queue->notFull);
+		pthread_mutex_unlock(&queue->lock);
+
+		handleJob(params, fd, jobNum, &acceptTime);
+		close(fd);
+	}
+
+	// Exit thread
+	pthread_exit( NULL );
+}
+
+/*
+ * void handleJob(struct workerParams *params, int fd, long jobNum,
+ *                struct timeval *acceptTime) --
+ * Reads the job on connection fd into the worker's buffer, sorts its
+ * lines and answers with the sorted lines or the path they were written
+ * to. Errors are reported to the client, never ending the daemon.
+ * Prints the latency of the job to stderr: the time it waited in the
+ * queue, the time spent sorting and the total time since acceptTime.
+*/
+void handleJob(struct workerParams *params, int fd, long jobNum,
+				struct timeval *acceptTime) {
+
+	struct timeval startTime, sortTime, endTime;
+	gettimeofday(&startTime, NULL);
+
+	// Read the header line
+	char header[HEADER_LEN];
+	if (readHeader(fd, header, HEADER_LEN) < 0) {
+		sendError(fd, "bad header");
+		return;
+	}
+
+	// Read the lines of the job into the buffer
+	long dataSize;
+	char *outputPath = NULL;
+	char inputPath[PATH_MAX];
+	char outputPathBuffer[PATH_MAX];
+	char errorMsg[HEADER_LEN + 64];
+	if (strncmp(header, "SORT ", 5) == 0) {
+		long inputLen, outputLen;
+		if (sscanf(header + 5, "%ld %ld", &inputLen, &outputLen) != 2) {
+			sendError(fd, "bad header");
+			return;
+		}
+		if (readPath(fd, inputLen, inputPath) < 0) {
+			sendError(fd, "the input path must be absolute");
+			return;
+		}
+		if (outputLen != 0) {
+			if (readPath(fd, outputLen, outputPathBuffer) < 0) {
+				sendError(fd, "the output path must be absolute");
+				return;
+			}
+			outputPath = outputPathBuffer;
+		}
+		if (readJobFile(params, inputPath, &dataSize, errorMsg) < 0) {
+			sendError(fd, errorMsg);
+			return;
+		}
+	}
+	else if (strncmp(header, "DATA ", 5) == 0) {
+		dataSize = atol(header + 5);
+		if (dataSize < 0 || dataSize > params->maxJobBytes) {
+			sendError(fd, "job is too large");
+			return;
+		}
+		reserveBuffer(params, dataSize + 1);
+		if (readAll(fd, params->buffer, dataSize) < 0) {
+			sendError(fd, "connection closed before all data was sent");
+			return;
+		}
+	}
+	else {
+		sendError(fd, "unknown command");
+		return;
+	}
+
+	// Index and sort the lines
+	long totalLines = countLines(params->buffer, dataSize);
+	reserveArray(params, totalLines);
+	indexLines(params->buffer, dataSize, params->linesArray);
+	quicksort(params->linesArray, 0, totalLines - 1);
+	gettimeofday(&sortTime, NULL);
+
+	// Answer with the sorted lines, or write them to the output file
+	char reply[HEADER_LEN + 128];
+	long outputSize = 0;
+	int result;
+	if (outputPath != NULL) {
+		int outFd = open(outputPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (outFd < 0) {
+			snprintf(errorMsg, sizeof(errorMsg), "cannot write \'%s\'", outputPath);
+			sendError(fd, errorMsg);
+			return;
+		}
+		result = writeLines(outFd, params->outputBuffer, params->linesArray,
+							totalLines, &outputSize);
+		close(outFd);
+		if (result < 0) {
+			snprintf(errorMsg, sizeof(errorMsg), "cannot write \'%s\'", outputPath);
+			sendError(fd, errorMsg);
+			return;
+		}
+		snprintf(reply, sizeof(reply), "OK %ld %ld\n", totalLines,
+				elapsedMicros(&startTime, &sortTime));
+		result = writeAll(fd, reply, strlen(reply));
+	}
+	else {
+		// Every line is followed by a newline, including the last
+		long i;
+		for (i = 0; i < totalLines; i++)
+			outputSize += strlen(params->linesArray[i]) + 1;
+		snprintf(reply, sizeof(reply), "OK %ld %ld %ld\n", outputSize, totalLines,
+				elapsedMicros(&startTime, &sortTime));
+		result = writeAll(fd, reply, strlen(reply));
+		if (result == 0)
+			result = writeLines(fd, params->outputBuffer, params->linesArray,
+								totalLines, &outputSize);
+	}
+
+	// Print the latency of the job to stderr
+	gettimeofday(&endTime, NULL);
+	fprintf(stderr, "job %ld: %ld lines, %ld bytes%s, queued %ld us, sorted %ld us, "
+			"total %ld us\n", jobNum, totalLines, dataSize,
+			result < 0 ? " (client hung up)" : "",
+			elapsedMicros(acceptTime, &startTime),
+			elapsedMicros(&startTime, &sortTime),
+			elapsedMicros(acceptTime, &endTime));
+}
+
+/*
+ * int readHeader(int fd, char *header, int maxLen) --
+ * Reads one line of at most maxLen-1 bytes from fd into header,
+ * replacing its newline with '\0'. Reads one byte at a time so
+ * that none of the data after the header is consumed.
+ * Returns 0 on success, or -1 if the line is too long, or if fd
+ * closes or times out first.
+*/
+int readHeader(int fd, char *header, int maxLen) {
+	int len = 0;
+	while (len < maxLen - 1) {
+		ssize_t result = read(fd, header + len, 1);
+		if (result < 0 && errno == EINTR)
+			continue;
+		if (result <= 0)
+			return -1;
+		if (header[len] == '\n') {
+			header[len] = '\0';
+			return 0;
+		}
+		len++;
+	}
+	return -1;
+}
+
+/*
+ * int readPath(int fd, long len, char *path) --
+ * Reads a path of len bytes from fd into path, which holds PATH_MAX
+ * bytes, and ends it with '\0'.
+ * Returns 0 on success, or -1 if the path is empty, too long, relative
+ * or holds a '\0', or if fd closes first.
+*/
+int readPath(int fd, long len, char *path) {
+	if (len <= 0 || len >= PATH_MAX || readAll(fd, path, len) < 0)
+		return -1;
+	path[len] = '\0';
+	if (path[0] != '/' || strlen(path) != len)
+		return -1;
+	return 0;
+}
+
+/*
+ * int readJobFile(struct workerParams *params, char *fileName,
+ *                 long *dataSize, char *errorMsg) --
+ * Reads the whole file fileName into the worker's buffer,
+ * and sets dataSize to the number of bytes read.
+ * Returns 0 on success, or -1 with a message in errorMsg.
+*/
+int readJobFile(struct workerParams *params, char *fileName,
+				long *dataSize, char *errorMsg) {
+
+	// Open file for reading
+	int fd = open(fileName, O_RDONLY);
+	if (fd < 0) {
+		sprintf(errorMsg, "the file \'%s\' does not exist", fileName);
+		return -1;
+	}
+
+	// Reject files larger than the job limit
+	struct stat fileStat;
+	if (fstat(fd, &fileStat) < 0 || fileStat.st_size > params->maxJobBytes) {
+		close(fd);
+		sprintf(errorMsg, "the file \'%s\' is too large", fileName);
+		return -1;
+	}
+
+	reserveBuffer(params, fileStat.st_size + 1);
+	int result = readAll(fd, params->buffer, fileStat.st_size);
+	close(fd);
+	if (result < 0) {
+		sprintf(errorMsg, "cannot read \'%s\'", fileName);
+		return -1;
+	}
+
+	*dataSize = fileStat.st_size;
+	return 0;
+}
+
+/*
+ * void reserveBuffer(struct workerParams *params, long len) --
+ * Grows the worker's buffer to hold at least len bytes,
+ * at least doubling it so that growth is rare.
+*/
+void reserveBuffer(struct workerParams *params, long len) {
+	if (len <= params->bufferCap)
+		return;
+	long newCap = params->bufferCap * 2 > len ? params->bufferCap * 2 : len;
+	params->buffer = growMapping(params->buffer, params->bufferCap, newCap);
+	params->bufferCap = newCap;
+}
+
+/*
+ * void reserveArray(struct workerParams *params, long len) --
+ * Grows the worker's array to hold at least len string pointers,
+ * at least doubling it so that growth is rare.
+*/
+void reserveArray(struct workerParams *params, long len) {
+	if (len <= params->arrayCap)
+		return;
+	long newCap = params->arrayCap * 2 > len ? params->arrayCap * 2 : len;
+	params->linesArray = growMapping(params->linesArray, params->arrayCap * sizeof(char*),
+									newCap * sizeof(char*));
+	params->arrayCap = newCap;
+}
+
+/*
+ * void *mapWarm(long len) --
+ * Maps len bytes of memory with every page faulted in up front,
+ * so the first jobs do not pay for page faults.
+ * Returns a pointer to the new mapping.
+*/
+void *mapWarm(long len) {
+	void *memoryBuffer = mmap(	NULL, len, PROT_READ | PROT_WRITE,
+								MAP_ANONYMOUS | MAP_PRIVATE | MAP_POPULATE, -1, 0);
+	if ( memoryBuffer == MAP_FAILED ) {
+  		fprintf(stderr, "errno is %d\n", errno);
+  		perror("memoryBuffer is MAP_FAILED ");
+  		exit(1);
+	}
+	return memoryBuffer;
+}
+
+/*
+ * void *growMapping(void *oldMapping, long oldLen, long newLen) --
+ * Grows a mapping from oldLen to newLen bytes, moving it if
+ * there is no room to grow in place.
+ * Returns a pointer to the grown mapping.
+*/
+void *growMapping(void *oldMapping, long oldLen, long newLen) {
+	void *memoryBuffer = mremap(oldMapping, oldLen, newLen, MREMAP_MAYMOVE);
+	if ( memoryBuffer == MAP_FAILED ) {
+  		fprintf(stderr, "errno is %d\n", errno);
+  		perror("memoryBuffer is MAP_FAILED ");
+  		exit(1);
+	}
+	return memoryBuffer;
+}
+
+/*
+ * long countLines(char *buffer, long dataSize) --
+ * Returns the number of lines in the dataSize bytes of buffer,
+ * counting a last line that has no newline.
+*/
+long countLines(char *buffer, long dataSize) {
+	char *curr = buffer;
+	char *end = buffer + dataSize;
+	char *newline;
+	long numLines = 0;
+
+	while (curr < end) {
+		newline = memchr(curr, '\n', end - curr);
+		numLines++;
+		if (newline == NULL)
+			break;
+		curr = newline + 1;
+	}
+
+	return numLines;
+}
+
+/*
+ * void indexLines(char *buffer, long dataSize, char **linesArray) --
+ * Terminates each line of the dataSize bytes in buffer with '\0' and
+ * stores a pointer to it in linesArray, which must have room for
+ * every line counted by countLines().
+*/
+void indexLines(char *buffer, long dataSize, char **linesArray) {
+	char *curr = buffer;
+	char *end = buffer + dataSize;
+	char *newline;
+	long numLines = 0;
+
+	// Terminate each line and add it to the array
+	buffer[dataSize] = '\0';
+	while (curr < end) {
+		newline = memchr(curr, '\n', end - curr);
+		if (newline == NULL)
+			newline = end;
+		*newline = '\0';
+		linesArray[numLines] = curr;
+		numLines++;
+		curr = newline + 1;
+	}
+}
+
+/*
+ * int writeLines(int fd, char *outputBuffer, char **linesArray,
+ *                long totalLines, long *outputSize) --
+ * Writes the lines in linesArray indexes (0 - totalLines) to fd, each
+ * followed by a newline, collecting them in outputBuffer so that they
+ * are written in large pieces. Sets outputSize to the bytes written.
+ * Returns 0 on success, or -1 if a write fails or times out.
+*/
+int writeLines(int fd, char *outputBuffer, char **linesArray,
+				long totalLines, long *outputSize) {
+	long fill = 0;
+	long written = 0;
+	long i;
+
+	for (i = 0; i < totalLines; i++) {
+		long len = strlen(linesArray[i]);
+
+		// Make room for the line, writing very long lines directly
+		if (fill + len + 1 > OUTPUT_BUFFER_BYTES) {
+			if (writeAll(fd, outputBuffer, fill) < 0)
+				return -1;
+			written += fill;
+			fill = 0;
+		}
+		if (len + 1 > OUTPUT_BUFFER_BYTES) {
+			if (writeAll(fd, linesArray[i], len) < 0 || writeAll(fd, "\n", 1) < 0)
+				return -1;
+			written += len + 1;
+			continue;
+		}
+
+		memcpy(outputBuffer + fill, linesArray[i], len);
+		outputBuffer[fill + len] = '\n';
+		fill += len + 1;
+	}
+
+	if (writeAll(fd, outputBuffer, fill) < 0)
+		return -1;
+	*outputSize = written + fill;
+	return 0;
+}
+
+/*
+ * int readAll(int fd, char *data, long len) --
+ * Reads exactly len bytes from fd into data.
+ * Returns 0 on success, or -1 if a read fails or times out,
+ * or if fd ends first.
+*/
+int readAll(int fd, char *data, long len) {
+	while (len > 0) {
+		ssize_t result = read(fd, data, len);
+		if (result < 0 && errno == EINTR)
+			continue;
+		if (result <= 0)
+			return -1;
+		data += result;
+		len -= result;
+	}
+	return 0;
+}
+
+/*
+ * int writeAll(int fd, char *data, long len) --
+ * Writes all len bytes of data to fd.
+ * Returns 0 on success, or -1 if a write fails or times out.
+*/
+int writeAll(int fd, char *data, long len) {
+	while (len > 0) {
+		ssize_t result = write(fd, data, len);
+		if (result < 0 && errno == EINTR)
+			continue;
+		if (result < 0)
+			return -1;
+		data += result;
+		len -= result;
+	}
+	return 0;
+}
+
+/*
+ * void sendError(int fd, char *message) --
+ * Answers the job on connection fd with an error message.
+*/
+void sendError(int fd, char *message) {
+	char reply[HEADER_LEN + 128];
+	snprintf(reply, sizeof(reply), "ERR %s\n", message);
+	writeAll(fd, reply, strlen(reply));
+}
+
+/*
+ * long elapsedMicros(struct timeval *startTime, struct timeval *endTime) --
+ * Returns the number of microseconds from startTime to endTime.
+*/
+long elapsedMicros(struct timeval *startTime, struct timeval *endTime) {
+	return (endTime->tv_sec - startTime->tv_sec) * 1000000L +
+			(endTime->tv_usec - startTime->tv_usec);
+}
+
+/*
+ * void runClient(char *socketPath, char *inputFile, char *outputFile) --
+ * Sends a job to the daemon at socketPath: sorts inputFile, or the lines
+ * on standard input if inputFile is NULL, and prints the sorted lines,
+ * or has the daemon write them to outputFile if it is not NULL.
+ * Prints the time the daemon took and the round trip time to stderr.
+*/
+void runClient(char *socketPath, char *inputFile, char *outputFile) {
+	struct timeval startTime, endTime;
+	gettimeofday(&startTime, NULL);
+
+	// If the daemon rejects the job early, read its reply instead of dying
+	signal(SIGPIPE, SIG_IGN);
+
+	int fd = openSocket(socketPath, 0);
+	char header[64];
+
+	if (inputFile != NULL) {
+		// Send the absolute paths, since the daemon runs elsewhere
+		char inputPath[PATH_MAX];
+		char outputPath[2 * PATH_MAX];
+		outputPath[0] = '\0';
+		if (realpath(inputFile, inputPath) == NULL) {
+			fprintf(stderr, "The file \'%s\' does not exist.\n", inputFile);
+			exit(1);
+		}
+		if (outputFile != NULL) {
+			char cwd[PATH_MAX];
+			if (outputFile[0] == '/')
+				snprintf(outputPath, sizeof(outputPath), "%s", outputFile);
+			else if (getcwd(cwd, sizeof(cwd)) != NULL)
+				snprintf(outputPath, sizeof(outputPath), "%s/%s", cwd, outputFile);
+			else {
+				perror("getcwd");
+				exit(1);
+			}
+			if (outputFile[0] == '\0' || strlen(outputPath) >= PATH_MAX) {
+				fprintf(stderr, "The output file '%s' is not valid.\n", outputFile);
+				exit(1);
+			}
+		}
+		// Send the lengths of the paths, then the paths themselves
+		snprintf(header, sizeof(header), "SORT %ld %ld\n", (long) strlen(inputPath),
+				(long) strlen(outputPath));
+		if (writeAll(fd, header, strlen(header)) < 0 ||
+			writeAll(fd, inputPath, strlen(inputPath)) < 0 ||
+			writeAll(fd, outputPath, strlen(outputPath)) < 0) {
+			perror("write");
+			exit(1);
+		}
+	}
+	else {
+		// Read standard input, then send it after its size
+		long dataCap = INIT_BUFFER_BYTES;
+		long dataSize = 0;
+		char *data = malloc(dataCap);
+		ssize_t result;
+		while (data != NULL && (result = read(STDIN_FILENO, data + dataSize,
+											dataCap - dataSize)) != 0) {
+			if (result < 0 && errno == EINTR)
+				continue;
+			if (result < 0) {
+				perror("read");
+				exit(1);
+			}
+			dataSize += result;
+			if (dataSize == dataCap) {
+				dataCap *= 2;
+				data = realloc(data, dataCap);
+			}
+		}
+		if (data == NULL) {
+			fprintf(stderr, "ERROR: Out of memory!\n");
+			exit(1);
+		}
+		// A failed write means the daemon has already replied
+		snprintf(header, sizeof(header), "DATA %ld\n", dataSize);
+		if (writeAll(fd, header, strlen(header)) == 0)
+			writeAll(fd, data, dataSize);
+		free(data);
+	}
+
+	// Read the reply
+	char reply[HEADER_LEN + 128];
+	if (readHeader(fd, reply, sizeof(reply)) < 0) {
+		fprintf(stderr, "Error: the daemon closed the connection\n");
+		exit(1);
+	}
+	if (strncmp(reply, "OK ", 3) != 0) {
+		fprintf(stderr, "Error: %s\n", strncmp(reply, "ERR ", 4) == 0 ? reply + 4 : reply);
+		exit(1);
+	}
+
+	// Copy the sorted lines to standard output
+	long numLines, micros;
+	if (outputFile == NULL) {
+		long outputSize;
+		if (sscanf(reply + 3, "%ld %ld %ld", &outputSize, &numLines, &micros) != 3 ||
+			outputSize < 0) {
+			fprintf(stderr, "Error: bad reply '%s'\n", reply);
+			exit(1);
+		}
+		char *buffer = malloc(OUTPUT_BUFFER_BYTES);
+		if (buffer == NULL) {
+			fprintf(stderr, "ERROR: Out of memory!\n");
+			exit(1);
+		}
+		while (outputSize > 0) {
+			long len = outputSize < OUTPUT_BUFFER_BYTES ? outputSize : OUTPUT_BUFFER_BYTES;
+			if (readAll(fd, buffer, len) < 0) {
+				fprintf(stderr, "Error: the daemon closed the connection\n");
+				exit(1);
+			}
+			writeAll(STDOUT_FILENO, buffer, len);
+			outputSize -= len;
+		}
+		free(buffer);
+	}
+	else {
+		// The reply carries no byte count, since nothing follows it
+		long extra;
+		if (sscanf(reply + 3, "%ld %ld %ld", &numLines, &micros, &extra) != 2) {
+			fprintf(stderr, "Error: bad reply '%s'\n", reply);
+			exit(1);
+		}
+	}
+	close(fd);
+
+	/* Print runtime info to stderr for performance testing */
+	gettimeofday(&endTime, NULL);
+	fprintf(stderr, "%ld lines, daemon time: %ld microseconds, round trip: %ld microseconds\n",
+			numLines, micros, elapsedMicros(&startTime, &endTime));
+}
+
+/* void quicksort(char **strArray, long lower, long upper) -- Using the
+ * quicksort algorithm from CLRS, recursively sorts all elements
+ * between and including indexes upper and lower in strArray.
+*/
+void quicksort(char **strArray, long lower, long upper) {
+	if (lower < upper) {
+		// Partition range
+		long pivot = partition(strArray, lower, upper);
+		// Call quicksort again on each range around pivot
+		quicksort(strArray, lower, pivot - 1);
+		quicksort(strArray, pivot + 1, upper);
+	}
+}
+
+/* long partition(char **strArray, long lower, long upper) --
+ * Partitions the elements between and including upper and lower
+ * in strArray around a pivot chosen by the 'median of 3'
+ * method (implemented in selectPivot()).
+ * Returns pivot index
+*/
+long partition(char **strArray, long lower, long upper) {
+
+	//Select the optimal pivot index
+	long pivot = selectPivot(strArray, lower, upper);
+
+	// Move pivot to the end
+	swapStr(strArray, pivot, upper);
+
+	// Save value of pivot string for comparison
+	char* pivotStr = strArray[upper];
+
+	// Variable to keep track of how many strings equivalent
+	// to the pivot we encounter
+	long eqLines = 0;
+
+	long j;
+	int strcmpRetVal;
+	long currIndex = lower - 1;
+
+	// Move the values relative to the pivot
+	for (j = lower; j <= upper - 1; j++) {
+		strcmpRetVal = strcmp(strArray[j], pivotStr);
+		if (strcmpRetVal < 0) {
+			currIndex++;
+			swapStr(strArray, currIndex, j);
+		}
+		else if (strcmpRetVal == 0) {
+			// Alternate which side equivalent lines are moved
+			eqLines++;
+			if (eqLines % 2 == 0) {
+				currIndex++;
+				swapStr(strArray, currIndex, j);
+			}
+		}
+	}
+
+	// Move pivot back
+	swapStr(strArray, currIndex + 1, upper);
+
+	// Return pivot index
+	return currIndex + 1;
+}
+
+/* long selectPivot(char **strArray, long lower, long upper) --
+ * Uses the 'median of 3' approach to select
+ * (and return the index of) an optimal pivot between
+ * and including lower and upper in strArray for partitioning.
+ * If the range is 10 or smaller, simply returns upper index.
+*/
+long selectPivot(char **strArray, long lower, long upper) {
+
+	// Abort if range is too small
+	if (upper - lower <= 10)
+		return upper;
+
+	// Set midpoint
+	long mid = (upper + lower) / 2;
+
+	// Sort the three values
+	if (strcmp(strArray[mid], strArray[lower]) < 0)
+		swapStr(strArray, lower, mid);
+	if (strcmp(strArray[upper], strArray[lower]) < 0)
+		swapStr(strArray, lower, upper);
+	if (strcmp(strArray[upper], strArray[mid]) < 0)
+		swapStr(strArray, mid, upper);
+
+	// Return index of median value
+	return mid;
+}
+
+/* void swapStr(char **strArray, long indexA, long indexB) --
+ * Swaps the string pointers at indexA and indexB in
+ * strArray with one another.
+*/
+void swapStr(char **strArray, long indexA, long indexB) {
+	char* temp = strArray[indexA];
+	strArray[indexA] = strArray[indexB];
+	strArray[indexB] = temp;
+}
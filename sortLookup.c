@@ -0,0 +1,280 @@
+/* sortLookup -- finds lines in a file sorted by sortSeq or sortThread,
+ * using the binary index they write with the -x option.
+ * The index and the sorted file are mapped into memory and searched
+ * with a binary search, so each lookup takes O(log n) comparisons,
+ * most of which are decided by the key prefixes stored in the index.
+ * Usage:
+ *   sortLookup <indexFile> <sortedFile> exact <key>
+ *       prints every line equal to key
+ *   sortLookup <indexFile> <sortedFile> prefix <prefix>
+ *       prints every line that starts with prefix
+ *   sortLookup <indexFile> <sortedFile> range <lower> <upper>
+ *       prints every line from lower (inclusive) to upper (exclusive)
+*/
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+// Macros to define the format of the index written with -x
+#define INDEX_MAGIC "QSIDX01"
+#define INDEX_PREFIX_LEN 8
+
+/*
+ * indexHeader -- the start of an index file written with -x.
+ * magic holds INDEX_MAGIC, numLines is the number of lines
+ * in the sorted output, and dataSize is its size in bytes.
+*/
+struct indexHeader {
+	char magic[8];
+	uint64_t numLines;
+	uint64_t dataSize;
+};
+
+/*
+ * indexEntry -- one line of the sorted output in an index file:
+ * the byte offset where the line starts, and the first
+ * INDEX_PREFIX_LEN bytes of the line, padded with '\0'.
+*/
+struct indexEntry {
+	uint64_t offset;
+	char prefix[INDEX_PREFIX_LEN];
+};
+
+/*
+ * sortedIndex -- a mapped index file and the sorted file it describes.
+*/
+struct sortedIndex {
+	struct indexEntry *entries;
+	uint64_t numLines;
+	char *data;
+	uint64_t dataSize;
+};
+
+// Prototype declaration for main program functions
+void usage(char*);
+void *mapFile(char*, uint64_t*);
+void openIndex(char*, char*, struct sortedIndex*);
+uint64_t lowerBound(struct sortedIndex*, char*);
+int compareLine(struct sortedIndex*, uint64_t, char*);
+int hasPrefix(struct sortedIndex*, uint64_t, char*);
+void printLine(struct sortedIndex*, uint64_t);
+
+/*
+ * void usage(char *progName) --
+ * Prints the command-line usage of the program to stderr and exits.
+*/
+void usage(char *progName) {
+	fprintf(stderr, "%s <indexFile> <sortedFile> exact <key>\n"
+			"%s <indexFile> <sortedFile> prefix <prefix>\n"
+			"%s <indexFile> <sortedFile> range <lower> <upper>\n",
+			progName, progName, progName);
+	exit(1);
+}
+
+int main (int argc, char *argv[]) {
+
+	// Exit if the wrong number of arguments is given
+	if (argc < 5) {
+		usage(argv[0]);
+	}
+
+	// Map the index and the sorted file
+	struct sortedIndex index;
+	openIndex(argv[1], argv[2], &index);
+
+	// Print the lines matching the query
+	char *command = argv[3];
+	uint64_t i;
+	if (strcmp(command, "exact") == 0 && argc == 5) {
+		for (i = lowerBound(&index, argv[4]);
+				i < index.numLines && compareLine(&index, i, argv[4]) == 0; i++) {
+			printLine(&index, i);
+		}
+	}
+	else if (strcmp(command, "prefix") == 0 && argc == 5) {
+		for (i = lowerBound(&index, argv[4]);
+				i < index.numLines && hasPrefix(&index, i, argv[4]); i++) {
+			printLine(&index, i);
+		}
+	}
+	else if (strcmp(command, "range") == 0 && argc == 6) {
+		for (i = lowerBound(&index, argv[4]);
+				i < index.numLines && compareLine(&index, i, argv[5]) < 0; i++) {
+			printLine(&index, i);
+		}
+	}
+	else {
+		usage(argv[0]);
+	}
+
+	exit(0);
+}
+
+/*
+ * void *mapFile(char *fileName, uint64_t *fileSize) --
+ * Maps the whole file fileName into memory for reading,
+ * and sets fileSize to its size in bytes.
+ * Returns a pointer to the mapped file, or NULL if the file is empty.
+*/
+void *mapFile(char *fileName, uint64_t *fileSize) {
+
+	// Open file for reading
+	int fd = open(fileName, O_RDONLY);
+
+	// Exit if file does not open
+	if (fd < 0) {
+		fprintf(stderr, "The file \'%s\' does not exist.\n", fileName);
+		exit(1);
+	}
+
+	// Find the size of the file
+	struct stat fileStat;
+	if (fstat(fd, &fileStat) < 0) {
+		perror("fstat");
+		exit(1);
+	}
+	*fileSize = fileStat.st_size;
+
+	// Empty files cannot be mapped
+	if (*fileSize == 0) {
+		close(fd);
+		return NULL;
+	}
+
+	void *memoryBuffer = mmap(NULL, *fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+	if ( memoryBuffer == MAP_FAILED ) {
+		fprintf(stderr, "errno is %d\n", errno);
+		perror("memoryBuffer is MAP_FAILED ");
+		exit(1);
+	}
+	close(fd);
+
+	return memoryBuffer;
+}
+
+/*
+ * void openIndex(char *indexFileName, char *sortedFileName, struct sortedIndex *index) --
+ * Maps the index file indexFileName and the sorted file sortedFileName,
+ * and sets up index to search them.
+ * Exits if the index is not valid or was not written for the sorted file.
+*/
+void openIndex(char *indexFileName, char *sortedFileName, struct sortedIndex *index) {
+
+	uint64_t indexSize;
+	char *indexData = mapFile(indexFileName, &indexSize);
+	index->data = mapFile(sortedFileName, &index->dataSize);
+
+	// Check the header of the index
+	struct indexHeader *header = (struct indexHeader*) indexData;
+	if (indexSize < sizeof(struct indexHeader) ||
+			memcmp(header->magic, INDEX_MAGIC, sizeof(header->magic)) != 0 ||
+			indexSize != sizeof(struct indexHeader) +
+							header->numLines * sizeof(struct indexEntry)) {
+		fprintf(stderr, "Error: \'%s\' is not a valid index file\n", indexFileName);
+		exit(1);
+	}
+
+	// Check that the index matches the sorted file
+	if (header->dataSize != index->dataSize) {
+		fprintf(stderr, "Error: the index \'%s\' was not written for \'%s\'\n",
+				indexFileName, sortedFileName);
+		exit(1);
+	}
+
+	index->numLines = header->numLines;
+	index->entries = (struct indexEntry*) (indexData + sizeof(struct indexHeader));
+}
+
+/*
+ * uint64_t lowerBound(struct sortedIndex *index, char *key) --
+ * Using a binary search, returns the index of the first line
+ * that is not less than key, or numLines if there is none.
+*/
+uint64_t lowerBound(struct sortedIndex *index, char *key) {
+	uint64_t lower = 0;
+	uint64_t upper = index->numLines;
+
+	while (lower < upper) {
+		uint64_t mid = lower + (upper - lower) / 2;
+		if (compareLine(index, mid, key) < 0)
+			lower = mid + 1;
+		else
+			upper = mid;
+	}
+
+	return lower;
+}
+
+/*
+ * int compareLine(struct sortedIndex *index, uint64_t lineNum, char *key) --
+ * Compares line lineNum of the sorted file with key in the same way
+ * as strcmp(). The prefix stored in the index decides most comparisons
+ * without reading the sorted file.
+*/
+int compareLine(struct sortedIndex *index, uint64_t lineNum, char *key) {
+
+	// Compare the prefixes, padded with '\0' like the index
+	char keyPrefix[INDEX_PREFIX_LEN];
+	strncpy(keyPrefix, key, INDEX_PREFIX_LEN);
+	int result = memcmp(index->entries[lineNum].prefix, keyPrefix, INDEX_PREFIX_LEN);
+	if (result != 0)
+		return result;
+
+	// Equal prefixes that end before INDEX_PREFIX_LEN are equal strings
+	if (memchr(keyPrefix, '\0', INDEX_PREFIX_LEN) != NULL)
+		return 0;
+
+	// Otherwise compare the rest of the line, which ends at a newline
+	unsigned char *line = (unsigned char*) index->data + index->entries[lineNum].offset;
+	unsigned char *end = (unsigned char*) index->data + index->dataSize;
+	unsigned char *keyByte = (unsigned char*) key;
+	line += INDEX_PREFIX_LEN;
+	keyByte += INDEX_PREFIX_LEN;
+	while (line < end && *line != '\n' && *line == *keyByte) {
+		line++;
+		keyByte++;
+	}
+	int lineByte = (line < end && *line != '\n') ? *line : 0;
+	return lineByte - *keyByte;
+}
+
+/*
+ * int hasPrefix(struct sortedIndex *index, uint64_t lineNum, char *prefix) --
+ * Returns 1 if line lineNum of the sorted file starts with prefix, or 0 if not.
+*/
+int hasPrefix(struct sortedIndex *index, uint64_t lineNum, char *prefix) {
+	char *line = index->data + index->entries[lineNum].offset;
+	char *end = index->data + index->dataSize;
+
+	while (*prefix != '\0') {
+		if (line >= end || *line == '\n' || *line != *prefix)
+			return 0;
+		line++;
+		prefix++;
+	}
+
+	return 1;
+}
+
+/*
+ * void printLine(struct sortedIndex *index, uint64_t lineNum) --
+ * Prints line lineNum of the sorted file, followed by a newline.
+*/
+void printLine(struct sortedIndex *index, uint64_t lineNum) {
+	char *line = index->data + index->entries[lineNum].offset;
+	char *end = index->data + index->dataSize;
+	char *newline = memchr(line, '\n', end - line);
+	if (newline == NULL)
+		newline = end;
+
+	fwrite(line, 1, newline - line, stdout);
+	putchar('\n');
+}
@@ -10,43 +10,221 @@
  * CLRS quicksort algorithm.
  * The number of processes to create is the first command line argument.
  * The path of the file to be sorted is the second command-line argument.
+ * Options may be given before the arguments:
+ *   -u  prints each distinct line once (like sort -u)
+ *   -c  prints each distinct line once with its count (like sort | uniq -c)
+ *   -l  merges the sorted slices using the longest common prefixes of
+ *       neighbouring lines, so prefixes shared by many lines (like paths
+ *       or URLs) are not compared again at every merge step
+ *   -S  publishes the phase and per-process progress of the sort in the
+ *       shared memory segment /sortstat.<pid>, which sortStat reads
+ *   -V  merges the sorted slices by 8 byte keys of the first bytes of each
+ *       line, several keys at a time with AVX2 or SSE4.2 bitonic merge
+ *       networks when the CPU supports them, comparing whole lines only
+ *       where the keys are equal
 */
 
+#define _GNU_SOURCE
 #include <unistd.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#ifdef __x86_64__
+#include <immintrin.h>
+#endif
 
-// Macro to define initial size of the array
-#define INIT_ARRAY_SZ 128
+// Macros to define the telemetry segment published with -S
+#define STATS_MAGIC "QSSTAT1"
+#define STATS_MAX_WORKERS 16
+#define STATS_PHASE_READ 1
+#define STATS_PHASE_SORT 2
+#define STATS_PHASE_MERGE 3
+#define STATS_PHASE_WRITE 4
+#define STATS_PHASE_DONE 5
+
+// Merges and writes publish their progress every this many lines
+#define STATS_UPDATE_LINES 4096
+
+// The smallest page size, used to keep word-sized reads within a page
+#define MIN_PAGE_SIZE 4096
+
+/*
+ * lineTable -- an open-addressing hash table holding each
+ * distinct line and the number of times it occurs, used by
+ * the -u and -c modes to collapse duplicate lines before sorting.
+*/
+struct lineTable {
+	char **lines;
+	long *counts;
+	unsigned long mask;
+};
+
+/*
+ * statsWorker -- the counters one worker publishes in the telemetry
+ * segment: lines done out of linesTotal in the current phase, bytes
+ * written, and the phase and merge level it is working on. Each worker
+ * process only writes its own counters, which fill a cache line of their own.
+*/
+struct statsWorker {
+	volatile uint64_t linesDone;
+	volatile uint64_t linesTotal;
+	volatile uint64_t bytesWritten;
+	volatile uint32_t phase;
+	volatile uint32_t mergeLevel;
+	char padding[32];
+};
+
+/*
+ * statsSegment -- the telemetry segment published with -S.
+ * magic holds STATS_MAGIC, phase is the STATS_PHASE the sort is in,
+ * which started at phaseStart (in microseconds since the epoch),
+ * and numWorkers is the number of entries of workers in use.
+*/
+struct statsSegment {
+	char magic[8];
+	uint64_t pid;
+	volatile uint64_t totalLines;
+	volatile uint64_t phaseStart;
+	volatile uint32_t phase;
+	volatile uint32_t mergeLevel;
+	uint32_t numWorkers;
+	char padding[20];
+	struct statsWorker workers[STATS_MAX_WORKERS];
+};
+
+// The telemetry segment published with -S (NULL otherwise),
+// and the counters in it updated by the calling process
+struct statsSegment *stats = NULL;
+struct statsWorker *workerStats = NULL;
+
+// The kernel that merges the keys of -V, chosen for the CPU by
+// selectMergeKernel(), and its name
+void (*mergeKernel)(int64_t*, char**, long, int64_t*, char**, long, int64_t*, char**) = NULL;
+char *mergeKernelName = NULL;
 
 // Prototype declaration for main program functions
-char **multiProcessSort(char**, int, int);
-void merge(char**, char **, int, int, int);
-void quicksort(char**, int, int);
-int partition(char**, int, int);
-int selectPivot(char**, int, int);
-void swapStr(char**, int, int);
-char **extendArray(char**, int, int);
+void usage(char*);
+char **multiProcessSort(char**, long, int, int, int);
+void merge(char**, char **, long, long, long);
+void lcpMerge(char**, char**, long*, long*, long, long, long);
+long nextLcp(char**, long*, long);
+int compareFrom(char*, char*, long*);
+long *allocLcpArray(long);
+void selectMergeKernel();
+int64_t mergeKey(char*);
+uint64_t prefixKey(char*);
+int64_t *allocKeyArray(long);
+void keyMerge(int64_t*, int64_t*, char**, char**, long, long, long);
+void fixKeyTies(int64_t*, int64_t*, char**, char**, long, long, long);
+void mergeKeysScalar(int64_t*, char**, long, int64_t*, char**, long, int64_t*, char**);
+void mergeKeysTail(int64_t*, char**, long, int64_t*, char**, long,
+					int64_t*, char**, int, int64_t*, char**);
+#ifdef __x86_64__
+void mergeKeysAvx2(int64_t*, char**, long, int64_t*, char**, long, int64_t*, char**);
+void bitonicMergeAvx2(__m256i*, __m256i*, __m256i*, __m256i*);
+void bitonicSortAvx2(__m256i*, __m256i*);
+void mergeKeysSse(int64_t*, char**, long, int64_t*, char**, long, int64_t*, char**);
+void bitonicMergeSse(__m128i*, __m128i*, __m128i*, __m128i*);
+#endif
+void statsOpen(int);
+void statsClose();
+void statsPhase(int, int);
+void statsAttach(int, long);
+void quicksort(char**, long, long);
+long partition(char**, long, long);
+long selectPivot(char**, long, long);
+void swapStr(char**, long, long);
+long uniqueLines(char**, long, struct lineTable*);
+long lineCount(struct lineTable*, char*);
+unsigned long findLine(struct lineTable*, char*);
+unsigned long hashStr(char*);
+char **readLines(char*, int, char**, long*, long*);
+long lineBoundary(char*, long, long);
+long countLines(char*, long, long);
+void indexLines(char*, long, long, char**, long);
 
 
 
+/*
+ * void usage(char *progName) --
+ * Prints the command-line usage of the program to stderr and exits.
+*/
+void usage(char *progName) {
+	fprintf(stderr, "%s [-u | -c] [-l | -V] [-S] <numProcesses> <fileName>\n"
+			"  -u  print each distinct line once\n"
+			"  -c  print each distinct line once, prefixed by its count\n"
+			"  -l  merge slices using the common prefixes of neighbouring lines\n"
+			"  -S  publish the progress of the sort for sortStat\n"
+			"  -V  merge slices by keys of their first bytes, with SIMD\n"
+			"      merge networks when the CPU supports them\n",
+			progName);
+	exit(1);
+}
+
 int main (int argc, char *argv[]) {
 
-	// Exit if file does not open
-  	if (argc != 3) {
-  		fprintf(stderr, "Error: Exactly 2 arguments required:\n%s <numProcesses> <fileName>\n",
-  				argv[0]);
-  		exit(1);
+	// Parse command-line options
+	int uniqueMode = 0;
+	int countMode = 0;
+	int lcpMode = 0;
+	int statsMode = 0;
+	int keyMode = 0;
+	int opt;
+	while ((opt = getopt(argc, argv, "uclSV")) != -1) {
+		switch (opt) {
+		case 'u':
+			// Print each distinct line once
+			uniqueMode = 1;
+			break;
+		case 'c':
+			// Print each distinct line once, prefixed by its count
+			uniqueMode = 1;
+			countMode = 1;
+			break;
+		case 'l':
+			// Merge using the common prefixes of neighbouring lines
+			lcpMode = 1;
+			break;
+		case 'S':
+			// Publish the progress of the sort
+			statsMode = 1;
+			break;
+		case 'V':
+			// Merge by keys of the first bytes of the lines
+			keyMode = 1;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	// Exit if both merge variants are asked for
+	if (lcpMode && keyMode) {
+		fprintf(stderr, "Error: -l cannot be combined with -V\n");
+		exit(1);
+	}
+	if (keyMode) {
+		selectMergeKernel();
+		fprintf(stderr, "merge kernel: %s\n", mergeKernelName);
+	}
+
+	// Exit if the wrong number of arguments is given
+  	if (argc - optind != 2) {
+  		fprintf(stderr, "Error: Exactly 2 arguments required:\n");
+  		usage(argv[0]);
   	}
 
 	// Set number of threads
-	int numProcesses = atoi(argv[1]);
+	int numProcesses = atoi(argv[optind]);
 
 	// Exit if number of threads is not a power of 2 (max 16)
 	if (numProcesses != 1 &&
@@ -58,80 +236,50 @@ int main (int argc, char *argv[]) {
 	  		exit(1);
 		}
 
-  	// Open file for reading
-	FILE *inputFile = fopen(argv[2], "r");
-
-  	// Exit if file does not open
-  	if (inputFile == NULL) {
-  		fprintf(stderr, "The file \'%s\' does not exist.\n", argv[2]);
-  		exit(1);
-  	}
-
-	// Create an array in shared memory to hold lines from the file
-	void *memoryBuffer = mmap(	NULL, (INIT_ARRAY_SZ * sizeof(char*)), PROT_READ | PROT_WRITE,
-								MAP_ANONYMOUS | MAP_SHARED, -1, 0);
-	if ( memoryBuffer == MAP_FAILED ) {
-  		fprintf(stderr, "errno is %d\n", errno);
-  		perror("memoryBuffer is MAP_FAILED ");
-  		exit(1);
+	// Publish the progress of the sort
+	if (statsMode) {
+		statsOpen(numProcesses);
+		statsPhase(STATS_PHASE_READ, 0);
 	}
-  	char **linesArray = (char**) memoryBuffer;
-
-  	// Declare variables for our file-reading loop
-  	int arrayLen = INIT_ARRAY_SZ;
-  	char *buf = NULL;
-  	size_t bufLen = 0;
-  	int lineIndex = 0;
-
-	/* Read all lines from the file into an
-	 * array of strings, extending the array as needed*/
-  	while (getline(&buf, &bufLen, inputFile) != EOF) {
-
-  		// If the array is full, resize it
-  		if (lineIndex >= arrayLen) {
-  			int newArrayLen = arrayLen * 2;
-  			linesArray = extendArray(linesArray, arrayLen, newArrayLen);
-
-			// Check for unsuccessful malloc
-			if (linesArray == NULL) {
-  				fprintf(stderr, "ERROR: Out of memory!\n");
-  				exit(1);
-  			}
 
-			// Reset array length variable
-  			arrayLen = newArrayLen;
-  		}
-
-  		// Remove final newline characters to standardize lines
-  		int lineLen = strlen(buf);
-  		if (buf[lineLen - 1] == '\n') {
-  			buf[lineLen - 1] = '\0';
-  		}
-
-		// Add string pointer to the array
-  		linesArray[lineIndex] = buf;
-  		buf = NULL;
-  		lineIndex++;
-  	}
-
-	// Cleanup memory from file input
-	free(buf);
-	fclose(inputFile);
-
-  	// New variale for total lines in array for code clarity
-  	int totalLines = lineIndex;
+	// Read and index all lines from the file, using numProcesses
+	// processes to find the line boundaries
+	char *fileBuffer;
+	long fileSize;
+	long totalLines;
+	char **linesArray = readLines(argv[optind + 1], numProcesses, &fileBuffer, &fileSize, &totalLines);
+	if (stats != NULL)
+		stats->totalLines = totalLines;
+	statsPhase(STATS_PHASE_SORT, 0);
 
 	// Keep track of start time for sort runtime calculation
 	struct timeval startTime, endTime;
 	int seconds, micros;
 	gettimeofday(&startTime, NULL);
 
+	// Collapse duplicate lines so only distinct lines are sorted
+	struct lineTable table;
+	if (uniqueMode) {
+		long numDistinct = uniqueLines(linesArray, totalLines, &table);
+
+		// Shrink the shared array to fit the distinct lines
+		linesArray = mremap(linesArray, (totalLines + 1) * sizeof(char*),
+							(numDistinct + 1) * sizeof(char*), 0);
+		if ( linesArray == MAP_FAILED ) {
+	  		fprintf(stderr, "errno is %d\n", errno);
+	  		perror("linesArray is MAP_FAILED ");
+	  		exit(1);
+		}
+		totalLines = numDistinct;
+	}
+
 	// Sort the array
 	if (totalLines >= numProcesses) {
-		linesArray = multiProcessSort(linesArray, totalLines, numProcesses);
+		linesArray = multiProcessSort(linesArray, totalLines, numProcesses, lcpMode, keyMode);
 	}
 	else {
 		// Sort the array using quicksort
+		statsAttach(0, totalLines);
 	  	quicksort(linesArray, 0, totalLines - 1);
 	}
 
@@ -145,30 +293,74 @@ int main (int argc, char *argv[]) {
   	}
   	fprintf(stderr, "runtime: %d seconds, %d microseconds\n", seconds, micros);
 
-	// Print all lines of the array in order,
-	// freeing each line from memory after print
-	int i;
+	// Print page fault counts of this process and
+	// the sort processes to stderr for performance testing
+	struct rusage usage, childUsage;
+	getrusage(RUSAGE_SELF, &usage);
+	getrusage(RUSAGE_CHILDREN, &childUsage);
+	fprintf(stderr, "page faults: %ld minor, %ld major\n",
+			usage.ru_minflt + childUsage.ru_minflt,
+			usage.ru_majflt + childUsage.ru_majflt);
+
+	// Print all lines of the array in order
+	statsPhase(STATS_PHASE_WRITE, 0);
+	statsAttach(0, totalLines);
+	long bytesWritten = 0;
+	long i;
   	for (i = 0; i < totalLines; i++) {
-  		printf("%s\n", linesArray[i]);
-		free(linesArray[i]);
+		if (countMode)
+			bytesWritten += printf("%7ld %s\n", lineCount(&table, linesArray[i]),
+									linesArray[i]);
+		else
+  			bytesWritten += printf("%s\n", linesArray[i]);
+
+		// Publish the progress of the output
+		if (workerStats != NULL && i % STATS_UPDATE_LINES == 0) {
+			workerStats->linesDone = i;
+			workerStats->bytesWritten = bytesWritten;
+		}
   	}
+	if (workerStats != NULL) {
+		workerStats->linesDone = totalLines;
+		workerStats->bytesWritten = bytesWritten;
+	}
 
-	// unmap the array of poitners
-	munmap(linesArray, arrayLen * sizeof(char*));
+	// unmap the array of poitners and the buffer holding the lines
+	munmap(linesArray, (totalLines + 1) * sizeof(char*));
+	munmap(fileBuffer, fileSize + 1);
+	if (uniqueMode) {
+		free(table.lines);
+		free(table.counts);
+	}
 
 	exit(0);
 }
 
 /*
- * char **multiProcessSort(char **linesArray, int totalLines, int numThreads) --
+ * char **multiProcessSort(char **linesArray, long totalLines, int numThreads,
+ *                         int useLcp, int useKeys) --
  * Breaks linesArray indexes (0 - totalLines) into a number of ranges
  * specified by numProcesses, then, using quicksort, sorts each of those
  * ranges alphabetically by the string they point to using separate processes.
  * Afterwards, merges those ranges back together using spearate threads
  * until all string poitners (0 - totalLines) are sorted.
+ * If useLcp is set, the merges use lcpMerge(), and the first round
+ * finds the common prefixes of neighbouring lines as it goes.
+ * If useKeys is set, the sorting processes also make the merge key of
+ * each line, and the merges use keyMerge().
  * Returns a pointer to the sorted array.
 */
-char **multiProcessSort(char** linesArray, int totalLines, int numProcesses) {
+char **multiProcessSort(char** linesArray, long totalLines, int numProcesses,
+						int useLcp, int useKeys) {
+
+	// Set up the shared merge key arrays, which the sorting processes fill
+	int64_t *inputKeys = NULL;
+	int64_t *outputKeys = NULL;
+	int64_t *tempKeys;
+	if (useKeys && numProcesses > 1) {
+		inputKeys = allocKeyArray(totalLines);
+		outputKeys = allocKeyArray(totalLines);
+	}
 
 	pid_t kidpid[numProcesses];
 	int i, kid_status;
@@ -180,9 +372,17 @@ char **multiProcessSort(char** linesArray, int totalLines, int numProcesses) {
 		}
 
 		if (kidpid[i] == 0) {
-			int lower = i * totalLines / numProcesses;
-			int upper = (i + 1) * totalLines / numProcesses - 1;
+			long lower = i * totalLines / numProcesses;
+			long upper = (i + 1) * totalLines / numProcesses - 1;
+			statsAttach(i, upper - lower + 1);
 			quicksort(linesArray, lower, upper);
+
+			// Make the merge keys of the sorted lines
+			long j;
+			if (inputKeys != NULL) {
+				for (j = lower; j <= upper; j++)
+					inputKeys[j] = mergeKey(linesArray[j]);
+			}
 			exit(getpid());
 		}
 	}
@@ -194,20 +394,33 @@ char **multiProcessSort(char** linesArray, int totalLines, int numProcesses) {
 
 	// Set up auxiliary array in shared memory for
 	// merging and swapping between two arrays
-	void** memoryBuffer = mmap(	NULL, (totalLines * sizeof(char*)), PROT_READ | PROT_WRITE,
+	void** memoryBuffer = mmap(	NULL, ((totalLines + 1) * sizeof(char*)), PROT_READ | PROT_WRITE,
 								MAP_ANONYMOUS | MAP_SHARED, -1, 0);
 	if ( memoryBuffer == MAP_FAILED ) {
   		fprintf(stderr, "errno is %d\n", errno);
   		perror("memoryBuffer is MAP_FAILED ");
   		exit(1);
 	}
+
+	// Huge pages are only a hint, so ignore failure
+	madvise(memoryBuffer, (totalLines + 1) * sizeof(char*), MADV_HUGEPAGE);
+
 	char** inputArray = linesArray;
 	char** outputArray = (char**) memoryBuffer;
 	char** temp;
 
+	// Set up the shared common prefix arrays, which the first round fills
+	long *inputLcp = NULL;
+	long *outputLcp = NULL;
+	long *tempLcp;
+	if (useLcp)
+		outputLcp = allocLcpArray(totalLines);
+
 	// Merge until all strings are sorted
 	int numMerges = numProcesses / 2;
+	int mergeLevel = 1;
 	while (numMerges > 0) {
+		statsPhase(STATS_PHASE_MERGE, mergeLevel);
 
 		// Create new processes for merging
 		for (i = 0; i < numMerges; i++) {
@@ -220,11 +433,19 @@ char **multiProcessSort(char** linesArray, int totalLines, int numProcesses) {
 			}
 
 			if (kidpid[i] == 0) {
-				int lower = i * totalLines / numMerges;
-				int upper = (i + 1) * totalLines / numMerges - 1;
-				int mid = 	((i * totalLines / numMerges) +
-							((i + 1) * totalLines / numMerges)) / 2;
-				merge(inputArray, outputArray, lower, mid, upper);
+				long lower = i * totalLines / numMerges;
+				long upper = (i + 1) * totalLines / numMerges - 1;
+				// mid must be the boundary between the two ranges
+				// sorted in the previous round, which is not always
+				// the average of lower and upper after rounding
+				long mid = (2 * i + 1) * totalLines / (2 * numMerges);
+				statsAttach(i, upper - lower + 1);
+				if (useLcp)
+					lcpMerge(inputArray, outputArray, inputLcp, outputLcp, lower, mid, upper);
+				else if (inputKeys != NULL)
+					keyMerge(inputKeys, outputKeys, inputArray, outputArray, lower, mid, upper);
+				else
+					merge(inputArray, outputArray, lower, mid, upper);
 				exit(getpid());
 			}
 
@@ -239,19 +460,36 @@ char **multiProcessSort(char** linesArray, int totalLines, int numProcesses) {
 		temp = inputArray;
 		inputArray = outputArray;
 		outputArray = temp;
+		tempKeys = inputKeys;
+		inputKeys = outputKeys;
+		outputKeys = tempKeys;
+		tempLcp = inputLcp;
+		inputLcp = outputLcp;
+		outputLcp = tempLcp;
+		if (useLcp && outputLcp == NULL)
+			outputLcp = allocLcpArray(totalLines);
 
 		// Reset number of lerges left
 		numMerges = numMerges / 2;
+		mergeLevel++;
 	}
 
-	// unmap the array of poitners
-	munmap(outputArray, totalLines * sizeof(char*));
+	// unmap the array of poitners and the common prefix arrays
+	munmap(outputArray, (totalLines + 1) * sizeof(char*));
+	if (useLcp) {
+		munmap(inputLcp, (totalLines + 1) * sizeof(long));
+		munmap(outputLcp, (totalLines + 1) * sizeof(long));
+	}
+	if (inputKeys != NULL) {
+		munmap(inputKeys, (totalLines + 1) * sizeof(int64_t));
+		munmap(outputKeys, (totalLines + 1) * sizeof(int64_t));
+	}
 
 	// Return the sorted array
 	return inputArray;
 }
 
-/* void merge(char **inputArray, char **outputArray, int lower, int mid, int upper) --
+/* void merge(char **inputArray, char **outputArray, long lower, long mid, long upper) --
  * Precondition: The stirng pointers in the index ranges lower to mid-1 (inclusive)
  * are sorted relative to each other in inputArray,
  * and the stirng pointers in the index ranges mid to upper (inclusive)
@@ -260,15 +498,17 @@ char **multiProcessSort(char** linesArray, int totalLines, int numProcesses) {
  * This method copies all pointers in sorted order from each range in inputArray
  * to the index range lower to upper (inclusive) in outputArray.
 */
-void merge(char **inputArray, char **outputArray, int lower, int mid, int upper) {
+void merge(char **inputArray, char **outputArray, long lower, long mid, long upper) {
 
 	// Set up loop variables
-	int i = lower;
-	int j = mid;
-	int k;
+	long i = lower;
+	long j = mid;
+	long k;
 
 	// Merge values
 	for (k = lower; k <= upper; k++) {
+		if (workerStats != NULL && (k - lower) % STATS_UPDATE_LINES == 0)
+			workerStats->linesDone = k - lower;
 		if (i < mid && j <= upper) {
 			if (strcmp(inputArray[i], inputArray[j]) <= 0) {
 				outputArray[k] = inputArray[i];
@@ -290,31 +530,660 @@ void merge(char **inputArray, char **outputArray, int lower, int mid, int upper)
   	}
 }
 
-/* void quicksort(char **strArray, int lower, int upper) -- Using the
+/* void lcpMerge(char **inputArray, char **outputArray, long *inputLcp,
+ *               long *outputLcp, long lower, long mid, long upper) --
+ * Precondition: as for merge(), and inputLcp[i] holds the length of the
+ * longest common prefix of inputArray[i-1] and inputArray[i] for every
+ * index i in either range except the first of each. If inputLcp is NULL,
+ * those prefixes are found as each line is reached instead.
+ *
+ * Merges the two ranges like merge(), but keeps the common prefix of each
+ * range's next line with the last line copied. The line sharing the longer
+ * prefix is the smaller one, and lines sharing the same prefix are only
+ * compared from where they may differ, so long shared prefixes are not
+ * read again. Fills outputLcp for lower to upper in the same way.
+*/
+void lcpMerge(char **inputArray, char **outputArray, long *inputLcp,
+				long *outputLcp, long lower, long mid, long upper) {
+
+	// Set up loop variables
+	long i = lower;
+	long j = mid;
+	long k;
+
+	// Common prefix of the next line of each range with the last line copied
+	long lcpI = 0;
+	long lcpJ = 0;
+	int takeI;
+
+	// Merge values
+	for (k = lower; k <= upper; k++) {
+		if (workerStats != NULL && (k - lower) % STATS_UPDATE_LINES == 0)
+			workerStats->linesDone = k - lower;
+		if (i < mid && j <= upper) {
+			if (lcpI != lcpJ) {
+				// The line sharing more with the last line is smaller
+				takeI = lcpI > lcpJ;
+			}
+			else {
+				// Compare from the first byte that may differ
+				long lcp = lcpI;
+				takeI = compareFrom(inputArray[i], inputArray[j], &lcp) <= 0;
+				if (takeI)
+					lcpJ = lcp;
+				else
+					lcpI = lcp;
+			}
+		}
+		else {
+			takeI = j > upper;
+		}
+
+		if (takeI) {
+			outputArray[k] = inputArray[i];
+			outputLcp[k] = lcpI;
+			i++;
+			if (i < mid)
+				lcpI = nextLcp(inputArray, inputLcp, i);
+		}
+		else {
+			outputArray[k] = inputArray[j];
+			outputLcp[k] = lcpJ;
+			j++;
+			if (j <= upper)
+				lcpJ = nextLcp(inputArray, inputLcp, j);
+		}
+  	}
+}
+
+/*
+ * long nextLcp(char **strArray, long *lcpArray, long index) --
+ * Returns the length of the longest common prefix of strArray[index-1]
+ * and strArray[index], read from lcpArray, or found by comparing the
+ * lines if lcpArray is NULL.
+*/
+long nextLcp(char **strArray, long *lcpArray, long index) {
+	long lcp = 0;
+	if (lcpArray != NULL)
+		return lcpArray[index];
+	compareFrom(strArray[index - 1], strArray[index], &lcp);
+	return lcp;
+}
+
+/*
+ * int compareFrom(char *strA, char *strB, long *lcp) --
+ * Precondition: strA and strB share their first *lcp bytes.
+ * Compares strA and strB in the same way as strcmp(), starting at
+ * byte *lcp, and sets *lcp to the length of their common prefix.
+ * Equal bytes are skipped 8 at a time while neither read crosses into
+ * another page, so reading past the end of a string never faults.
+*/
+int compareFrom(char *strA, char *strB, long *lcp) {
+	unsigned char *byteA = (unsigned char*) strA + *lcp;
+	unsigned char *byteB = (unsigned char*) strB + *lcp;
+	uint64_t wordA, wordB;
+	while (((uintptr_t) byteA & (MIN_PAGE_SIZE - 1)) <= MIN_PAGE_SIZE - sizeof(uint64_t) &&
+			((uintptr_t) byteB & (MIN_PAGE_SIZE - 1)) <= MIN_PAGE_SIZE - sizeof(uint64_t)) {
+		memcpy(&wordA, byteA, sizeof(uint64_t));
+		memcpy(&wordB, byteB, sizeof(uint64_t));
+
+		// Stop at the word holding the first difference or the end of strA
+		if (wordA != wordB ||
+				((wordA - 0x0101010101010101ULL) & ~wordA & 0x8080808080808080ULL) != 0)
+			break;
+		byteA += sizeof(uint64_t);
+		byteB += sizeof(uint64_t);
+	}
+	while (*byteA != '\0' && *byteA == *byteB) {
+		byteA++;
+		byteB++;
+	}
+	*lcp = byteA - (unsigned char*) strA;
+	return *byteA - *byteB;
+}
+
+/*
+ * long *allocLcpArray(long len) --
+ * Allocates an array of len common prefix lengths in shared memory,
+ * so that the merge processes can fill it for the next round.
+*/
+long *allocLcpArray(long len) {
+	long *lcpArray = mmap(NULL, (len + 1) * sizeof(long), PROT_READ | PROT_WRITE,
+							MAP_ANONYMOUS | MAP_SHARED, -1, 0);
+	if ( lcpArray == MAP_FAILED ) {
+  		fprintf(stderr, "errno is %d\n", errno);
+  		perror("lcpArray is MAP_FAILED ");
+  		exit(1);
+	}
+	return lcpArray;
+}
+
+/*
+ * void selectMergeKernel() --
+ * Chooses the kernel keyMerge() merges keys with, from the instruction
+ * sets this CPU supports: AVX2, then SSE4.2, then plain C.
+*/
+void selectMergeKernel() {
+	mergeKernel = mergeKeysScalar;
+	mergeKernelName = "scalar";
+#ifdef __x86_64__
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		mergeKernel = mergeKeysAvx2;
+		mergeKernelName = "avx2";
+	}
+	else if (__builtin_cpu_supports("sse4.2")) {
+		mergeKernel = mergeKeysSse;
+		mergeKernelName = "sse4.2";
+	}
+#endif
+}
+
+/*
+ * int64_t *allocKeyArray(long len) --
+ * Allocates an array of len merge keys in shared memory,
+ * so that the sort and merge processes can fill it for the next round.
+*/
+int64_t *allocKeyArray(long len) {
+	int64_t *keyArray = mmap(NULL, (len + 1) * sizeof(int64_t), PROT_READ | PROT_WRITE,
+							MAP_ANONYMOUS | MAP_SHARED, -1, 0);
+	if ( keyArray == MAP_FAILED ) {
+  		fprintf(stderr, "errno is %d\n", errno);
+  		perror("keyArray is MAP_FAILED ");
+  		exit(1);
+	}
+	return keyArray;
+}
+
+/*
+ * int64_t mergeKey(char *line) --
+ * Returns the merge key of line: its first 8 bytes as a big-endian
+ * number, as in prefixKey(), with the sign bit flipped so the keys
+ * order like the lines' first bytes as signed numbers.
+*/
+int64_t mergeKey(char *line) {
+	return (int64_t) (prefixKey(line) ^ 0x8000000000000000ULL);
+}
+
+/* uint64_t prefixKey(char *str) --
+ * Returns the first 8 bytes of str as a big-endian number, padded with
+ * zeros after the end of the string, so that keys compare like strcmp()
+ * on the strings' first 8 bytes.
+*/
+uint64_t prefixKey(char *str) {
+	uint64_t key = 0;
+	int i;
+	for (i = 0; i < 8 && str[i] != '\0'; i++)
+		key |= (uint64_t) (unsigned char) str[i] << (56 - 8 * i);
+	return key;
+}
+
+/*
+ * void keyMerge(int64_t *inputKeys, int64_t *outputKeys, char **inputArray,
+ *               char **outputArray, long lower, long mid, long upper) --
+ * Precondition: as for merge(), and inputKeys holds the merge key of the
+ * line at the same index of inputArray.
+ *
+ * Merges the two ranges like merge(), but with the vector kernel chosen
+ * by selectMergeKernel(), which moves the pointers to the lines along
+ * with their keys and orders them by key alone. Each run of lines with
+ * the same key is then put in order with fixKeyTies(). Fills outputKeys
+ * for lower to upper in the same way.
+*/
+void keyMerge(int64_t *inputKeys, int64_t *outputKeys, char **inputArray,
+				char **outputArray, long lower, long mid, long upper) {
+	mergeKernel(inputKeys + lower, inputArray + lower, mid - lower,
+				inputKeys + mid, inputArray + mid, upper + 1 - mid,
+				outputKeys + lower, outputArray + lower);
+	fixKeyTies(inputKeys, outputKeys, inputArray, outputArray, lower, mid, upper);
+	if (workerStats != NULL)
+		workerStats->linesDone = upper + 1 - lower;
+}
+
+/*
+ * void fixKeyTies(int64_t *inputKeys, int64_t *outputKeys, char **inputArray,
+ *                 char **outputArray, long lower, long mid, long upper) --
+ * Precondition: outputKeys and outputArray hold the keys and lines of
+ * both ranges of inputKeys and inputArray (as for keyMerge()), in order
+ * of their keys.
+ * Each run of lines in outputArray with the same key comes from a run of
+ * lines with that key in either range of inputArray, which are already
+ * in order. Rewrites each such run with those two runs merged by
+ * comparing the lines.
+*/
+void fixKeyTies(int64_t *inputKeys, int64_t *outputKeys, char **inputArray,
+				char **outputArray, long lower, long mid, long upper) {
+	long i = lower;
+	long j = mid;
+	long k = lower;
+	while (k <= upper) {
+		int64_t key = outputKeys[k];
+		long end = k + 1;
+		while (end <= upper && outputKeys[end] == key)
+			end++;
+
+		// A line with a key of its own is already in place
+		if (end == k + 1) {
+			if (i < mid && inputKeys[i] == key)
+				i++;
+			else
+				j++;
+			k = end;
+			continue;
+		}
+
+		// Find the lines with the key in each range, and merge them
+		long firstI = i;
+		long firstJ = j;
+		while (i < mid && inputKeys[i] == key)
+			i++;
+		while (j <= upper && inputKeys[j] == key)
+			j++;
+		long a = firstI;
+		long b = firstJ;
+		for (; k < end; k++) {
+			if (b >= j || (a < i && strcmp(inputArray[a], inputArray[b]) <= 0)) {
+				outputArray[k] = inputArray[a];
+				a++;
+			}
+			else {
+				outputArray[k] = inputArray[b];
+				b++;
+			}
+		}
+	}
+}
+
+/*
+ * void mergeKeysScalar(int64_t *keysA, char **linesA, long numA,
+ *                      int64_t *keysB, char **linesB, long numB,
+ *                      int64_t *outputKeys, char **outputLines) --
+ * Merges the sorted keys keysA and keysB, and the lines along with them,
+ * into outputKeys and outputLines one key at a time, for CPUs without
+ * vector instructions.
+*/
+void mergeKeysScalar(int64_t *keysA, char **linesA, long numA,
+					int64_t *keysB, char **linesB, long numB,
+					int64_t *outputKeys, char **outputLines) {
+	mergeKeysTail(keysA, linesA, numA, keysB, linesB, numB, NULL, NULL, 0,
+					outputKeys, outputLines);
+}
+
+/*
+ * void mergeKeysTail(int64_t *keysA, char **linesA, long numA,
+ *                    int64_t *keysB, char **linesB, long numB,
+ *                    int64_t *extraKeys, char **extraLines, int numExtra,
+ *                    int64_t *outputKeys, char **outputLines) --
+ * Merges the sorted keys keysA, keysB and extraKeys, and the lines along
+ * with them, into outputKeys and outputLines one key at a time. Used to
+ * finish the vector kernels, once either input has less than a vector of
+ * keys left, with the keys still in registers as extraKeys.
+*/
+void mergeKeysTail(int64_t *keysA, char **linesA, long numA,
+					int64_t *keysB, char **linesB, long numB,
+					int64_t *extraKeys, char **extraLines, int numExtra,
+					int64_t *outputKeys, char **outputLines) {
+	long i = 0;
+	long j = 0;
+	int e = 0;
+	while (i < numA || j < numB || e < numExtra) {
+		// Take the smallest of the next key of each input
+		if (i < numA && (j >= numB || keysA[i] <= keysB[j]) &&
+				(e >= numExtra || keysA[i] <= extraKeys[e])) {
+			*outputKeys = keysA[i];
+			*outputLines = linesA[i];
+			i++;
+		}
+		else if (j < numB && (e >= numExtra || keysB[j] <= extraKeys[e])) {
+			*outputKeys = keysB[j];
+			*outputLines = linesB[j];
+			j++;
+		}
+		else {
+			*outputKeys = extraKeys[e];
+			*outputLines = extraLines[e];
+			e++;
+		}
+		outputKeys++;
+		outputLines++;
+	}
+}
+
+#ifdef __x86_64__
+
+/*
+ * void mergeKeysAvx2(int64_t *keysA, char **linesA, long numA,
+ *                    int64_t *keysB, char **linesB, long numB,
+ *                    int64_t *outputKeys, char **outputLines) --
+ * Merges the sorted keys keysA and keysB, and the lines along with them,
+ * four keys at a time without a branch per key. The four largest keys
+ * merged so far are kept in a register and merged with the next four
+ * keys of the input whose next key is smaller, using bitonicMergeAvx2(),
+ * writing out the four smallest. Needs a CPU with AVX2.
+*/
+__attribute__((target("avx2")))
+void mergeKeysAvx2(int64_t *keysA, char **linesA, long numA,
+					int64_t *keysB, char **linesB, long numB,
+					int64_t *outputKeys, char **outputLines) {
+	if (numA < 4 || numB < 4) {
+		mergeKeysTail(keysA, linesA, numA, keysB, linesB, numB, NULL, NULL, 0,
+						outputKeys, outputLines);
+		return;
+	}
+
+	__m256i lowKeys = _mm256_loadu_si256((__m256i*) keysA);
+	__m256i lowLines = _mm256_loadu_si256((__m256i*) linesA);
+	__m256i highKeys = _mm256_loadu_si256((__m256i*) keysB);
+	__m256i highLines = _mm256_loadu_si256((__m256i*) linesB);
+	long i = 4;
+	long j = 4;
+	long k = 0;
+	while (1) {
+		bitonicMergeAvx2(&lowKeys, &highKeys, &lowLines, &highLines);
+		_mm256_storeu_si256((__m256i*) (outputKeys + k), lowKeys);
+		_mm256_storeu_si256((__m256i*) (outputLines + k), lowLines);
+		k += 4;
+
+		// Load the next four keys of the input whose next key is smaller
+		if (i + 4 > numA || j + 4 > numB)
+			break;
+		if (keysA[i] <= keysB[j]) {
+			lowKeys = _mm256_loadu_si256((__m256i*) (keysA + i));
+			lowLines = _mm256_loadu_si256((__m256i*) (linesA + i));
+			i += 4;
+		}
+		else {
+			lowKeys = _mm256_loadu_si256((__m256i*) (keysB + j));
+			lowLines = _mm256_loadu_si256((__m256i*) (linesB + j));
+			j += 4;
+		}
+	}
+
+	// Finish with the keys left in the register and the inputs
+	int64_t extraKeys[4];
+	char *extraLines[4];
+	_mm256_storeu_si256((__m256i*) extraKeys, highKeys);
+	_mm256_storeu_si256((__m256i*) extraLines, highLines);
+	mergeKeysTail(keysA + i, linesA + i, numA - i, keysB + j, linesB + j, numB - j,
+					extraKeys, extraLines, 4, outputKeys + k, outputLines + k);
+}
+
+/*
+ * void bitonicMergeAvx2(__m256i *lowKeys, __m256i *highKeys,
+ *                       __m256i *lowLines, __m256i *highLines) --
+ * Precondition: lowKeys and highKeys each hold four sorted keys, and
+ * lowLines and highLines the pointers to their lines.
+ * Merges them with a bitonic merge network: highKeys is reversed so the
+ * eight keys form a bitonic sequence, and the elementwise minimum and
+ * maximum split it into the four smallest and the four largest keys,
+ * which bitonicSortAvx2() puts in order in lowKeys and highKeys.
+ * The lines are moved with the same masks as their keys.
+*/
+__attribute__((target("avx2")))
+void bitonicMergeAvx2(__m256i *lowKeys, __m256i *highKeys,
+						__m256i *lowLines, __m256i *highLines) {
+	__m256i reversedKeys = _mm256_permute4x64_epi64(*highKeys, 0x1B);
+	__m256i reversedLines = _mm256_permute4x64_epi64(*highLines, 0x1B);
+	__m256i greater = _mm256_cmpgt_epi64(*lowKeys, reversedKeys);
+	__m256i minKeys = _mm256_blendv_epi8(*lowKeys, reversedKeys, greater);
+	__m256i maxKeys = _mm256_blendv_epi8(reversedKeys, *lowKeys, greater);
+	__m256i minLines = _mm256_blendv_epi8(*lowLines, reversedLines, greater);
+	__m256i maxLines = _mm256_blendv_epi8(reversedLines, *lowLines, greater);
+	bitonicSortAvx2(&minKeys, &minLines);
+	bitonicSortAvx2(&maxKeys, &maxLines);
+	*lowKeys = minKeys;
+	*highKeys = maxKeys;
+	*lowLines = minLines;
+	*highLines = maxLines;
+}
+
+/*
+ * void bitonicSortAvx2(__m256i *keys, __m256i *lines) --
+ * Sorts four keys forming a bitonic sequence, and the pointers to their
+ * lines along with them, comparing the keys two apart and then the
+ * neighbouring keys. Each lane takes the key it is compared with if
+ * that key belongs on its side, so equal keys are never duplicated.
+*/
+__attribute__((target("avx2")))
+void bitonicSortAvx2(__m256i *keys, __m256i *lines) {
+	// Compare the keys two apart, keeping the smaller in the lower half
+	__m256i swappedKeys = _mm256_permute4x64_epi64(*keys, 0x4E);
+	__m256i swappedLines = _mm256_permute4x64_epi64(*lines, 0x4E);
+	__m256i takeSwapped = _mm256_blend_epi32(_mm256_cmpgt_epi64(*keys, swappedKeys),
+											_mm256_cmpgt_epi64(swappedKeys, *keys), 0xF0);
+	__m256i sortedKeys = _mm256_blendv_epi8(*keys, swappedKeys, takeSwapped);
+	__m256i sortedLines = _mm256_blendv_epi8(*lines, swappedLines, takeSwapped);
+
+	// Compare the neighbouring keys, keeping the smaller in the even lanes
+	swappedKeys = _mm256_permute4x64_epi64(sortedKeys, 0xB1);
+	swappedLines = _mm256_permute4x64_epi64(sortedLines, 0xB1);
+	takeSwapped = _mm256_blend_epi32(_mm256_cmpgt_epi64(sortedKeys, swappedKeys),
+									_mm256_cmpgt_epi64(swappedKeys, sortedKeys), 0xCC);
+	*keys = _mm256_blendv_epi8(sortedKeys, swappedKeys, takeSwapped);
+	*lines = _mm256_blendv_epi8(sortedLines, swappedLines, takeSwapped);
+}
+
+/*
+ * void mergeKeysSse(int64_t *keysA, char **linesA, long numA,
+ *                   int64_t *keysB, char **linesB, long numB,
+ *                   int64_t *outputKeys, char **outputLines) --
+ * Like mergeKeysAvx2(), merges the sorted keys keysA and keysB and the
+ * lines along with them, but two keys at a time, for CPUs with SSE4.2
+ * but no AVX2.
+*/
+__attribute__((target("sse4.2")))
+void mergeKeysSse(int64_t *keysA, char **linesA, long numA,
+					int64_t *keysB, char **linesB, long numB,
+					int64_t *outputKeys, char **outputLines) {
+	if (numA < 2 || numB < 2) {
+		mergeKeysTail(keysA, linesA, numA, keysB, linesB, numB, NULL, NULL, 0,
+						outputKeys, outputLines);
+		return;
+	}
+
+	__m128i lowKeys = _mm_loadu_si128((__m128i*) keysA);
+	__m128i lowLines = _mm_loadu_si128((__m128i*) linesA);
+	__m128i highKeys = _mm_loadu_si128((__m128i*) keysB);
+	__m128i highLines = _mm_loadu_si128((__m128i*) linesB);
+	long i = 2;
+	long j = 2;
+	long k = 0;
+	while (1) {
+		bitonicMergeSse(&lowKeys, &highKeys, &lowLines, &highLines);
+		_mm_storeu_si128((__m128i*) (outputKeys + k), lowKeys);
+		_mm_storeu_si128((__m128i*) (outputLines + k), lowLines);
+		k += 2;
+
+		// Load the next two keys of the input whose next key is smaller
+		if (i + 2 > numA || j + 2 > numB)
+			break;
+		if (keysA[i] <= keysB[j]) {
+			lowKeys = _mm_loadu_si128((__m128i*) (keysA + i));
+			lowLines = _mm_loadu_si128((__m128i*) (linesA + i));
+			i += 2;
+		}
+		else {
+			lowKeys = _mm_loadu_si128((__m128i*) (keysB + j));
+			lowLines = _mm_loadu_si128((__m128i*) (linesB + j));
+			j += 2;
+		}
+	}
+
+	// Finish with the keys left in the register and the inputs
+	int64_t extraKeys[2];
+	char *extraLines[2];
+	_mm_storeu_si128((__m128i*) extraKeys, highKeys);
+	_mm_storeu_si128((__m128i*) extraLines, highLines);
+	mergeKeysTail(keysA + i, linesA + i, numA - i, keysB + j, linesB + j, numB - j,
+					extraKeys, extraLines, 2, outputKeys + k, outputLines + k);
+}
+
+/*
+ * void bitonicMergeSse(__m128i *lowKeys, __m128i *highKeys,
+ *                      __m128i *lowLines, __m128i *highLines) --
+ * Precondition: lowKeys and highKeys each hold two sorted keys, and
+ * lowLines and highLines the pointers to their lines.
+ * Like bitonicMergeAvx2(), merges them into the two smallest keys in
+ * lowKeys and the two largest in highKeys, each pair then put in order.
+*/
+__attribute__((target("sse4.2")))
+void bitonicMergeSse(__m128i *lowKeys, __m128i *highKeys,
+						__m128i *lowLines, __m128i *highLines) {
+	__m128i reversedKeys = _mm_shuffle_epi32(*highKeys, 0x4E);
+	__m128i reversedLines = _mm_shuffle_epi32(*highLines, 0x4E);
+	__m128i greater = _mm_cmpgt_epi64(*lowKeys, reversedKeys);
+	__m128i keys[2], lines[2];
+	keys[0] = _mm_blendv_epi8(*lowKeys, reversedKeys, greater);
+	keys[1] = _mm_blendv_epi8(reversedKeys, *lowKeys, greater);
+	lines[0] = _mm_blendv_epi8(*lowLines, reversedLines, greater);
+	lines[1] = _mm_blendv_epi8(reversedLines, *lowLines, greater);
+
+	// Put each pair in order, keeping the smaller key in the lower lane
+	int h;
+	for (h = 0; h < 2; h++) {
+		__m128i swappedKeys = _mm_shuffle_epi32(keys[h], 0x4E);
+		__m128i swappedLines = _mm_shuffle_epi32(lines[h], 0x4E);
+		__m128i takeSwapped = _mm_blend_epi16(_mm_cmpgt_epi64(keys[h], swappedKeys),
+											_mm_cmpgt_epi64(swappedKeys, keys[h]), 0xF0);
+		keys[h] = _mm_blendv_epi8(keys[h], swappedKeys, takeSwapped);
+		lines[h] = _mm_blendv_epi8(lines[h], swappedLines, takeSwapped);
+	}
+	*lowKeys = keys[0];
+	*highKeys = keys[1];
+	*lowLines = lines[0];
+	*highLines = lines[1];
+}
+
+#endif
+
+/*
+ * void statsOpen(int numWorkers) --
+ * Creates the telemetry segment /sortstat.<pid> in shared memory for
+ * numWorkers workers, for sortStat to read while the sort runs, and
+ * arranges for statsClose() to be called at exit. The segment is
+ * shared with the sort and merge processes forked afterwards.
+*/
+void statsOpen(int numWorkers) {
+
+	// Create the segment, named after this process
+	char name[64];
+	sprintf(name, "/sortstat.%ld", (long) getpid());
+	int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+	if (fd < 0) {
+		fprintf(stderr, "The telemetry segment \'%s\' could not be created.\n", name);
+		exit(1);
+	}
+	if (ftruncate(fd, sizeof(struct statsSegment)) < 0) {
+		perror("ftruncate");
+		exit(1);
+	}
+
+	stats = mmap(NULL, sizeof(struct statsSegment), PROT_READ | PROT_WRITE,
+					MAP_SHARED, fd, 0);
+	if ( stats == MAP_FAILED ) {
+  		fprintf(stderr, "errno is %d\n", errno);
+  		perror("stats is MAP_FAILED ");
+  		exit(1);
+	}
+	close(fd);
+
+	// The new segment is zeroed, so only the header needs to be filled in
+	memcpy(stats->magic, STATS_MAGIC, sizeof(stats->magic));
+	stats->pid = getpid();
+	stats->numWorkers = numWorkers;
+	atexit(statsClose);
+}
+
+/*
+ * void statsClose() --
+ * Marks the sort as done in the telemetry segment and removes its name,
+ * so it is freed once sortStat stops reading it. Does nothing in the
+ * sort and merge processes, which exit before the sort is done.
+*/
+void statsClose() {
+	if (stats == NULL || stats->pid != getpid())
+		return;
+
+	char name[64];
+	sprintf(name, "/sortstat.%ld", (long) getpid());
+	stats->phase = STATS_PHASE_DONE;
+	shm_unlink(name);
+}
+
+/*
+ * void statsPhase(int phase, int mergeLevel) --
+ * Publishes the start of phase (a STATS_PHASE) at merge level mergeLevel
+ * in the telemetry segment, and clears the counters of every worker.
+ * Does nothing if there is no telemetry segment.
+*/
+void statsPhase(int phase, int mergeLevel) {
+	if (stats == NULL)
+		return;
+
+	struct timeval now;
+	gettimeofday(&now, NULL);
+
+	int i;
+	for (i = 0; i < STATS_MAX_WORKERS; i++) {
+		stats->workers[i].linesDone = 0;
+		stats->workers[i].linesTotal = 0;
+		stats->workers[i].bytesWritten = 0;
+		stats->workers[i].phase = 0;
+	}
+	stats->phaseStart = now.tv_sec * 1000000ULL + now.tv_usec;
+	stats->mergeLevel = mergeLevel;
+	stats->phase = phase;
+}
+
+/*
+ * void statsAttach(int worker, long linesTotal) --
+ * Makes slot worker of the telemetry segment the one the calling process
+ * updates, for linesTotal lines of the current phase.
+ * Does nothing if there is no telemetry segment.
+*/
+void statsAttach(int worker, long linesTotal) {
+	if (stats == NULL || worker >= STATS_MAX_WORKERS)
+		return;
+
+	workerStats = &stats->workers[worker];
+	workerStats->linesDone = 0;
+	workerStats->linesTotal = linesTotal;
+	workerStats->bytesWritten = 0;
+	workerStats->mergeLevel = stats->mergeLevel;
+	workerStats->phase = stats->phase;
+}
+
+/* void quicksort(char **strArray, long lower, long upper) -- Using the
  * quicksort algorithm from CLRS, recursively sorts all elements
  * between and including indexes upper and lower in strArray.
 */
-void quicksort(char **strArray, int lower, int upper) {
+void quicksort(char **strArray, long lower, long upper) {
 	if (lower < upper) {
 		// Partition range
-		int pivot = partition(strArray, lower, upper);
+		long pivot = partition(strArray, lower, upper);
+		if (workerStats != NULL)
+			workerStats->linesDone++;
 		// Call quickosrt again on each range around pivot
   		quicksort(strArray, lower, pivot - 1);
 		quicksort(strArray, pivot + 1, upper);
 	}
+	else if (lower == upper && workerStats != NULL) {
+		// A single line is already in its final place
+		workerStats->linesDone++;
+	}
 }
 
-/* void partition(char **strArray, int lower, int upper) --
+/* void partition(char **strArray, long lower, long upper) --
  * Using the partition algorithm from CLRS, partitions all
  * elements between and including indexes lower and upper
  * in strArray around a pivot chosen by the 'median of 3'
  * method (implemented in selectPivot()).
  * Returns pivot index
 */
-int partition(char **strArray, int lower, int upper) {
+long partition(char **strArray, long lower, long upper) {
 
 	//Select the optimal pivot index
-  	int pivot = selectPivot(strArray, lower, upper);
+  	long pivot = selectPivot(strArray, lower, upper);
 
 	// Move pivot to the end
   	swapStr(strArray, pivot, upper);
@@ -324,11 +1193,11 @@ int partition(char **strArray, int lower, int upper) {
 
 	// Variable to keep track of how many strings equivalent
 	// to the pivot we encounter
-	int eqLines = 0;
+	long eqLines = 0;
 
-  	int j;
+  	long j;
   	int strcmpRetVal;
-  	int currIndex = lower - 1;
+  	long currIndex = lower - 1;
 
 	// Move the values relative to the pivot
   	for (j = lower; j <= upper - 1; j++) {
@@ -354,7 +1223,7 @@ int partition(char **strArray, int lower, int upper) {
   	return currIndex + 1;
 }
 
-/* selectPivot(char **strArray, int lower, int upper) --
+/* selectPivot(char **strArray, long lower, long upper) --
  * Uses the 'median of 3' approach to select
  * (and return the index of) an optimal pivot between
  * and including lower and upperin strArray for partitioning.
@@ -362,14 +1231,14 @@ int partition(char **strArray, int lower, int upper) {
  * each other within the array, which will aid future sorting.
  * If the range is 10 or smaller, simply returns upper index.
 */
-int selectPivot(char **strArray, int lower, int upper) {
+long selectPivot(char **strArray, long lower, long upper) {
 
 	// Abort if range is too small
 	if (upper - lower <= 10)
   		return upper;
 
 	// Set midpoint
-  	int mid = (upper + lower) / 2;
+  	long mid = (upper + lower) / 2;
 
 	// Sort the three values
   	if (strcmp(strArray[mid], strArray[lower]) < 0)
@@ -383,49 +1252,311 @@ int selectPivot(char **strArray, int lower, int upper) {
   	return mid; // index of median value
 }
 
-/* swapStr(char **strArray, int indexA, int indexB) --
+/* swapStr(char **strArray, long indexA, long indexB) --
  * Swaps the string pointers at indexA and indexB in
  * strArray with one another.
 */
-void swapStr(char **strArray, int indexA, int indexB) {
+void swapStr(char **strArray, long indexA, long indexB) {
 	char* temp = strArray[indexA];
   	strArray[indexA] = strArray[indexB];
   	strArray[indexB] = temp;
 }
 
 /*
- * extendArray(char **oldArray, int oldLen, int newLen) --
- * Accepts a character pointer array (oldArray) of length oldLen,
- * creates a new, bigger array with the size newLen, and
- * copies all elements from oldArray to the new array.
- * Returns a pointer to the new array.
- * Returns NULL if memory allocation fails for the new array.
+ * char **readLines(char *fileName, int numProcesses, char **fileBuffer,
+ *                  long *fileSize, long *totalLines) --
+ * Reads the whole file fileName into a single buffer in shared memory,
+ * breaks the buffer into numProcesses byte ranges that start and end on
+ * line boundaries, and indexes the lines of each range in a separate process.
+ * The processes first count the lines in their range; a prefix sum over the
+ * counts gives each process the index of its first line, so the shared array
+ * of line pointers is mapped once at its final size and filled in a second
+ * pass without any resizing. Newlines are replaced with '\0' in place.
+ * Sets fileBuffer to the buffer holding the lines, fileSize to its length,
+ * and totalLines to the number of lines read.
+ * Returns a pointer to the array of lines.
 */
-char **extendArray(char **oldArray, int oldLen, int newLen) {
+char **readLines(char *fileName, int numProcesses, char **fileBuffer,
+					long *fileSize, long *totalLines) {
 
-	// Create new bigger array in shared memory
-	void *memoryBuffer = mmap(	NULL, (newLen * sizeof(char*)), PROT_READ | PROT_WRITE,
-  								MAP_ANONYMOUS | MAP_SHARED, -1, 0);
-	// Return NULL if mmap fails
-  	if (memoryBuffer == MAP_FAILED ) {
-    		fprintf(stderr, "errno is %d\n", errno);
-    		perror("memoryBuffer is MAP_FAILED ");
-    		exit(1);
-  	}
+	// Open file for reading
+	int fd = open(fileName, O_RDONLY);
 
-	// Cast void pointer to char**
-  	char **newArray = (char**) memoryBuffer;
+	// Exit if file does not open
+	if (fd < 0) {
+		fprintf(stderr, "The file \'%s\' does not exist.\n", fileName);
+		exit(1);
+	}
 
-	//Copy all values over
-  	int i;
-  	for (i = 0; i < oldLen; i++)
-  	{
-  		newArray[i] = oldArray[i];
-  	}
+	// Find the size of the file
+	struct stat fileStat;
+	if (fstat(fd, &fileStat) < 0) {
+		perror("fstat");
+		exit(1);
+	}
+	long bufferLen = fileStat.st_size;
+
+	// Create a buffer in shared memory to hold the file and a final '\0'
+	void *memoryBuffer = mmap(	NULL, bufferLen + 1, PROT_READ | PROT_WRITE,
+								MAP_ANONYMOUS | MAP_SHARED, -1, 0);
+	if ( memoryBuffer == MAP_FAILED ) {
+  		fprintf(stderr, "errno is %d\n", errno);
+  		perror("memoryBuffer is MAP_FAILED ");
+  		exit(1);
+	}
+
+	// The sort reads lines from all over the buffer, so ask for huge pages
+	madvise(memoryBuffer, bufferLen + 1, MADV_HUGEPAGE);
+	char *buffer = (char*) memoryBuffer;
+
+	// Read the whole file into the buffer
+	long bytesRead = 0;
+	while (bytesRead < bufferLen) {
+		ssize_t result = read(fd, buffer + bytesRead, bufferLen - bytesRead);
+		if (result < 0 && errno == EINTR)
+			continue;
+		if (result < 0) {
+			perror("read");
+			exit(1);
+		}
+		if (result == 0)
+			break;
+		bytesRead += result;
+	}
+	close(fd);
+	buffer[bytesRead] = '\0';
+
+	// Set up the byte range of each process, and an array
+	// in shared memory for the processes to return their line counts
+	long lower[numProcesses];
+	long upper[numProcesses];
+	long firstLine[numProcesses];
+	long *lineCounts = mmap(	NULL, numProcesses * sizeof(long), PROT_READ | PROT_WRITE,
+							MAP_ANONYMOUS | MAP_SHARED, -1, 0);
+	if ( lineCounts == MAP_FAILED ) {
+  		fprintf(stderr, "errno is %d\n", errno);
+  		perror("lineCounts is MAP_FAILED ");
+  		exit(1);
+	}
 
-	// unmap old array
-	munmap(oldArray, oldLen * sizeof(char*));
+	// Break up the buffer and count the lines in each part
+	pid_t kidpid[numProcesses];
+	int i, kid_status;
+	for (i = 0; i < numProcesses; i++) {
+		lower[i] = lineBoundary(buffer, bytesRead, i * bytesRead / numProcesses);
+		upper[i] = lineBoundary(buffer, bytesRead, (i + 1) * bytesRead / numProcesses);
+
+		kidpid[i] = fork();
+		if (kidpid[i] < 0) {
+			fprintf(stderr, "Fork failed!\n");
+			exit(1);
+		}
+
+		if (kidpid[i] == 0) {
+			lineCounts[i] = countLines(buffer, lower[i], upper[i]);
+			exit(0);
+		}
+	}
+
+	// Wait for all processes to exit
+	for (i = 0; i < numProcesses; i++) {
+		waitpid(-1, &kid_status, 0);
+	}
+
+	// Prefix sum of the line counts gives the first line of each part
+	long lineCount = 0;
+	for (i = 0; i < numProcesses; i++) {
+		firstLine[i] = lineCount;
+		lineCount += lineCounts[i];
+	}
+	munmap(lineCounts, numProcesses * sizeof(long));
 
-	// Return new array
-  	return newArray;
+	// Create an array in shared memory of exactly the right size to hold the lines
+	memoryBuffer = mmap(	NULL, (lineCount + 1) * sizeof(char*), PROT_READ | PROT_WRITE,
+							MAP_ANONYMOUS | MAP_SHARED, -1, 0);
+	if ( memoryBuffer == MAP_FAILED ) {
+  		fprintf(stderr, "errno is %d\n", errno);
+  		perror("memoryBuffer is MAP_FAILED ");
+  		exit(1);
+	}
+
+	// Huge pages are only a hint, so ignore failure
+	madvise(memoryBuffer, (lineCount + 1) * sizeof(char*), MADV_HUGEPAGE);
+	char **linesArray = (char**) memoryBuffer;
+
+	// Index the lines in each part of the buffer
+	for (i = 0; i < numProcesses; i++) {
+		kidpid[i] = fork();
+		if (kidpid[i] < 0) {
+			fprintf(stderr, "Fork failed!\n");
+			exit(1);
+		}
+
+		if (kidpid[i] == 0) {
+			indexLines(buffer, lower[i], upper[i], linesArray, firstLine[i]);
+			exit(0);
+		}
+	}
+
+	// Wait for all processes to exit
+	for (i = 0; i < numProcesses; i++) {
+		waitpid(-1, &kid_status, 0);
+	}
+
+	// Return the buffer, its length, the line count and array of lines
+	*fileBuffer = buffer;
+	*fileSize = bytesRead;
+	*totalLines = lineCount;
+	return linesArray;
+}
+
+/*
+ * long lineBoundary(char *buffer, long bufferLen, long pos) --
+ * Returns the index of the first line that starts at or after
+ * index pos in buffer, or bufferLen if there is no such line.
+*/
+long lineBoundary(char *buffer, long bufferLen, long pos) {
+
+	// The ends of the buffer are always boundaries
+	if (pos <= 0)
+		return 0;
+	if (pos >= bufferLen)
+		return bufferLen;
+
+	// pos already starts a line
+	if (buffer[pos - 1] == '\n')
+		return pos;
+
+	// Otherwise skip to the start of the next line
+	char *newline = memchr(buffer + pos, '\n', bufferLen - pos);
+	if (newline == NULL)
+		return bufferLen;
+	return newline - buffer + 1;
+}
+
+/*
+ * long countLines(char *buffer, long lower, long upper) --
+ * Precondition: lower is the start of a line in buffer.
+ * Returns the number of lines that start between index lower
+ * and upper-1 (inclusive) in buffer. Newlines are found with
+ * memchr(), which scans many bytes at a time.
+*/
+long countLines(char *buffer, long lower, long upper) {
+	char *curr = buffer + lower;
+	char *end = buffer + upper;
+	char *newline;
+	long numLines = 0;
+
+	// Count one line per newline, plus a final unterminated line
+	while (curr < end) {
+		numLines++;
+		newline = memchr(curr, '\n', end - curr);
+		if (newline == NULL)
+			break;
+		curr = newline + 1;
+	}
+
+	return numLines;
+}
+
+/*
+ * void indexLines(char *buffer, long lower, long upper, char **linesArray, long firstLine) --
+ * Precondition: lower is the start of a line in buffer.
+ * Replaces each newline between index lower and upper-1 (inclusive) in buffer
+ * with '\0', and stores a pointer to each line that starts in that range in
+ * linesArray, beginning at index firstLine.
+*/
+void indexLines(char *buffer, long lower, long upper, char **linesArray, long firstLine) {
+	char *curr = buffer + lower;
+	char *end = buffer + upper;
+	char *newline;
+	long lineIndex = firstLine;
+
+	// Terminate each line and add its pointer to the array
+	while (curr < end) {
+		linesArray[lineIndex] = curr;
+		lineIndex++;
+		newline = memchr(curr, '\n', end - curr);
+		if (newline == NULL)
+			break;
+		*newline = '\0';
+		curr = newline + 1;
+	}
+}
+
+/*
+ * long uniqueLines(char **linesArray, long totalLines, struct lineTable *table) --
+ * Counts how many times each distinct line occurs in linesArray using
+ * a hash table, and moves the first occurrence of each distinct line
+ * to the front of linesArray, so that only distinct lines are sorted.
+ * Sets up table so the counts can be found afterwards with lineCount().
+ * Returns the number of distinct lines.
+*/
+long uniqueLines(char **linesArray, long totalLines, struct lineTable *table) {
+
+	// Size the table to a power of 2 at least twice the number of lines
+	unsigned long tableLen = 2;
+	while (tableLen < 2 * (unsigned long) totalLines)
+		tableLen *= 2;
+	table->lines = calloc(tableLen, sizeof(char*));
+	table->counts = calloc(tableLen, sizeof(long));
+	table->mask = tableLen - 1;
+
+	// Check for unsuccessful calloc
+	if (table->lines == NULL || table->counts == NULL) {
+		fprintf(stderr, "ERROR: Out of memory!\n");
+		exit(1);
+	}
+
+	// Count each line, keeping the first occurrence of each one
+	long i;
+	long numDistinct = 0;
+	unsigned long slot;
+	for (i = 0; i < totalLines; i++) {
+		slot = findLine(table, linesArray[i]);
+		if (table->lines[slot] == NULL) {
+			table->lines[slot] = linesArray[i];
+			linesArray[numDistinct] = linesArray[i];
+			numDistinct++;
+		}
+		table->counts[slot]++;
+	}
+
+	return numDistinct;
+}
+
+/*
+ * long lineCount(struct lineTable *table, char *line) --
+ * Returns the number of times line occurred in the lines
+ * given to uniqueLines() when table was set up.
+*/
+long lineCount(struct lineTable *table, char *line) {
+	return table->counts[findLine(table, line)];
+}
+
+/*
+ * unsigned long findLine(struct lineTable *table, char *line) --
+ * Returns the slot of table that holds line, or the empty
+ * slot where line belongs if it is not in the table yet.
+ * Collisions are resolved by linear probing.
+*/
+unsigned long findLine(struct lineTable *table, char *line) {
+	unsigned long slot = hashStr(line) & table->mask;
+	while (table->lines[slot] != NULL && strcmp(table->lines[slot], line) != 0)
+		slot = (slot + 1) & table->mask;
+	return slot;
+}
+
+/*
+ * unsigned long hashStr(char *str) --
+ * Returns the 64-bit FNV-1a hash of str.
+*/
+unsigned long hashStr(char *str) {
+	unsigned long hash = 14695981039346656037UL;
+	while (*str != '\0') {
+		hash ^= (unsigned char) *str;
+		hash *= 1099511628211UL;
+		str++;
+	}
+	return hash;
 }
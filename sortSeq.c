@@ -11,55 +11,211 @@
  * CLRS quicksort algorithm.
  * The path of the file to be sorted is provided as the first
  * command-line argument.
+ * Options may be given before the arguments:
+ *   -u  prints each distinct line once (like sort -u)
+ *   -c  prints each distinct line once with its count (like sort | uniq -c)
+ *   -k <numLines>  prints only the first numLines lines of sorted order,
+ *       found with quickselect so only those lines are fully sorted
+ *   -q <queries>  prints only the lines at the given comma-separated
+ *       ranks (1 is the first line) and percentiles (p50, p99, p99.9),
+ *       found with a multi-target quickselect instead of a full sort;
+ *       exits with status 1 if any query is not valid
+ *   -i <sortedFile>  prints the lines merged into the already-sorted
+ *       sortedFile, which is streamed instead of being sorted again
+ *   -x <indexFile>  also writes a binary index of the line offsets and
+ *       key prefixes of the sorted output, for lookups with sortLookup
 */
 
+#define _GNU_SOURCE
 #include <unistd.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
 #include <sys/time.h>
 
 // Macro to define initial size of the array
 #define INIT_ARRAY_SZ 128
 
+// Macro to define the average line length assumed
+// when presizing the array from the file size
+#define EST_LINE_BYTES 16
+
+// Macros to define the format of the index written with -x
+#define INDEX_MAGIC "QSIDX01"
+#define INDEX_PREFIX_LEN 8
+
+/*
+ * indexHeader -- the start of an index file written with -x.
+ * magic holds INDEX_MAGIC, numLines is the number of lines
+ * in the sorted output, and dataSize is its size in bytes.
+*/
+struct indexHeader {
+	char magic[8];
+	uint64_t numLines;
+	uint64_t dataSize;
+};
+
+/*
+ * indexEntry -- one line of the sorted output in an index file:
+ * the byte offset where the line starts, and the first
+ * INDEX_PREFIX_LEN bytes of the line, padded with '\0'.
+*/
+struct indexEntry {
+	uint64_t offset;
+	char prefix[INDEX_PREFIX_LEN];
+};
+
+/*
+ * lineTable -- an open-addressing hash table holding each
+ * distinct line and the number of times it occurs, used by
+ * the -u and -c modes to collapse duplicate lines before sorting.
+*/
+struct lineTable {
+	char **lines;
+	long *counts;
+	unsigned long mask;
+};
+
 // Prototype declaration for main program functions
-void quicksort(char**, int, int);
-int partition(char**, int, int);
-int selectPivot(char**, int, int);
-void swapStr(char**, int, int);
-char **extendArray(char**, int, int);
+void usage(char*);
+void quicksort(char**, long, long);
+long partition(char**, long, long);
+long selectPivot(char**, long, long);
+void swapStr(char**, long, long);
+void quickselect(char**, long, long, long);
+void partialSort(char**, long, long, long);
+void multiSelect(char**, long, long, long*, long);
+int parseQueries(char*, char***);
+long queryIndex(char*, long);
+int compareLongs(const void*, const void*);
+void mergeWithFile(char**, long, char*);
+void writeIndex(char**, long, char*);
+long uniqueLines(char**, long, struct lineTable*);
+long lineCount(struct lineTable*, char*);
+unsigned long findLine(struct lineTable*, char*);
+unsigned long hashStr(char*);
+char **allocArray(long);
+char **extendArray(char**, long, long);
 
 
+/*
+ * void usage(char *progName) --
+ * Prints the command-line usage of the program to stderr and exits.
+*/
+void usage(char *progName) {
+	fprintf(stderr, "%s [-u | -c] [-k <numLines> | -q <queries>] [-i <sortedFile>]\n"
+			"    [-x <indexFile>] <fileName>\n"
+			"  -u  print each distinct line once\n"
+			"  -c  print each distinct line once, prefixed by its count\n"
+			"  -k  print only the first numLines lines of sorted order\n"
+			"  -q  print only the lines at the given comma-separated\n"
+			"      ranks and percentiles, e.g. 1,100,p50,p99,p999\n"
+			"  -i  merge the sorted lines into the already-sorted sortedFile\n"
+			"  -x  write a binary index of the sorted output to indexFile\n"
+			"      for fast lookups with sortLookup\n",
+			progName);
+	exit(1);
+}
+
 int main (int argc, char *argv[]) {
 
-	// Exit if file does not open
-	if (argc != 2) {
-		fprintf(stderr, "Error: Exactly 1 argument required:\n%s [filename]\n",
-				argv[0]);
+	// Parse command-line options
+	int uniqueMode = 0;
+	int countMode = 0;
+	long topK = 0;
+	char **queries = NULL;
+	int numQueries = 0;
+	char *baseFileName = NULL;
+	char *indexFileName = NULL;
+	int opt;
+	while ((opt = getopt(argc, argv, "uck:q:i:x:")) != -1) {
+		switch (opt) {
+		case 'u':
+			// Print each distinct line once
+			uniqueMode = 1;
+			break;
+		case 'c':
+			// Print each distinct line once, prefixed by its count
+			uniqueMode = 1;
+			countMode = 1;
+			break;
+		case 'k':
+			// Print only the first topK lines of sorted order
+			topK = atol(optarg);
+			if (topK <= 0) {
+				fprintf(stderr, "Error: -k requires a positive number of lines\n");
+				exit(1);
+			}
+			break;
+		case 'q':
+			// Print only the lines at the given ranks and percentiles
+			numQueries = parseQueries(optarg, &queries);
+			break;
+		case 'i':
+			// Merge the sorted lines into an already-sorted file
+			baseFileName = optarg;
+			break;
+		case 'x':
+			// Write an index of the sorted output for sortLookup
+			indexFileName = optarg;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	// Exit if -i is combined with an option that changes the output
+	if (baseFileName != NULL && (uniqueMode || topK > 0 || numQueries > 0)) {
+		fprintf(stderr, "Error: -i cannot be combined with -u, -c, -k or -q\n");
 		exit(1);
 	}
 
+	// Exit if -x is combined with an option that changes the output format
+	if (indexFileName != NULL && (countMode || numQueries > 0 || baseFileName != NULL)) {
+		fprintf(stderr, "Error: -x cannot be combined with -c, -q or -i\n");
+		exit(1);
+	}
+
+	// Exit if the wrong number of arguments is given
+	if (argc - optind != 1) {
+		fprintf(stderr, "Error: Exactly 1 argument required:\n");
+		usage(argv[0]);
+	}
+
 	// Open file for reading
-	FILE *inputFile = fopen(argv[1], "r");
+	FILE *inputFile = fopen(argv[optind], "r");
 
 	// Exit if file does not open
 	if (inputFile == NULL) {
-		fprintf(stderr, "The file \'%s\' does not exist.\n", argv[1]);
+		fprintf(stderr, "The file \'%s\' does not exist.\n", argv[optind]);
 		exit(1);
 	}
 
+	// Presize the array from the file size, so it rarely needs to grow
+	long arrayLen = INIT_ARRAY_SZ;
+	struct stat fileStat;
+	if (fstat(fileno(inputFile), &fileStat) == 0 &&
+			fileStat.st_size / EST_LINE_BYTES > arrayLen) {
+		arrayLen = fileStat.st_size / EST_LINE_BYTES;
+	}
+
 	// Create an array to hold lines from the file
-	char **linesArray = malloc(INIT_ARRAY_SZ * sizeof(char*));
+	char **linesArray = allocArray(arrayLen);
 	if (linesArray == NULL) {
 		fprintf(stderr, "ERROR: Out of memory!\n");
 		exit(1);
 	}
 
 	// Declare variables for our file-reading loop
-	int arrayLen = INIT_ARRAY_SZ;
 	char *buf = NULL;
 	size_t bufLen = 0;
-	int lineIndex = 0;
+	long lineIndex = 0;
 
 	/* Read all lines from the file into an
 	 * array of strings, extending the array as needed*/
@@ -67,10 +223,10 @@ int main (int argc, char *argv[]) {
 
 		// If the array is full, resize it
 		if (lineIndex >= arrayLen) {
-			int newArrayLen = arrayLen * 2;
+			long newArrayLen = arrayLen * 2;
 			linesArray = extendArray(linesArray, arrayLen, newArrayLen);
 
-			// Check for unsuccessful malloc
+			// Check for unsuccessful mremap
 			if (linesArray == NULL) {
 				fprintf(stderr, "ERROR: Out of memory!\n");
 				exit(1);
@@ -97,15 +253,50 @@ int main (int argc, char *argv[]) {
 	fclose(inputFile);
 
 	// New variale for total lines in array for code clarity
-	int totalLines = lineIndex;
+	long totalLines = lineIndex;
 
 	// Keep track of start time for sort runtime calculation
 	struct timeval startTime, endTime;
 	int seconds, micros;
 	gettimeofday(&startTime, NULL);
 
-	// Sort the array using quicksort
-	quicksort(linesArray, 0, totalLines - 1);
+	// Collapse duplicate lines so only distinct lines are sorted
+	struct lineTable table;
+	if (uniqueMode) {
+		totalLines = uniqueLines(linesArray, totalLines, &table);
+	}
+
+	// Sort the array using quicksort, or only the
+	// first topK lines if fewer lines were asked for
+	long numOutput = totalLines;
+	if (numQueries > 0) {
+		// Only select the lines at the queried indexes
+		long *targets = malloc(numQueries * sizeof(long));
+		if (targets == NULL) {
+			fprintf(stderr, "ERROR: Out of memory!\n");
+			exit(1);
+		}
+		long numTargets = 0;
+		int q;
+		for (q = 0; q < numQueries; q++) {
+			long index = queryIndex(queries[q], totalLines);
+			if (index >= 0) {
+				targets[numTargets] = index;
+				numTargets++;
+			}
+		}
+		qsort(targets, numTargets, sizeof(long), compareLongs);
+		multiSelect(linesArray, 0, totalLines - 1, targets, numTargets);
+		free(targets);
+		numOutput = 0;
+	}
+	else if (topK > 0 && topK < totalLines) {
+		partialSort(linesArray, 0, totalLines - 1, topK - 1);
+		numOutput = topK;
+	}
+	else {
+		quicksort(linesArray, 0, totalLines - 1);
+	}
 
 	// Print runtime info to stderr for performance testing
 	gettimeofday(&endTime, NULL);
@@ -117,44 +308,150 @@ int main (int argc, char *argv[]) {
 	}
 	fprintf(stderr, "runtime: %d seconds, %d microseconds\n", seconds, micros);
 
+	// Print page fault counts to stderr for performance testing
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	fprintf(stderr, "page faults: %ld minor, %ld major\n",
+			usage.ru_minflt, usage.ru_majflt);
+
+
+	// Print the line selected by each query
+	long i;
+	int badQueries = 0;
+	for (i = 0; i < numQueries; i++) {
+		long index = queryIndex(queries[i], totalLines);
+		if (index < 0) {
+			fprintf(stderr, "Error: '%s' is not a valid rank or percentile\n", queries[i]);
+			badQueries++;
+		}
+		else if (countMode)
+			printf("%s\t%7ld %s\n", queries[i], lineCount(&table, linesArray[index]),
+					linesArray[index]);
+		else
+			printf("%s\t%s\n", queries[i], linesArray[index]);
+	}
+	free(queries);
+
+	// Merge the sorted lines into the sorted file
+	if (baseFileName != NULL) {
+		mergeWithFile(linesArray, totalLines, baseFileName);
+		numOutput = 0;
+	}
+
+	// Write the index of the lines about to be printed
+	if (indexFileName != NULL) {
+		writeIndex(linesArray, numOutput, indexFileName);
+	}
 
-	// Print all lines of the array in order
-	int i;
+	// Print the sorted lines of the array in order,
+	// freeing every line from memory
 	for (i = 0; i < totalLines; i++) {
-		printf("%s\n", linesArray[i]);
+		if (i < numOutput) {
+			if (countMode)
+				printf("%7ld %s\n", lineCount(&table, linesArray[i]), linesArray[i]);
+			else
+				printf("%s\n", linesArray[i]);
+		}
 		free(linesArray[i]);
 	}
 
-	free(linesArray);
+	munmap(linesArray, arrayLen * sizeof(char*));
+	if (uniqueMode) {
+		free(table.lines);
+		free(table.counts);
+	}
 
-	exit(0);
+	// Fail if any query selected no line
+	exit(badQueries > 0 ? 1 : 0);
 }
 
-/* void quicksort(char **strArray, int lower, int upper) -- Using the
+/* void quicksort(char **strArray, long lower, long upper) -- Using the
  * quicksort algorithm from CLRS, recursively sorts all elements
  * between and including indexes upper and lower in strArray.
 */
-void quicksort(char **strArray, int lower, int upper) {
+void quicksort(char **strArray, long lower, long upper) {
 	if (lower < upper) {
 		// Partition range
-		int pivot = partition(strArray, lower, upper);
+		long pivot = partition(strArray, lower, upper);
 		// Call quickosrt again on each range around pivot
   		quicksort(strArray, lower, pivot - 1);
 		quicksort(strArray, pivot + 1, upper);
 	}
 }
 
-/* void partition(char **strArray, int lower, int upper) --
+/* void multiSelect(char **strArray, long lower, long upper, long *targets, long numTargets) --
+ * Precondition: targets holds numTargets indexes between lower and upper
+ * in increasing order.
+ * Using partition(), rearranges the elements between and including indexes
+ * lower and upper in strArray so that the element at each index in targets
+ * is the one that would be there if the range were sorted.
+ * Only the partitions that hold a target are partitioned again.
+*/
+void multiSelect(char **strArray, long lower, long upper, long *targets, long numTargets) {
+	while (numTargets > 0 && lower < upper) {
+		// Partition range
+		long pivot = partition(strArray, lower, upper);
+
+		// Split the targets into those before and after the pivot
+		long numBefore = 0;
+		while (numBefore < numTargets && targets[numBefore] < pivot)
+			numBefore++;
+		long numDone = numBefore;
+		while (numDone < numTargets && targets[numDone] == pivot)
+			numDone++;
+
+		// Select the targets before the pivot, then
+		// continue with the targets after the pivot
+		multiSelect(strArray, lower, pivot - 1, targets, numBefore);
+		targets += numDone;
+		numTargets -= numDone;
+		lower = pivot + 1;
+	}
+}
+
+/* void quickselect(char **strArray, long lower, long upper, long target) --
+ * Using partition(), rearranges the elements between and including
+ * indexes lower and upper in strArray so that the element at index
+ * target is the one that would be there if the range were sorted,
+ * with no greater element before it and no smaller element after it.
+ * Only the side of each partition that holds target is partitioned again.
+*/
+void quickselect(char **strArray, long lower, long upper, long target) {
+	while (lower < upper) {
+		// Partition range
+		long pivot = partition(strArray, lower, upper);
+		// Continue with the side of the pivot that holds target
+		if (target < pivot)
+			upper = pivot - 1;
+		else if (target > pivot)
+			lower = pivot + 1;
+		else
+			return;
+	}
+}
+
+/* void partialSort(char **strArray, long lower, long upper, long last) --
+ * Moves the smallest (last - lower + 1) elements between and including
+ * indexes lower and upper in strArray to indexes lower to last, in
+ * sorted order. The order of the remaining elements is undefined.
+*/
+void partialSort(char **strArray, long lower, long upper, long last) {
+	// Find the boundary of the prefix, then sort only the prefix
+	quickselect(strArray, lower, upper, last);
+	quicksort(strArray, lower, last);
+}
+
+/* void partition(char **strArray, long lower, long upper) --
  * Using the partition algorithm from CLRS, partitions all
  * elements between and including indexes lower and upper
  * in strArray around a pivot chosen by the 'median of 3'
  * method (implemented in selectPivot()).
  * Returns pivot index
 */
-int partition(char **strArray, int lower, int upper) {
+long partition(char **strArray, long lower, long upper) {
 
 	//Select the optimal pivot index
-  	int pivot = selectPivot(strArray, lower, upper);
+  	long pivot = selectPivot(strArray, lower, upper);
 
 	// Move pivot to the end
   	swapStr(strArray, pivot, upper);
@@ -164,11 +461,11 @@ int partition(char **strArray, int lower, int upper) {
 
 	// Variable to keep track of how many strings equivalent
 	// to the pivot we encounter
-	int eqLines = 0;
+	long eqLines = 0;
 
-  	int j;
+  	long j;
   	int strcmpRetVal;
-  	int currIndex = lower - 1;
+  	long currIndex = lower - 1;
 
 	// Move the values relative to the pivot
   	for (j = lower; j <= upper - 1; j++) {
@@ -194,7 +491,7 @@ int partition(char **strArray, int lower, int upper) {
   	return currIndex + 1;
 }
 
-/* selectPivot(char **strArray, int lower, int upper) --
+/* selectPivot(char **strArray, long lower, long upper) --
  * Uses the 'median of 3' approach to select
  * (and return the index of) an optimal pivot between
  * and including lower and upperin strArray for partitioning.
@@ -202,14 +499,14 @@ int partition(char **strArray, int lower, int upper) {
  * each other within the array, which will aid future sorting.
  * If the range is 10 or smaller, simply returns upper index.
 */
-int selectPivot(char **strArray, int lower, int upper) {
+long selectPivot(char **strArray, long lower, long upper) {
 
 	// Abort if range is too small
 	if (upper - lower <= 10)
   		return upper;
 
 	// Set midpoint
-  	int mid = (upper + lower) / 2;
+  	long mid = (upper + lower) / 2;
 
 	// Sort the three values
   	if (strcmp(strArray[mid], strArray[lower]) < 0)
@@ -223,44 +520,342 @@ int selectPivot(char **strArray, int lower, int upper) {
   	return mid; // index of median value
 }
 
-/* swapStr(char **strArray, int indexA, int indexB) --
+/* swapStr(char **strArray, long indexA, long indexB) --
  * Swaps the string pointers at indexA and indexB in
  * strArray with one another.
 */
-void swapStr(char **strArray, int indexA, int indexB) {
+void swapStr(char **strArray, long indexA, long indexB) {
 	char* temp = strArray[indexA];
   	strArray[indexA] = strArray[indexB];
   	strArray[indexB] = temp;
 }
 
 /*
- * extendArray(char **oldArray, int oldLen, int newLen) --
- * Accepts a character pointer array (oldArray) of length oldLen,
- * creates a new, bigger array with the size newLen, and
- * copies all elements from oldArray to the new array.
+ * allocArray(long len) --
+ * Maps a new character pointer array of length len, and asks the
+ * kernel to back it with transparent huge pages, so that filling and
+ * sorting a large array takes far fewer page faults and TLB misses.
+ * The array must be released with munmap().
  * Returns a pointer to the new array.
  * Returns NULL if memory allocation fails for the new array.
 */
-char **extendArray(char **oldArray, int oldLen, int newLen) {
+char **allocArray(long len) {
 
-	// Create new bigger array
-	char **newArray = malloc(newLen * sizeof(char*));
-	// Return NULL if malloc fails
-	if (newArray == NULL) {
-		// malloc() failed. Return NULL
+	// Map the new array
+	void *memoryBuffer = mmap(	NULL, len * sizeof(char*), PROT_READ | PROT_WRITE,
+								MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+	// Return NULL if mmap fails
+	if (memoryBuffer == MAP_FAILED) {
 		return NULL;
 	}
 
-	//Copy all values over
-  	int i;
-  	for (i = 0; i < oldLen; i++)
-  	{
-  		newArray[i] = oldArray[i];
-  	}
+	// Huge pages are only a hint, so ignore failure
+	madvise(memoryBuffer, len * sizeof(char*), MADV_HUGEPAGE);
 
-	// Free old array
-  	free(oldArray);
+	// Return new array
+	return (char**) memoryBuffer;
+}
+
+/*
+ * extendArray(char **oldArray, long oldLen, long newLen) --
+ * Accepts a character pointer array (oldArray) of length oldLen,
+ * created by allocArray(), and grows it to the size newLen with mremap().
+ * The kernel moves the existing pages to a bigger mapping if needed,
+ * so no elements are copied, and the huge page hint is kept.
+ * Returns a pointer to the new array.
+ * Returns NULL if memory allocation fails for the new array.
+*/
+char **extendArray(char **oldArray, long oldLen, long newLen) {
+
+	// Grow the mapping, moving it if there is no room to grow in place
+	void *memoryBuffer = mremap(oldArray, oldLen * sizeof(char*),
+								newLen * sizeof(char*), MREMAP_MAYMOVE);
+	// Return NULL if mremap fails
+	if (memoryBuffer == MAP_FAILED) {
+		return NULL;
+	}
 
 	// Return new array
-  	return newArray;
+  	return (char**) memoryBuffer;
+}
+
+/*
+ * long uniqueLines(char **linesArray, long totalLines, struct lineTable *table) --
+ * Counts how many times each distinct line occurs in linesArray using
+ * a hash table, and moves the first occurrence of each distinct line
+ * to the front of linesArray, so that only distinct lines are sorted.
+ * Duplicate lines are freed, since they are no longer in linesArray.
+ * Sets up table so the counts can be found afterwards with lineCount().
+ * Returns the number of distinct lines.
+*/
+long uniqueLines(char **linesArray, long totalLines, struct lineTable *table) {
+
+	// Size the table to a power of 2 at least twice the number of lines
+	unsigned long tableLen = 2;
+	while (tableLen < 2 * (unsigned long) totalLines)
+		tableLen *= 2;
+	table->lines = calloc(tableLen, sizeof(char*));
+	table->counts = calloc(tableLen, sizeof(long));
+	table->mask = tableLen - 1;
+
+	// Check for unsuccessful calloc
+	if (table->lines == NULL || table->counts == NULL) {
+		fprintf(stderr, "ERROR: Out of memory!\n");
+		exit(1);
+	}
+
+	// Count each line, keeping the first occurrence of each one
+	long i;
+	long numDistinct = 0;
+	unsigned long slot;
+	for (i = 0; i < totalLines; i++) {
+		slot = findLine(table, linesArray[i]);
+		if (table->lines[slot] == NULL) {
+			table->lines[slot] = linesArray[i];
+			linesArray[numDistinct] = linesArray[i];
+			numDistinct++;
+		}
+		else {
+			// Free the duplicate line
+			free(linesArray[i]);
+		}
+		table->counts[slot]++;
+	}
+
+	return numDistinct;
+}
+
+/*
+ * long lineCount(struct lineTable *table, char *line) --
+ * Returns the number of times line occurred in the lines
+ * given to uniqueLines() when table was set up.
+*/
+long lineCount(struct lineTable *table, char *line) {
+	return table->counts[findLine(table, line)];
+}
+
+/*
+ * unsigned long findLine(struct lineTable *table, char *line) --
+ * Returns the slot of table that holds line, or the empty
+ * slot where line belongs if it is not in the table yet.
+ * Collisions are resolved by linear probing.
+*/
+unsigned long findLine(struct lineTable *table, char *line) {
+	unsigned long slot = hashStr(line) & table->mask;
+	while (table->lines[slot] != NULL && strcmp(table->lines[slot], line) != 0)
+		slot = (slot + 1) & table->mask;
+	return slot;
+}
+
+/*
+ * unsigned long hashStr(char *str) --
+ * Returns the 64-bit FNV-1a hash of str.
+*/
+unsigned long hashStr(char *str) {
+	unsigned long hash = 14695981039346656037UL;
+	while (*str != '\0') {
+		hash ^= (unsigned char) *str;
+		hash *= 1099511628211UL;
+		str++;
+	}
+	return hash;
+}
+
+/*
+ * int parseQueries(char *queryList, char ***queries) --
+ * Splits the comma-separated list of ranks and percentiles given
+ * with -q (for example "1,100,p50,p99.9") into separate strings.
+ * Sets queries to a new array of those strings.
+ * Returns the number of queries.
+*/
+int parseQueries(char *queryList, char ***queries) {
+
+	// Count the queries so the array can be sized once
+	int numQueries = 1;
+	char *curr;
+	for (curr = queryList; *curr != '\0'; curr++) {
+		if (*curr == ',')
+			numQueries++;
+	}
+
+	*queries = malloc(numQueries * sizeof(char*));
+	if (*queries == NULL) {
+		fprintf(stderr, "ERROR: Out of memory!\n");
+		exit(1);
+	}
+
+	// Split the list in place at each comma
+	int i = 0;
+	char *query = strtok(queryList, ",");
+	while (query != NULL) {
+		(*queries)[i] = query;
+		i++;
+		query = strtok(NULL, ",");
+	}
+
+	return i;
+}
+
+/*
+ * long queryIndex(char *query, long totalLines) --
+ * Returns the index in a sorted array of totalLines lines selected by query.
+ * A query of the form 'pN' is a percentile, using the nearest-rank method;
+ * a percentile of more than 2 plain digits has an implied decimal point
+ * after the second digit, so p999 is the 99.9th percentile.
+ * Any other query is a 1-based rank.
+ * Returns -1 if query is not valid or selects no line.
+*/
+long queryIndex(char *query, long totalLines) {
+	char *end;
+
+	if (totalLines <= 0)
+		return -1;
+
+	// Percentile queries
+	if (query[0] == 'p') {
+		double percentile = strtod(query + 1, &end);
+		if (end == query + 1 || *end != '\0' || !isfinite(percentile))
+			return -1;
+		if (percentile > 100 && strspn(query + 1, "0123456789") == strlen(query + 1)) {
+			while (percentile >= 100)
+				percentile /= 10;
+		}
+		if (percentile < 0 || percentile > 100)
+			return -1;
+
+		// Nearest rank: the smallest line with at least
+		// percentile% of the lines at or below it
+		double exactRank = percentile / 100 * totalLines;
+		long rank = (long) exactRank;
+		if (rank < exactRank)
+			rank++;
+		if (rank < 1)
+			rank = 1;
+		return rank - 1;
+	}
+
+	// Rank queries
+	long rank = strtol(query, &end, 10);
+	if (end == query || *end != '\0' || rank < 1 || rank > totalLines)
+		return -1;
+	return rank - 1;
+}
+
+/*
+ * int compareLongs(const void *a, const void *b) --
+ * Comparison function for sorting an array of longs with qsort().
+*/
+int compareLongs(const void *a, const void *b) {
+	long longA = *(const long*) a;
+	long longB = *(const long*) b;
+	return (longA > longB) - (longA < longB);
+}
+
+/*
+ * void mergeWithFile(char **linesArray, long totalLines, char *baseFileName) --
+ * Precondition: the lines of the file baseFileName are sorted,
+ * and the string pointers in linesArray indexes 0 to totalLines-1 are sorted.
+ * Prints the lines of the file and of linesArray together in sorted order.
+ * The file is read one line at a time from start to end, so it is never
+ * held in memory and is never sorted again. As in merge(), a line from the
+ * file is printed before an equal line from linesArray.
+*/
+void mergeWithFile(char **linesArray, long totalLines, char *baseFileName) {
+
+	// Open file for reading
+	FILE *baseFile = fopen(baseFileName, "r");
+
+	// Exit if file does not open
+	if (baseFile == NULL) {
+		fprintf(stderr, "The file \'%s\' does not exist.\n", baseFileName);
+		exit(1);
+	}
+
+	// The file is only read sequentially, so read it in large blocks
+	posix_fadvise(fileno(baseFile), 0, 0, POSIX_FADV_SEQUENTIAL);
+	setvbuf(baseFile, NULL, _IOFBF, 1 << 20);
+
+	// Declare variables for our file-reading loop
+	char *buf = NULL;
+	size_t bufLen = 0;
+	ssize_t lineLen;
+	long j = 0;
+
+	// Merge values
+	while ((lineLen = getline(&buf, &bufLen, baseFile)) != EOF) {
+
+		// Remove final newline characters to standardize lines
+		if (lineLen > 0 && buf[lineLen - 1] == '\n') {
+			buf[lineLen - 1] = '\0';
+		}
+
+		// Print the lines of the array that come before this line
+		while (j < totalLines && strcmp(linesArray[j], buf) < 0) {
+			printf("%s\n", linesArray[j]);
+			j++;
+		}
+
+		printf("%s\n", buf);
+	}
+
+	// Print the lines of the array after the end of the file
+	while (j < totalLines) {
+		printf("%s\n", linesArray[j]);
+		j++;
+	}
+
+	// Cleanup memory from file input
+	free(buf);
+	fclose(baseFile);
+}
+
+/*
+ * void writeIndex(char **linesArray, long totalLines, char *indexFileName) --
+ * Writes a binary index of the sorted lines in linesArray indexes 0 to
+ * totalLines-1 to the file indexFileName, so that sortLookup can search
+ * the sorted output without reading or sorting it again.
+ * The index is an indexHeader followed by one indexEntry per line,
+ * in the byte order of this machine.
+*/
+void writeIndex(char **linesArray, long totalLines, char *indexFileName) {
+
+	// Open index file for writing
+	FILE *indexFile = fopen(indexFileName, "w");
+
+	// Exit if file does not open
+	if (indexFile == NULL) {
+		fprintf(stderr, "The index file \'%s\' cannot be created.\n", indexFileName);
+		exit(1);
+	}
+
+	// Leave room for the header, which needs the total output size
+	struct indexHeader header;
+	memset(&header, 0, sizeof(header));
+	fwrite(&header, sizeof(header), 1, indexFile);
+
+	// Write the output offset and prefix of each line
+	struct indexEntry entry;
+	uint64_t offset = 0;
+	long i;
+	for (i = 0; i < totalLines; i++) {
+		entry.offset = offset;
+		strncpy(entry.prefix, linesArray[i], INDEX_PREFIX_LEN);
+		fwrite(&entry, sizeof(entry), 1, indexFile);
+
+		// Each line is printed followed by a newline
+		offset += strlen(linesArray[i]) + 1;
+	}
+
+	// Write the header at the start of the file
+	memcpy(header.magic, INDEX_MAGIC, sizeof(header.magic));
+	header.numLines = totalLines;
+	header.dataSize = offset;
+	rewind(indexFile);
+	fwrite(&header, sizeof(header), 1, indexFile);
+
+	// Exit if any write failed
+	if (ferror(indexFile) || fclose(indexFile) != 0) {
+		fprintf(stderr, "Error: could not write the index file \'%s\'\n", indexFileName);
+		exit(1);
+	}
 }
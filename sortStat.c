@@ -0,0 +1,289 @@
+/* sortStat -- shows the live progress of a sortThread or sortProcess run
+ * started with the -S option, by reading the telemetry segment it
+ * publishes in shared memory as /sortstat.<pid>.
+ * Once a second (or every interval seconds), prints the phase of the
+ * sort, the lines done so far in that phase, an estimate of the time
+ * left in it, the bytes written, and the slowest worker, until the
+ * sort is done.
+ * Usage:
+ *   sortStat [-w] <pid> [interval]
+ *       -w  also prints the progress of each worker
+*/
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+
+// Macros to define the telemetry segment published with -S
+#define STATS_MAGIC "QSSTAT1"
+#define STATS_MAX_WORKERS 16
+#define STATS_PHASE_READ 1
+#define STATS_PHASE_SORT 2
+#define STATS_PHASE_MERGE 3
+#define STATS_PHASE_WRITE 4
+#define STATS_PHASE_DONE 5
+
+/*
+ * statsWorker -- the counters one worker publishes in the telemetry
+ * segment: lines done out of linesTotal in the current phase, bytes
+ * written, and the phase and merge level it is working on.
+*/
+struct statsWorker {
+	volatile uint64_t linesDone;
+	volatile uint64_t linesTotal;
+	volatile uint64_t bytesWritten;
+	volatile uint32_t phase;
+	volatile uint32_t mergeLevel;
+	char padding[32];
+};
+
+/*
+ * statsSegment -- the telemetry segment published with -S.
+ * magic holds STATS_MAGIC, phase is the STATS_PHASE the sort is in,
+ * which started at phaseStart (in microseconds since the epoch),
+ * and numWorkers is the number of entries of workers in use.
+*/
+struct statsSegment {
+	char magic[8];
+	uint64_t pid;
+	volatile uint64_t totalLines;
+	volatile uint64_t phaseStart;
+	volatile uint32_t phase;
+	volatile uint32_t mergeLevel;
+	uint32_t numWorkers;
+	char padding[20];
+	struct statsWorker workers[STATS_MAX_WORKERS];
+};
+
+// Prototype declaration for main program functions
+void usage(char*);
+struct statsSegment *openStats(long);
+void printStats(struct statsSegment*, int);
+char *phaseName(int);
+double percentDone(uint64_t, uint64_t);
+
+/*
+ * void usage(char *progName) --
+ * Prints the command-line usage of the program to stderr and exits.
+*/
+void usage(char *progName) {
+	fprintf(stderr, "%s [-w] <pid> [interval]\n"
+			"  -w  also print the progress of each worker\n",
+			progName);
+	exit(1);
+}
+
+int main (int argc, char *argv[]) {
+
+	// Parse command-line options
+	int showWorkers = 0;
+	int opt;
+	while ((opt = getopt(argc, argv, "w")) != -1) {
+		switch (opt) {
+		case 'w':
+			// Print the progress of each worker
+			showWorkers = 1;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	// Exit if the wrong number of arguments is given
+	if (argc - optind != 1 && argc - optind != 2) {
+		usage(argv[0]);
+	}
+	long pid = atol(argv[optind]);
+	double interval = argc - optind == 2 ? atof(argv[optind + 1]) : 1.0;
+	if (pid <= 0 || interval <= 0) {
+		usage(argv[0]);
+	}
+
+	// Print the progress until the sort is done
+	struct statsSegment *stats = openStats(pid);
+	while (1) {
+		printStats(stats, showWorkers);
+		fflush(stdout);
+		if (stats->phase == STATS_PHASE_DONE)
+			break;
+
+		// The segment is left behind if the sort is killed
+		if (kill(pid, 0) < 0 && errno == ESRCH) {
+			fprintf(stderr, "The sort with pid %ld exited before it was done.\n", pid);
+			exit(1);
+		}
+		usleep((useconds_t) (interval * 1000000));
+	}
+
+	exit(0);
+}
+
+/*
+ * struct statsSegment *openStats(long pid) --
+ * Maps the telemetry segment published by the sort with process id pid.
+ * Exits if there is none, or it is not a valid telemetry segment.
+*/
+struct statsSegment *openStats(long pid) {
+
+	// Open the segment, named after the sort process
+	char name[64];
+	sprintf(name, "/sortstat.%ld", pid);
+	int fd = shm_open(name, O_RDONLY, 0);
+	if (fd < 0) {
+		fprintf(stderr, "No sort started with -S is running with pid %ld.\n", pid);
+		exit(1);
+	}
+
+	// Check the size of the segment before mapping it
+	struct stat fileStat;
+	if (fstat(fd, &fileStat) < 0) {
+		perror("fstat");
+		exit(1);
+	}
+	if (fileStat.st_size != sizeof(struct statsSegment)) {
+		fprintf(stderr, "Error: \'%s\' is not a valid telemetry segment\n", name);
+		exit(1);
+	}
+
+	struct statsSegment *stats = mmap(NULL, sizeof(struct statsSegment), PROT_READ,
+										MAP_SHARED, fd, 0);
+	if ( stats == MAP_FAILED ) {
+		fprintf(stderr, "errno is %d\n", errno);
+		perror("stats is MAP_FAILED ");
+		exit(1);
+	}
+	close(fd);
+
+	// Check the header of the segment
+	if (memcmp(stats->magic, STATS_MAGIC, sizeof(stats->magic)) != 0 ||
+			stats->numWorkers > STATS_MAX_WORKERS) {
+		fprintf(stderr, "Error: \'%s\' is not a valid telemetry segment\n", name);
+		exit(1);
+	}
+
+	return stats;
+}
+
+/*
+ * void printStats(struct statsSegment *stats, int showWorkers) --
+ * Prints one line with the phase of the sort, the time spent in it,
+ * the lines done in it and an estimate of the time left, the bytes
+ * written and the slowest worker, followed by a line for each worker
+ * if showWorkers is set.
+*/
+void printStats(struct statsSegment *stats, int showWorkers) {
+
+	// Read the phase before the counters that belong to it
+	int phase = stats->phase;
+	int mergeLevel = stats->mergeLevel;
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	double elapsed = (now.tv_sec * 1000000.0 + now.tv_usec - stats->phaseStart) / 1000000;
+
+	// Add up the counters of all workers, and find the slowest one
+	uint64_t linesDone = 0;
+	uint64_t linesTotal = 0;
+	uint64_t bytesWritten = 0;
+	int slowest = -1;
+	int numActive = 0;
+	int i;
+	for (i = 0; i < stats->numWorkers; i++) {
+		struct statsWorker *worker = &stats->workers[i];
+		numActive += worker->linesTotal > 0;
+		linesDone += worker->linesDone;
+		linesTotal += worker->linesTotal;
+		bytesWritten += worker->bytesWritten;
+		if (worker->linesTotal > 0 && (slowest < 0 ||
+				percentDone(worker->linesDone, worker->linesTotal) <
+				percentDone(stats->workers[slowest].linesDone,
+							stats->workers[slowest].linesTotal)))
+			slowest = i;
+	}
+
+	// Print the phase, and the merge level out of the number of levels
+	if (phase == STATS_PHASE_MERGE) {
+		int numLevels = 0;
+		while ((1 << numLevels) < stats->numWorkers)
+			numLevels++;
+		printf("%-5s %2d/%-2d", phaseName(phase), mergeLevel, numLevels);
+	}
+	else {
+		printf("%-11s", phaseName(phase));
+	}
+
+	if (phase == STATS_PHASE_DONE) {
+		printf("  %lu lines\n", (unsigned long) stats->totalLines);
+		return;
+	}
+	printf(" %7.1fs", elapsed);
+
+	// Print the progress of the phase, once its workers have started
+	if (linesTotal > 0) {
+		printf("  %5.1f%%  %lu/%lu lines", percentDone(linesDone, linesTotal),
+				(unsigned long) linesDone, (unsigned long) linesTotal);
+		if (linesDone > 0)
+			printf("  eta %.1fs", elapsed * (linesTotal - linesDone) / linesDone);
+	}
+	if (bytesWritten > 0)
+		printf("  %.1f MB written", bytesWritten / 1048576.0);
+	if (numActive > 1)
+		printf("  slowest: worker %d at %.1f%%", slowest,
+				percentDone(stats->workers[slowest].linesDone,
+							stats->workers[slowest].linesTotal));
+	printf("\n");
+
+	// Print a line for each worker working on the phase
+	for (i = 0; showWorkers && i < stats->numWorkers; i++) {
+		struct statsWorker *worker = &stats->workers[i];
+		if (worker->linesTotal == 0)
+			continue;
+		printf("    worker %2d: %-5s", i, phaseName(worker->phase));
+		if (worker->phase == STATS_PHASE_MERGE)
+			printf(" %2d", worker->mergeLevel);
+		printf("  %5.1f%%  %lu/%lu lines", percentDone(worker->linesDone, worker->linesTotal),
+				(unsigned long) worker->linesDone, (unsigned long) worker->linesTotal);
+		if (worker->bytesWritten > 0)
+			printf("  %.1f MB written", worker->bytesWritten / 1048576.0);
+		printf("\n");
+	}
+}
+
+/*
+ * char *phaseName(int phase) --
+ * Returns the name of a STATS_PHASE.
+*/
+char *phaseName(int phase) {
+	switch (phase) {
+	case STATS_PHASE_READ:
+		return "read";
+	case STATS_PHASE_SORT:
+		return "sort";
+	case STATS_PHASE_MERGE:
+		return "merge";
+	case STATS_PHASE_WRITE:
+		return "write";
+	case STATS_PHASE_DONE:
+		return "done";
+	default:
+		return "start";
+	}
+}
+
+/*
+ * double percentDone(uint64_t linesDone, uint64_t linesTotal) --
+ * Returns linesDone as a percentage of linesTotal, at most 100.
+*/
+double percentDone(uint64_t linesDone, uint64_t linesTotal) {
+	if (linesTotal == 0 || linesDone >= linesTotal)
+		return 100.0;
+	return 100.0 * linesDone / linesTotal;
+}
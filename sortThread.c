@@ -8,21 +8,239 @@
 /* sortThread -- sorts the limes in a given text file using
  * a multi-threaded implementation of quicksort, based on the
  * CLRS quicksort algorithm.
- * The number of threads to create is the first command line argument.
+ * The number of threads to create is the first command line argument,
+ * or 'auto' to sample the input and the machine and pick the engine,
+ * the number of threads and the insertion sort cutoff automatically.
  * The path of the file to be sorted is the second command-line argument.
+ * Options may be given before the arguments:
+ *   -u  prints each distinct line once (like sort -u)
+ *   -c  prints each distinct line once with its count (like sort | uniq -c)
+ *   -k <numLines>  prints only the first numLines lines of sorted order,
+ *       found with quickselect so only those lines are fully sorted
+ *   -q <queries>  prints only the lines at the given comma-separated
+ *       ranks (1 is the first line) and percentiles (p50, p99, p99.9),
+ *       found with a multi-threaded, multi-target quickselect;
+ *       exits with status 1 if any query is not valid
+ *   -i <sortedFile>  prints the lines merged into the already-sorted
+ *       sortedFile, which is streamed instead of being sorted again
+ *   -x <indexFile>  also writes a binary index of the line offsets and
+ *       key prefixes of the sorted output, for lookups with sortLookup
+ *   -C  indexes lines with 4 or 5 byte offsets into the file instead of
+ *       8 byte pointers, roughly halving the memory used for the index
+ *   -U  reads the file and writes the sorted lines with io_uring, keeping
+ *       several large requests in flight, falling back to read() and
+ *       write() if the kernel does not support it
+ *   -o <outputFile>  writes the sorted lines to outputFile instead of
+ *       standard output, with each thread writing its own slice of the
+ *       file at once using pwrite()
+ *   -b <batchFile>  sorts many files in one run: each line of batchFile
+ *       names an input file and the output file to write it to. Large
+ *       files are split between the threads one at a time; small files
+ *       are sorted whole, each by one thread. fileName is not given.
+ *   -m  merges already-sorted files (like sort -m) instead of sorting:
+ *       every argument after numThreads is a sorted file, and they are
+ *       streamed through a k-way merge, split into ranges merged by
+ *       separate threads when the output is a regular file
+ *   -L  sorts in the collation order of the locale (LC_COLLATE or LANG)
+ *       instead of byte order, by sorting strxfrm() keys computed once
+ *       per line in parallel
+ *   -P  sorts with a parallel quicksort instead of sorting slices and
+ *       merging them: the largest ranges are partitioned by all the
+ *       threads together, and the threads are split between the sides
+ *   -l  merges the sorted slices using the longest common prefixes of
+ *       neighbouring lines, so prefixes shared by many lines (like paths
+ *       or URLs) are not compared again at every merge step
+ *   -S  publishes the phase and per-thread progress of the sort in the
+ *       shared memory segment /sortstat.<pid>, which sortStat reads
+ *   -N <numParts>  with -o, splits the sorted lines into numParts files
+ *       outputFile.0000, outputFile.0001, ... of contiguous key ranges
+ *       holding about the same number of lines, each merged and written
+ *       by its own thread, and lists them with the first line of each in
+ *       outputFile.manifest, for consumers that process the ranges apart
+ *   -F  prints the smallest lines as soon as they are sorted, sorting
+ *       the leftmost ranges of the array first while the other threads
+ *       sort the rest, so a consumer of the output can start early
+ *   -V  merges the sorted slices by 8 byte keys of the first bytes of each
+ *       line, several keys at a time with AVX2 or SSE4.2 bitonic merge
+ *       networks when the CPU supports them, comparing whole lines only
+ *       where the keys are equal
 */
 
+#define _GNU_SOURCE
 #include <unistd.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <math.h>
 #include <errno.h>
+#include <locale.h>
 #include <pthread.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/types.h>
+#include <sys/syscall.h>
+#ifdef __has_include
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+#endif
+#ifdef __x86_64__
+#include <immintrin.h>
+#endif
 
-// Macro to define initial size of the array
-#define INIT_ARRAY_SZ 128
+// io_uring is used by -U only when the kernel headers have its opcode
+// probe (Linux 5.6 and later); otherwise -U always uses read() and write()
+#if defined(IO_URING_OP_SUPPORTED) && defined(__NR_io_uring_setup)
+#define HAVE_IO_URING
+#else
+#define IORING_OP_READ 22
+#define IORING_OP_WRITE 23
+#endif
+
+// Macros to define the size and number of requests kept in flight with -U
+#define IO_CHUNK_SIZE (1 << 20)
+#define IO_QUEUE_DEPTH 8
+
+// Macros to define how the auto mode samples the input and picks a configuration
+#define AUTO_SAMPLE_SIZE 4096
+#define AUTO_LINES_PER_THREAD 16384
+#define AUTO_LONG_PREFIX 8
+#define AUTO_ENGINE_NONE 0
+#define AUTO_ENGINE_SEQUENTIAL 1
+#define AUTO_ENGINE_THREADS 2
+
+// Macros to define the batch mode: files of at least BATCH_SPLIT_BYTES
+// are split between threads, and smaller files are sorted whole by one thread
+#define BATCH_SPLIT_BYTES (1 << 22)
+#define INIT_BATCH_SZ 64
+
+// Macros to define the merge-only mode: inputs of at least MERGE_SPLIT_BYTES
+// are split into ranges merged in parallel, using splitters chosen from
+// MERGE_SAMPLES lines of each file
+#define MERGE_SPLIT_BYTES (1 << 22)
+#define MERGE_SAMPLES 64
+
+// Ranges of at least this many lines are partitioned by several threads
+// together with -P; smaller ones are sorted by a single thread
+#define PARALLEL_PARTITION_MIN (1 << 16)
+
+// Macros to define the telemetry segment published with -S
+#define STATS_MAGIC "QSSTAT1"
+#define STATS_MAX_WORKERS 16
+#define STATS_PHASE_READ 1
+#define STATS_PHASE_SORT 2
+#define STATS_PHASE_MERGE 3
+#define STATS_PHASE_WRITE 4
+#define STATS_PHASE_DONE 5
+
+// Merges and writes publish their progress every this many lines
+#define STATS_UPDATE_LINES 4096
+
+// With -N, PART_SAMPLES lines per part are sampled from each sorted
+// slice to choose the keys that split the lines into parts
+#define PART_SAMPLES 32
+
+// With -F, ranges of at most STREAM_LEAF_LINES lines are sorted whole and
+// printed; larger ones are partitioned first. A range is in one of the
+// STREAM states: left to sort, being partitioned or sorted by a thread,
+// or sorted and waiting to be printed
+#define STREAM_LEAF_LINES (1 << 12)
+#define STREAM_UNSORTED 0
+#define STREAM_SORTING 1
+#define STREAM_SORTED 2
+
+// The smallest page size, used to keep word-sized reads within a page
+#define MIN_PAGE_SIZE 4096
+
+// Macros to define the sorting network used for the leaves of quicksort
+#define NETWORK_SIZE 16
+#define NETWORK_PAIRS 63
+
+// Macros to define the format of the index written with -x
+#define INDEX_MAGIC "QSIDX01"
+#define INDEX_PREFIX_LEN 8
+
+/*
+ * indexHeader -- the start of an index file written with -x.
+ * magic holds INDEX_MAGIC, numLines is the number of lines
+ * in the sorted output, and dataSize is its size in bytes.
+*/
+struct indexHeader {
+	char magic[8];
+	uint64_t numLines;
+	uint64_t dataSize;
+};
+
+/*
+ * indexEntry -- one line of the sorted output in an index file:
+ * the byte offset where the line starts, and the first
+ * INDEX_PREFIX_LEN bytes of the line, padded with '\0'.
+*/
+struct indexEntry {
+	uint64_t offset;
+	char prefix[INDEX_PREFIX_LEN];
+};
+
+/*
+ * offsetArray -- a compact array of line offsets into the file
+ * buffer, used by the -C mode in place of an array of string pointers.
+ * Each offset takes width bytes: 4 for files under 4 GiB, otherwise
+ * 5, which covers files up to 1 TiB.
+*/
+struct offsetArray {
+	unsigned char *data;
+	char *buffer;
+	int width;
+};
+
+/*
+ * ioRing -- an io_uring instance used by the -U mode, with pointers
+ * into its mapped submission and completion queues.
+*/
+struct ioRing {
+	int fd;
+	void *sqPtr;
+	void *cqPtr;
+	size_t sqLen;
+	size_t cqLen;
+	size_t sqesLen;
+	unsigned *sqHead;
+	unsigned *sqTail;
+	unsigned *sqMask;
+	unsigned *sqArray;
+	struct io_uring_sqe *sqes;
+	unsigned *cqHead;
+	unsigned *cqTail;
+	unsigned *cqMask;
+	struct io_uring_cqe *cqes;
+};
+
+/*
+ * outputStream -- buffered standard output for the -U mode.
+ * Lines are copied into buffers[current] until it holds fill bytes;
+ * each full buffer is written while the next one is filled.
+ * slotData, slotLen and slotOffset hold the part of each busy buffer
+ * still being written, and offset is the file offset of the next write,
+ * or -1 if standard output cannot seek.
+*/
+struct outputStream {
+	struct ioRing ring;
+	int useRing;
+	char *buffers[IO_QUEUE_DEPTH];
+	int busy[IO_QUEUE_DEPTH];
+	char *slotData[IO_QUEUE_DEPTH];
+	long slotLen[IO_QUEUE_DEPTH];
+	long slotOffset[IO_QUEUE_DEPTH];
+	int current;
+	long fill;
+	long offset;
+	int inFlight;
+	int maxInFlight;
+};
 
 /*
  * threadParams -- a struct to hold the parameters
@@ -30,112 +248,796 @@
  * to allow them to be called by pthread_create().
  * For the quicksort function, the fields
  * ourputArray and mid are left unused.
+ * For the partial sort function, mid holds the last
+ * index to be sorted and outputArray is left unused.
+ * For the -C mode functions, inputOffsets and outputOffsets
+ * are used in place of inputArray and outputArray.
+ * numThreads is only used by the parallel quicksort function.
+ * If outputLcp is not NULL, the merge function merges with lcpMerge().
+ * worker is the slot of the thread in the telemetry segment.
 */
 struct threadParams {
 	char **inputArray;
 	char **outputArray;
-	int lower;
-	int mid;
-	int upper;
+	struct offsetArray *inputOffsets;
+	struct offsetArray *outputOffsets;
+	long lower;
+	long mid;
+	long upper;
+	int numThreads;
+	long *inputLcp;
+	long *outputLcp;
+	int64_t *inputKeys;
+	int64_t *outputKeys;
+	int worker;
+};
+
+/*
+ * statsWorker -- the counters one worker publishes in the telemetry
+ * segment: lines done out of linesTotal in the current phase, bytes
+ * written, and the phase and merge level it is working on. Each worker
+ * only writes its own counters, which fill a cache line of their own.
+*/
+struct statsWorker {
+	volatile uint64_t linesDone;
+	volatile uint64_t linesTotal;
+	volatile uint64_t bytesWritten;
+	volatile uint32_t phase;
+	volatile uint32_t mergeLevel;
+	char padding[32];
+};
+
+/*
+ * statsSegment -- the telemetry segment published with -S.
+ * magic holds STATS_MAGIC, phase is the STATS_PHASE the sort is in,
+ * which started at phaseStart (in microseconds since the epoch),
+ * and numWorkers is the number of entries of workers in use.
+*/
+struct statsSegment {
+	char magic[8];
+	uint64_t pid;
+	volatile uint64_t totalLines;
+	volatile uint64_t phaseStart;
+	volatile uint32_t phase;
+	volatile uint32_t mergeLevel;
+	uint32_t numWorkers;
+	char padding[20];
+	struct statsWorker workers[STATS_MAX_WORKERS];
+};
+
+/*
+ * partitionParams -- a struct to hold the parameters
+ * for the block partitioning and swapping functions
+ * to allow them to be called by pthread_create().
+ * Each worker partitions the lines lower to upper-1 of strArray
+ * around pivotStr and stores the size of its lower side in numSmall.
+ * For the swapping function, largeRanges and smallRanges hold the
+ * misplaced lines of every block, and the worker swaps those
+ * numbered firstRank to lastRank-1.
+*/
+struct partitionParams {
+	char **strArray;
+	char *pivotStr;
+	long lower;
+	long upper;
+	long numSmall;
+	long *largeRanges;
+	long *smallRanges;
+	long firstRank;
+	long lastRank;
+};
+
+/*
+ * parseParams -- a struct to hold the parameters
+ * for the line counting and indexing functions
+ * to allow them to be called by pthread_create().
+ * Each worker scans the bytes lower to upper-1 of buffer.
+ * For the counting function, the fields linesArray,
+ * offsets and firstLine are left unused. For the indexing
+ * function, the lines are stored in offsets instead of
+ * linesArray if offsets is not NULL.
+*/
+struct parseParams {
+	char *buffer;
+	char **linesArray;
+	struct offsetArray *offsets;
+	long lower;
+	long upper;
+	long numLines;
+	long firstLine;
+};
+
+/*
+ * writeParams -- a struct to hold the parameters
+ * for the slice measuring and writing functions used by -o
+ * to allow them to be called by pthread_create().
+ * Each worker handles the lines lower to upper-1 of linesArray,
+ * which take numBytes bytes starting at offset in the file fd.
+ * table is NULL unless the lines are printed with their counts.
+ * For the measuring function, the fields fd and offset are left unused.
+ * worker is the slot of the thread in the telemetry segment.
+*/
+struct writeParams {
+	char **linesArray;
+	struct lineTable *table;
+	int fd;
+	int worker;
+	long lower;
+	long upper;
+	long numBytes;
+	long offset;
+};
+
+/*
+ * autoConfig -- the configuration picked by the auto mode: which
+ * AUTO_ENGINE to sort with, the number of threads, and the size of
+ * range that quicksort hands to insertion sort.
+*/
+struct autoConfig {
+	int engine;
+	int numThreads;
+	long cutoff;
+};
+
+/*
+ * batchJob -- one file of the batch mode: the input file to sort,
+ * the output file to write the sorted lines to, and the input size.
+*/
+struct batchJob {
+	char *inputFile;
+	char *outputFile;
+	long size;
+};
+
+/*
+ * batchParams -- the queue of files shared by the batch mode workers.
+ * Each worker takes the file at nextJob, holding lock, until
+ * nextJob reaches numJobs.
+*/
+struct batchParams {
+	struct batchJob *jobs;
+	long numJobs;
+	long nextJob;
+	pthread_mutex_t lock;
+};
+
+/*
+ * mergeLine -- a line of a mapped input file in the merge-only mode,
+ * which is not '\0' terminated: its first byte and its length.
+*/
+struct mergeLine {
+	char *str;
+	long len;
+};
+
+/*
+ * mergeCursor -- the position of the k-way merge in one input run:
+ * the line it is on, the start of the next line, the end of the run,
+ * the file the run belongs to, and how far the kernel has been asked
+ * to read ahead.
+*/
+struct mergeCursor {
+	struct mergeLine line;
+	char *next;
+	char *end;
+	int file;
+	char *readAhead;
+};
+
+/*
+ * mergeParams -- a struct to hold the parameters
+ * for the range merging function used by -m
+ * to allow it to be called by pthread_create().
+ * The range of file f runs from starts[f] to ends[f], and the
+ * merged range is written to fd at offset, or at the current
+ * position of fd if offset is -1.
+*/
+struct mergeParams {
+	char **starts;
+	char **ends;
+	int numFiles;
+	int fd;
+	long offset;
+};
+
+/*
+ * keyParams -- a struct to hold the parameters
+ * for the sort key function used by -L
+ * to allow it to be called by pthread_create().
+ * Each worker replaces the lines lower to upper-1 of linesArray
+ * with their keys, and stores the block holding them in keyBlock.
+*/
+struct keyParams {
+	char **linesArray;
+	long lower;
+	long upper;
+	char *keyBlock;
+};
+
+/*
+ * lineTable -- an open-addressing hash table holding each
+ * distinct line and the number of times it occurs, used by
+ * the -u and -c modes to collapse duplicate lines before sorting.
+*/
+struct lineTable {
+	char **lines;
+	long *counts;
+	unsigned long mask;
+};
+
+/*
+ * selectParams -- a struct to hold the parameters
+ * for the multi-target quickselect function
+ * to allow it to be called by pthread_create().
+ * targets holds numTargets increasing indexes between
+ * lower and upper, and numThreads is the number of
+ * threads the call may use.
+*/
+struct selectParams {
+	char **strArray;
+	long lower;
+	long upper;
+	long *targets;
+	long numTargets;
+	int numThreads;
+};
+
+/*
+ * partParams -- the parameters of the functions that gather, merge
+ * and write the parts of the -N mode, to allow them to be called by
+ * pthread_create(). bounds holds where each part starts in each of the
+ * numSlices sorted slices of inputArray, and partStarts where each part
+ * starts in outputArray. Each worker out of numWorkers handles every
+ * numWorkers'th part, starting with part worker.
+ * The write functions store the size of each part in partBytes, and
+ * leave inputArray and bounds unused.
+*/
+struct partParams {
+	char **inputArray;
+	char **outputArray;
+	long *bounds;
+	long *partStarts;
+	long *partBytes;
+	struct lineTable *table;
+	char *fileName;
+	int numSlices;
+	int numParts;
+	int worker;
+	int numWorkers;
+};
+
+/*
+ * streamRange -- a range of lines lower to upper (inclusive) of the
+ * -F mode, in one of the STREAM states. The ranges of a streamList are
+ * linked in the order of the array, and cover the lines not yet printed.
+*/
+struct streamRange {
+	long lower;
+	long upper;
+	int state;
+	struct streamRange *prev;
+	struct streamRange *next;
+};
+
+/*
+ * streamList -- the ranges of linesArray shared by the threads of the
+ * -F mode, from head, the next to print, to tail. The ranges and their
+ * states are only changed holding lock, signalling changed afterwards.
+ * done is set once every range is printed.
+*/
+struct streamList {
+	char **linesArray;
+	struct streamRange *head;
+	struct streamRange *tail;
+	int done;
+	pthread_mutex_t lock;
+	pthread_cond_t changed;
+};
+
+// Ranges of at most this many lines are sorted with insertion sort
+// instead of quicksort; set by the auto mode, and 0 (off) otherwise
+long insertionCutoff = 0;
+
+// The telemetry segment published with -S (NULL otherwise),
+// and the counters in it updated by the calling thread
+struct statsSegment *stats = NULL;
+__thread struct statsWorker *workerStats = NULL;
+
+// The kernel that merges the keys of -V, chosen for the CPU by
+// selectMergeKernel(), and its name
+void (*mergeKernel)(int64_t*, char**, long, int64_t*, char**, long, int64_t*, char**) = NULL;
+char *mergeKernelName = NULL;
+
+// The kernel that runs networkSort()'s sorting network, chosen for the
+// CPU by selectNetworkKernel()
+void (*networkKernel)(uint64_t*, uintptr_t*, int) = NULL;
+
+// Batcher's odd-even merge sorting network for NETWORK_SIZE inputs,
+// as pairs of indexes to compare and exchange in order
+int networkPairs[NETWORK_PAIRS][2] = {
+	{0, 1}, {2, 3}, {4, 5}, {6, 7}, {8, 9}, {10, 11}, {12, 13}, {14, 15},
+	{0, 2}, {1, 3}, {4, 6}, {5, 7}, {8, 10}, {9, 11}, {12, 14}, {13, 15},
+	{1, 2}, {5, 6}, {9, 10}, {13, 14}, {0, 4}, {1, 5}, {2, 6}, {3, 7},
+	{8, 12}, {9, 13}, {10, 14}, {11, 15}, {2, 4}, {3, 5}, {10, 12}, {11, 13},
+	{1, 2}, {3, 4}, {5, 6}, {9, 10}, {11, 12}, {13, 14}, {0, 8}, {1, 9},
+	{2, 10}, {3, 11}, {4, 12}, {5, 13}, {6, 14}, {7, 15}, {4, 8}, {5, 9},
+	{6, 10}, {7, 11}, {2, 4}, {3, 5}, {6, 8}, {7, 9}, {10, 12}, {11, 13},
+	{1, 2}, {3, 4}, {5, 6}, {7, 8}, {9, 10}, {11, 12}, {13, 14}
 };
 
 // Prototype declaration for main program functions
-char **multiThreadSort(char**, int, int);
+void usage(char*);
+char **multiThreadSort(char**, long, int, int, int);
+char **multiThreadSortParts(char**, long, int, int, long*);
+long *partBounds(char**, long, int, int);
+long lowerBoundStr(char**, long, long, char*);
+void *threadGatherParts(void*);
+void *threadMergeParts(void*);
+void gatherParts(struct partParams*);
+void mergeParts(struct partParams*);
+void writeParts(char**, long*, int, struct lineTable*, int, char*);
+void *threadWritePart(void*);
+long writePart(char**, long, long, struct lineTable*, char*, int);
+void streamSort(char**, long, int, struct lineTable*, struct timeval*);
+void *threadStreamHelper(void*);
+void streamHelper(struct streamList*);
+void sortStreamRange(struct streamList*, struct streamRange*);
+struct streamRange *newStreamRange(long, long, int);
+void multiThreadTopK(char**, long, int, long);
+void *threadPartialSort(void*);
+void multiThreadSelect(char**, long, long, long*, long, int);
+void *threadMultiSelect(void*);
 void *threadQuicksort(void*);
 void *threadMerge(void*);
-void merge(char**, char **, int, int, int);
-void quicksort(char**, int, int);
-int partition(char**, int, int);
-int selectPivot(char**, int, int);
-void swapStr(char**, int, int);
-char **extendArray(char**, int, int);
+void merge(char**, char **, long, long, long);
+void lcpMerge(char**, char**, long*, long*, long, long, long);
+long nextLcp(char**, long*, long);
+void statsOpen(int);
+void statsClose();
+void statsPhase(int, int);
+void statsAttach(int, long);
+int compareFrom(char*, char*, long*);
+void selectMergeKernel();
+void selectNetworkKernel();
+int64_t mergeKey(char*);
+void keyMerge(int64_t*, int64_t*, char**, char**, long, long, long);
+void fixKeyTies(int64_t*, int64_t*, char**, char**, long, long, long);
+void mergeKeysScalar(int64_t*, char**, long, int64_t*, char**, long, int64_t*, char**);
+void mergeKeysTail(int64_t*, char**, long, int64_t*, char**, long,
+					int64_t*, char**, int, int64_t*, char**);
+#ifdef __x86_64__
+void mergeKeysAvx2(int64_t*, char**, long, int64_t*, char**, long, int64_t*, char**);
+void bitonicMergeAvx2(__m256i*, __m256i*, __m256i*, __m256i*);
+void bitonicSortAvx2(__m256i*, __m256i*);
+void mergeKeysSse(int64_t*, char**, long, int64_t*, char**, long, int64_t*, char**);
+void bitonicMergeSse(__m128i*, __m128i*, __m128i*, __m128i*);
+void networkAvx2(uint64_t*, uintptr_t*, int);
+void compareExchangeAvx2(__m256i*, __m256i*, __m256i*, __m256i*);
+void transposeAvx2(__m256i*);
+#endif
+void quicksort(char**, long, long);
+long partition(char**, long, long);
+long selectPivot(char**, long, long);
+void swapStr(char**, long, long);
+void parallelQuicksort(char**, long, long, int);
+void *threadParallelQuicksort(void*);
+long parallelPartition(char**, long, long, int);
+void *threadPartitionBlock(void*);
+void *threadSwapMisplaced(void*);
+long partitionBlock(char**, long, long, char*);
+void swapMisplaced(char**, long*, long*, long, long);
+long nextMisplaced(long*, int*, long);
+void quickselect(char**, long, long, long);
+void partialSort(char**, long, long, long);
+void multiSelect(char**, long, long, long*, long);
+int parseQueries(char*, char***);
+long queryIndex(char*, long);
+int compareLongs(const void*, const void*);
+void mergeWithFile(char**, long, char*);
+void writeIndex(char**, long, char*);
+long uniqueLines(char**, long, struct lineTable*);
+long lineCount(struct lineTable*, char*);
+unsigned long findLine(struct lineTable*, char*);
+unsigned long hashStr(char*);
+char **readLines(char*, int, int, char**, long*, long*, struct offsetArray*);
+char **allocLineArray(long);
+long lineBoundary(char*, long, long);
+void *threadCountLines(void*);
+void *threadIndexLines(void*);
+long countLines(char*, long, long);
+void indexLines(char*, long, long, char**, long);
+void sortCompact(char*, int);
+struct offsetArray *multiThreadSortOffsets(struct offsetArray*, long, int);
+void *threadQuicksortOffsets(void*);
+void *threadMergeOffsets(void*);
+void mergeOffsets(struct offsetArray*, struct offsetArray*, long, long, long);
+void quicksortOffsets(struct offsetArray*, long, long);
+long partitionOffsets(struct offsetArray*, long, long);
+long selectPivotOffsets(struct offsetArray*, long, long);
+void swapOffsets(struct offsetArray*, long, long);
+uint64_t getOffset(struct offsetArray*, long);
+void setOffset(struct offsetArray*, long, uint64_t);
+char *offsetLine(struct offsetArray*, long);
+void allocOffsetArray(struct offsetArray*, long, int, char*);
+void indexOffsets(char*, long, long, struct offsetArray*, long);
+int ringSetup(struct ioRing*, unsigned);
+int ringProbe(int);
+void ringClose(struct ioRing*);
+void ringSubmit(struct ioRing*, int, int, char*, unsigned, long, unsigned long);
+int ringReap(struct ioRing*, unsigned long*);
+long ringReadFile(int, char*, long);
+void outputOpen(struct outputStream*, int);
+void outputWrite(struct outputStream*, char*, long);
+void outputFlush(struct outputStream*);
+void outputReap(struct outputStream*);
+void outputClose(struct outputStream*);
+void writeOutputFile(char**, long, struct lineTable*, int, char*);
+void *threadSliceSize(void*);
+void *threadWriteSlice(void*);
+long sliceSize(char**, long, long, struct lineTable*);
+void writeSlice(char**, long, long, struct lineTable*, int, long);
+void pwriteAll(int, char*, long, long);
+int autoReadThreads();
+void autoTune(char**, long, long, int, int, struct autoConfig*);
+int numaNodes();
+int isSorted(char**, long);
+int compareStrs(const void*, const void*);
+void insertionSort(char**, long, long);
+void networkSort(char**, long, long);
+void networkScalar(uint64_t*, uintptr_t*, int);
+void suffixSort(uintptr_t*, int, int);
+uint64_t prefixKey(char*);
+void sortBatch(char*, int);
+void *threadBatchWorker(void*);
+void sortFile(char*, char*, int);
+long parseBatchFile(char*, struct batchJob**);
+int compareJobSizes(const void*, const void*);
+void mergeFiles(char**, int, int, char*);
+void *threadMergeRange(void*);
+void mergeRange(char**, char**, int, int, long);
+void advanceCursor(struct mergeCursor*);
+void siftDown(struct mergeCursor**, int, int);
+int compareMergeLines(struct mergeLine*, struct mergeLine*);
+struct mergeLine *chooseSplitters(char**, long*, int, int);
+int compareSamples(const void*, const void*);
+long lowerBoundLine(char*, long, struct mergeLine*);
+char *mapSortedFile(char*, long*);
+long writeBuffer(int, char*, long, long);
+char **makeSortKeys(char**, long, int);
+void *threadMakeKeys(void*);
+char *makeKeys(char**, long, long);
+size_t keyEntryLen(size_t);
+void restoreLines(char**, long, char**, int);
+
 
 
+/*
+ * void usage(char *progName) --
+ * Prints the command-line usage of the program to stderr and exits.
+*/
+void usage(char *progName) {
+	fprintf(stderr, "%s [-u | -c] [-k <numLines> | -q <queries>] [-i <sortedFile>]\n"
+			"    [-x <indexFile>] [-C] [-U] [-o <outputFile> [-N <numParts>]]\n"
+			"    [-L] [-P | -l | -V] [-S] [-F] <numThreads | auto> <fileName>\n"
+			"%s -b <batchFile> <numThreads>\n"
+			"%s -m [-o <outputFile>] <numThreads> <sortedFile>...\n"
+			"  -u  print each distinct line once\n"
+			"  -c  print each distinct line once, prefixed by its count\n"
+			"  -k  print only the first numLines lines of sorted order\n"
+			"  -q  print only the lines at the given comma-separated\n"
+			"      ranks and percentiles, e.g. 1,100,p50,p99,p999\n"
+			"  -i  merge the sorted lines into the already-sorted sortedFile\n"
+			"  -x  write a binary index of the sorted output to indexFile\n"
+			"      for fast lookups with sortLookup\n"
+			"  -C  index lines with 4 or 5 byte offsets instead of pointers\n"
+			"      to save memory (cannot be combined with other options)\n"
+			"  -U  read and write with io_uring when the kernel supports it\n"
+			"  -o  write the sorted lines to outputFile, in parallel slices\n"
+			"  -b  sort each input file listed in batchFile into the output\n"
+			"      file listed after it, sharing the threads between files\n"
+			"  -m  merge already-sorted files without sorting them again\n"
+			"  -L  sort in the collation order of the locale\n"
+			"  -P  sort with a parallel quicksort instead of merging slices\n"
+			"  -l  merge slices using the common prefixes of neighbouring lines\n"
+			"  -S  publish the progress of the sort for sortStat\n"
+			"  -N  split the output into numParts files of contiguous key\n"
+			"      ranges, listed in outputFile.manifest\n"
+			"  -F  print the first lines as soon as they are sorted\n"
+			"  -V  merge slices by keys of their first bytes, with SIMD\n"
+			"      merge networks when the CPU supports them\n",
+			progName, progName, progName);
+	exit(1);
+}
 
 int main (int argc, char *argv[]) {
 
-	// Exit if file does not open
-  	if (argc != 3) {
-  		fprintf(stderr, "Error: Exactly 2 arguments required:\n%s <numThreads> <fileName>\n",
-  				argv[0]);
-  		exit(1);
-  	}
+	// Parse command-line options
+	int uniqueMode = 0;
+	int countMode = 0;
+	long topK = 0;
+	char **queries = NULL;
+	int numQueries = 0;
+	char *baseFileName = NULL;
+	char *indexFileName = NULL;
+	int compactMode = 0;
+	int ringMode = 0;
+	char *outputFileName = NULL;
+	char *batchFileName = NULL;
+	int mergeMode = 0;
+	int localeMode = 0;
+	int parallelMode = 0;
+	int lcpMode = 0;
+	int statsMode = 0;
+	int numParts = 0;
+	int streamMode = 0;
+	int keyMode = 0;
+	int opt;
+	while ((opt = getopt(argc, argv, "uck:q:i:x:CUo:b:mLPlSN:FV")) != -1) {
+		switch (opt) {
+		case 'u':
+			// Print each distinct line once
+			uniqueMode = 1;
+			break;
+		case 'c':
+			// Print each distinct line once, prefixed by its count
+			uniqueMode = 1;
+			countMode = 1;
+			break;
+		case 'k':
+			// Print only the first topK lines of sorted order
+			topK = atol(optarg);
+			if (topK <= 0) {
+				fprintf(stderr, "Error: -k requires a positive number of lines\n");
+				exit(1);
+			}
+			break;
+		case 'q':
+			// Print only the lines at the given ranks and percentiles
+			numQueries = parseQueries(optarg, &queries);
+			break;
+		case 'i':
+			// Merge the sorted lines into an already-sorted file
+			baseFileName = optarg;
+			break;
+		case 'x':
+			// Write an index of the sorted output for sortLookup
+			indexFileName = optarg;
+			break;
+		case 'C':
+			// Index lines with compact offsets instead of pointers
+			compactMode = 1;
+			break;
+		case 'U':
+			// Read and write with io_uring
+			ringMode = 1;
+			break;
+		case 'o':
+			// Write the sorted lines to a file in parallel
+			outputFileName = optarg;
+			break;
+		case 'b':
+			// Sort each file listed in the batch file
+			batchFileName = optarg;
+			break;
+		case 'm':
+			// Merge already-sorted files
+			mergeMode = 1;
+			break;
+		case 'L':
+			// Sort in the collation order of the locale
+			localeMode = 1;
+			break;
+		case 'P':
+			// Sort with a parallel quicksort
+			parallelMode = 1;
+			break;
+		case 'l':
+			// Merge using the common prefixes of neighbouring lines
+			lcpMode = 1;
+			break;
+		case 'S':
+			// Publish the progress of the sort
+			statsMode = 1;
+			break;
+		case 'N':
+			// Split the output into files of contiguous key ranges
+			numParts = atoi(optarg);
+			if (numParts <= 0 || numParts > 4096) {
+				fprintf(stderr, "Error: -N requires a number of parts from 1 to 4096\n");
+				exit(1);
+			}
+			break;
+		case 'F':
+			// Print the first lines as soon as they are sorted
+			streamMode = 1;
+			break;
+		case 'V':
+			// Merge by keys of the first bytes of the lines
+			keyMode = 1;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
 
-	// Set number of threads
-	int numThreads = atoi(argv[1]);
+	// Exit if -F is combined with an option that does not print all lines
+	// to standard output, or that changes them after they are sorted
+	if (streamMode && (topK > 0 || numQueries > 0 || baseFileName != NULL ||
+			indexFileName != NULL || compactMode || ringMode || outputFileName != NULL ||
+			batchFileName != NULL || mergeMode || localeMode || parallelMode || lcpMode ||
+			statsMode || numParts > 0)) {
+		fprintf(stderr, "Error: -F can only be combined with -u and -c\n");
+		exit(1);
+	}
 
-	// Exit if number of threads is not a power of 2 (max 16)
-	if (numThreads != 1 &&
-		numThreads != 2 &&
-		numThreads != 4 &&
-		numThreads != 8 &&
-		numThreads != 16) {
-			fprintf(stderr, "Error: numThreads must be power of 2 (max 16)\n");
-	  		exit(1);
-		}
+	// Exit if -L is combined with an option that relies on byte order
+	if (localeMode && (baseFileName != NULL || indexFileName != NULL || compactMode ||
+			batchFileName != NULL || mergeMode)) {
+		fprintf(stderr, "Error: -L cannot be combined with -i, -x, -C, -b or -m\n");
+		exit(1);
+	}
+	if (localeMode && setlocale(LC_COLLATE, "") == NULL) {
+		fprintf(stderr, "Error: the locale set in the environment is not available\n");
+		exit(1);
+	}
 
-  	// Open file for reading
-	FILE *inputFile = fopen(argv[2], "r");
+	// Exit if -P is combined with an option that does not fully sort the lines
+	if (parallelMode && (topK > 0 || numQueries > 0 || compactMode ||
+			batchFileName != NULL || mergeMode)) {
+		fprintf(stderr, "Error: -P cannot be combined with -k, -q, -C, -b or -m\n");
+		exit(1);
+	}
 
-  	// Exit if file does not open
-  	if (inputFile == NULL) {
-  		fprintf(stderr, "The file \'%s\' does not exist.\n", argv[2]);
-  		exit(1);
-  	}
+	// Exit if -l is combined with an option that does not merge sorted slices
+	if (lcpMode && (topK > 0 || numQueries > 0 || compactMode ||
+			batchFileName != NULL || mergeMode || parallelMode)) {
+		fprintf(stderr, "Error: -l cannot be combined with -k, -q, -C, -b, -m or -P\n");
+		exit(1);
+	}
 
-	// Create an array to hold lines from the file
-	char **linesArray = malloc(INIT_ARRAY_SZ * sizeof(char*));
+	// Exit if -V is combined with an option that does not merge sorted slices
+	if (keyMode && (topK > 0 || numQueries > 0 || compactMode || batchFileName != NULL ||
+			mergeMode || parallelMode || lcpMode || numParts > 0 || streamMode)) {
+		fprintf(stderr, "Error: -V cannot be combined with -k, -q, -C, -b, -m, -P, -l,"
+				" -N or -F\n");
+		exit(1);
+	}
+	selectNetworkKernel();
+	if (keyMode) {
+		selectMergeKernel();
+		fprintf(stderr, "merge kernel: %s\n", mergeKernelName);
+	}
 
-	// Check for unsuccessful malloc
-	if (linesArray == NULL) {
-		fprintf(stderr, "ERROR: Out of memory!\n");
+	// Exit if -S is combined with a mode that does not report its progress
+	if (statsMode && (compactMode || batchFileName != NULL || mergeMode)) {
+		fprintf(stderr, "Error: -S cannot be combined with -C, -b or -m\n");
 		exit(1);
 	}
 
-  	// Declare variables for our file-reading loop
-  	int arrayLen = INIT_ARRAY_SZ;
-  	char *buf = NULL;
-  	size_t bufLen = 0;
-  	int lineIndex = 0;
+	// Exit if -N is not given an output file, or is combined with
+	// an option that does not write all lines in byte order
+	if (numParts > 0 && outputFileName == NULL) {
+		fprintf(stderr, "Error: -N requires -o\n");
+		exit(1);
+	}
+	if (numParts > 0 && (topK > 0 || numQueries > 0 || baseFileName != NULL ||
+			indexFileName != NULL || compactMode || ringMode || batchFileName != NULL ||
+			mergeMode || localeMode || parallelMode || lcpMode)) {
+		fprintf(stderr, "Error: -N cannot be combined with -k, -q, -i, -x, -C, -U,"
+				" -b, -m, -L, -P or -l\n");
+		exit(1);
+	}
 
+	// Exit if -m is combined with any option other than -o
+	if (mergeMode && (uniqueMode || topK > 0 || numQueries > 0 ||
+			baseFileName != NULL || indexFileName != NULL || compactMode ||
+			ringMode || batchFileName != NULL)) {
+		fprintf(stderr, "Error: -m can only be combined with -o\n");
+		exit(1);
+	}
 
-	/* Read all lines from the file into an
-	 * array of strings, extending the array as needed*/
-  	while (getline(&buf, &bufLen, inputFile) != EOF) {
+	// Exit if -b is combined with any other option
+	if (batchFileName != NULL && (uniqueMode || topK > 0 || numQueries > 0 ||
+			baseFileName != NULL || indexFileName != NULL || compactMode ||
+			ringMode || outputFileName != NULL)) {
+		fprintf(stderr, "Error: -b cannot be combined with other options\n");
+		exit(1);
+	}
 
-  		// If the array is full, resize it
-  		if (lineIndex >= arrayLen) {
-  			int newArrayLen = arrayLen * 2;
-  			linesArray = extendArray(linesArray, arrayLen, newArrayLen);
+	// Exit if -C is combined with any other option
+	if (compactMode && (uniqueMode || topK > 0 || numQueries > 0 ||
+			baseFileName != NULL || indexFileName != NULL || ringMode ||
+			outputFileName != NULL)) {
+		fprintf(stderr, "Error: -C cannot be combined with other options\n");
+		exit(1);
+	}
 
-			// Check for unsuccessful malloc
-  			if (linesArray == NULL) {
-  				fprintf(stderr, "ERROR: Out of memory!\n");
-  				exit(1);
-  			}
+	// Exit if -i is combined with an option that changes the output
+	if (baseFileName != NULL && (uniqueMode || topK > 0 || numQueries > 0)) {
+		fprintf(stderr, "Error: -i cannot be combined with -u, -c, -k or -q\n");
+		exit(1);
+	}
 
-			// Reset array length variable
-  			arrayLen = newArrayLen;
-  		}
+	// Exit if -x is combined with an option that changes the output format
+	if (indexFileName != NULL && (countMode || numQueries > 0 || baseFileName != NULL)) {
+		fprintf(stderr, "Error: -x cannot be combined with -c, -q or -i\n");
+		exit(1);
+	}
 
-  		// Remove final newline characters to standardize lines
-  		int lineLen = strlen(buf);
-  		if (buf[lineLen - 1] == '\n') {
-  			buf[lineLen - 1] = '\0';
-  		}
+	// Exit if -o is combined with an option that prints other output
+	if (outputFileName != NULL && (numQueries > 0 || baseFileName != NULL)) {
+		fprintf(stderr, "Error: -o cannot be combined with -q or -i\n");
+		exit(1);
+	}
 
-		// Add string pointer to the array
-  		linesArray[lineIndex] = buf;
-  		buf = NULL;
-  		lineIndex++;
+	// Exit if the wrong number of arguments is given
+	if (batchFileName != NULL && argc - optind != 1) {
+		fprintf(stderr, "Error: Exactly 1 argument required with -b:\n");
+		usage(argv[0]);
+	}
+	if (mergeMode && argc - optind < 2) {
+		fprintf(stderr, "Error: At least 2 arguments required with -m:\n");
+		usage(argv[0]);
+	}
+  	if (batchFileName == NULL && !mergeMode && argc - optind != 2) {
+  		fprintf(stderr, "Error: Exactly 2 arguments required:\n");
+  		usage(argv[0]);
   	}
 
-	// Cleanup memory from file input
-	free(buf);
-	fclose(inputFile);
+	// Set number of threads, reading with one per processor in auto mode
+	int autoMode = strcmp(argv[optind], "auto") == 0;
+	int numThreads = autoMode ? autoReadThreads() : atoi(argv[optind]);
+
+	// Exit if auto mode is combined with -C, -b or -m
+	if (autoMode && (compactMode || batchFileName != NULL || mergeMode)) {
+		fprintf(stderr, "Error: -C, -b and -m cannot be combined with auto\n");
+		exit(1);
+	}
+
+	// Exit if number of threads is not a power of 2 (max 16)
+	if (numThreads != 1 &&
+		numThreads != 2 &&
+		numThreads != 4 &&
+		numThreads != 8 &&
+		numThreads != 16) {
+			fprintf(stderr, "Error: numThreads must be power of 2 (max 16)\n");
+	  		exit(1);
+		}
+
+	// Merge the sorted files
+	if (mergeMode) {
+		mergeFiles(argv + optind + 1, argc - optind - 1, numThreads, outputFileName);
+		exit(0);
+	}
+
+	// Sort each file of the batch
+	if (batchFileName != NULL) {
+		sortBatch(batchFileName, numThreads);
+		exit(0);
+	}
+
+	// Sort using compact line offsets
+	if (compactMode) {
+		sortCompact(argv[optind + 1], numThreads);
+		exit(0);
+	}
+
+	// Publish the progress of the sort
+	if (statsMode) {
+		statsOpen(numThreads);
+		statsPhase(STATS_PHASE_READ, 0);
+	}
 
-  	// New variale for total lines in array for code clarity
-  	int totalLines = lineIndex;
+	// Read and index all lines from the file, using numThreads
+	// threads to find the line boundaries
+	char *fileBuffer;
+	long fileSize;
+	long totalLines;
+	char **linesArray = readLines(argv[optind + 1], numThreads, ringMode, &fileBuffer,
+									&fileSize, &totalLines, NULL);
+	if (stats != NULL)
+		stats->totalLines = totalLines;
+	statsPhase(STATS_PHASE_SORT, 0);
 
 	/* Keep track of start time for
 	 * sort runtime calculation */
@@ -143,16 +1045,107 @@ int main (int argc, char *argv[]) {
 	int seconds, micros;
 	gettimeofday(&startTime, NULL);
 
+	// Collapse duplicate lines so only distinct lines are sorted
+	struct lineTable table;
+	if (uniqueMode) {
+		long numDistinct = uniqueLines(linesArray, totalLines, &table);
+
+		// Shrink the array to fit the distinct lines
+		linesArray = mremap(linesArray, (totalLines + 1) * sizeof(char*),
+							(numDistinct + 1) * sizeof(char*), 0);
+		if ( linesArray == MAP_FAILED ) {
+	  		fprintf(stderr, "errno is %d\n", errno);
+	  		perror("linesArray is MAP_FAILED ");
+	  		exit(1);
+		}
+		totalLines = numDistinct;
+	}
+
+	// Remember the array length, since only some lines may be printed
+	long arrayLen = totalLines;
+
+	// Replace the lines with their locale sort keys
+	char **keyBlocks = NULL;
+	if (localeMode)
+		keyBlocks = makeSortKeys(linesArray, totalLines, numThreads);
+	int numKeyBlocks = numThreads;
+
+	// Pick the engine, number of threads and cutoff from a sample of the lines
+	struct autoConfig config;
+	config.engine = AUTO_ENGINE_THREADS;
+	if (autoMode) {
+		autoTune(linesArray, totalLines, fileSize, numThreads, parallelMode, &config);
+		numThreads = config.numThreads;
+		insertionCutoff = config.cutoff;
+	}
+
 	// Sort the array
-	if (totalLines >= numThreads) {
+	long *partStarts = NULL;
+	if (numQueries > 0) {
+		// Only select the lines at the queried indexes
+		long *targets = malloc(numQueries * sizeof(long));
+		if (targets == NULL) {
+			fprintf(stderr, "ERROR: Out of memory!\n");
+			exit(1);
+		}
+		long numTargets = 0;
+		int q;
+		for (q = 0; q < numQueries; q++) {
+			long index = queryIndex(queries[q], totalLines);
+			if (index >= 0) {
+				targets[numTargets] = index;
+				numTargets++;
+			}
+		}
+		qsort(targets, numTargets, sizeof(long), compareLongs);
+		multiThreadSelect(linesArray, 0, totalLines - 1, targets, numTargets, numThreads);
+		free(targets);
+	}
+	else if (topK > 0 && topK < totalLines) {
+		// Sort only the first topK lines, moving them to the front
+		if (totalLines >= numThreads)
+			multiThreadTopK(linesArray, totalLines, numThreads, topK);
+		else
+			partialSort(linesArray, 0, totalLines - 1, topK - 1);
+		totalLines = topK;
+	}
+	else if (numParts > 0) {
+		// Sort the array into parts that are merged separately
+		partStarts = malloc((numParts + 1) * sizeof(long));
+		if (partStarts == NULL) {
+			fprintf(stderr, "ERROR: Out of memory!\n");
+			exit(1);
+		}
+		linesArray = multiThreadSortParts(linesArray, totalLines, numThreads,
+											numParts, partStarts);
+	}
+	else if (config.engine == AUTO_ENGINE_NONE) {
+		// The lines are already in order
+	}
+	else if (streamMode) {
+		// Sort and print the lines, the first ones as soon as possible
+		streamSort(linesArray, totalLines, numThreads, countMode ? &table : NULL,
+					&startTime);
+		totalLines = 0;
+	}
+	else if (parallelMode && config.engine == AUTO_ENGINE_THREADS) {
+		// Sort the array using parallel partitioning, without merging
+		parallelQuicksort(linesArray, 0, totalLines - 1, numThreads);
+	}
+	else if (totalLines >= numThreads) {
 		// Sort the array using threaded quicksort
-		linesArray = multiThreadSort(linesArray, totalLines, numThreads);
+		linesArray = multiThreadSort(linesArray, totalLines, numThreads, lcpMode, keyMode);
 	}
 	else {
 		// Sort the array using sequential quicksort
+		statsAttach(0, totalLines);
 	  	quicksort(linesArray, 0, totalLines - 1);
 	}
 
+	// Put the lines back in place of their keys, and free the keys
+	if (localeMode)
+		restoreLines(linesArray, arrayLen, keyBlocks, numKeyBlocks);
+
 	/* Print runtime info to stderr for performance testing */
   	gettimeofday(&endTime, NULL);
   	seconds = endTime.tv_sec  - startTime.tv_sec;
@@ -163,30 +1156,132 @@ int main (int argc, char *argv[]) {
   	}
   	fprintf(stderr, "runtime: %d seconds, %d microseconds\n", seconds, micros);
 
-  	// Print all lines of the array in order,
-	// freeing each line from memory after print
-	int i;
+	// Print page fault counts to stderr for performance testing
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	fprintf(stderr, "page faults: %ld minor, %ld major\n",
+			usage.ru_minflt, usage.ru_majflt);
+
+	// Print the line selected by each query
+	long i;
+	int badQueries = 0;
+	for (i = 0; i < numQueries; i++) {
+		long index = queryIndex(queries[i], totalLines);
+		if (index < 0) {
+			fprintf(stderr, "Error: '%s' is not a valid rank or percentile\n", queries[i]);
+			badQueries++;
+		}
+		else if (countMode)
+			printf("%s\t%7ld %s\n", queries[i], lineCount(&table, linesArray[index]),
+					linesArray[index]);
+		else
+			printf("%s\t%s\n", queries[i], linesArray[index]);
+	}
+	free(queries);
+
+	// Merge the sorted lines into the sorted file
+	if (baseFileName != NULL)
+		mergeWithFile(linesArray, totalLines, baseFileName);
+
+	// Write the index of the lines about to be printed
+	if (indexFileName != NULL)
+		writeIndex(linesArray, totalLines, indexFileName);
+
+  	// Print all lines of the array in order, unless only
+	// the queried lines or the merged lines were asked for
+	if (numQueries > 0 || baseFileName != NULL)
+		totalLines = 0;
+	statsPhase(STATS_PHASE_WRITE, 0);
+	statsAttach(0, totalLines);
+	long bytesWritten = 0;
+	if (numParts > 0) {
+		// Write each part to its own file, and the manifest of the parts
+		writeParts(linesArray, partStarts, numParts, countMode ? &table : NULL,
+					numThreads, outputFileName);
+		free(partStarts);
+		totalLines = 0;
+	}
+	else if (outputFileName != NULL) {
+		// Write slices of the lines to the output file in parallel
+		writeOutputFile(linesArray, totalLines, countMode ? &table : NULL,
+						numThreads, outputFileName);
+		totalLines = 0;
+	}
+	else if (ringMode) {
+		// Copy the lines into large buffers that are written asynchronously
+		struct outputStream out;
+		char countStr[32];
+		outputOpen(&out, 1);
+		for (i = 0; i < totalLines; i++) {
+			long lineLen = strlen(linesArray[i]);
+			if (countMode) {
+				long countLen = sprintf(countStr, "%7ld ", lineCount(&table, linesArray[i]));
+				outputWrite(&out, countStr, countLen);
+				bytesWritten += countLen;
+			}
+			outputWrite(&out, linesArray[i], lineLen);
+			outputWrite(&out, "\n", 1);
+
+			// Publish the progress of the output
+			bytesWritten += lineLen + 1;
+			if (workerStats != NULL && i % STATS_UPDATE_LINES == 0) {
+				workerStats->linesDone = i;
+				workerStats->bytesWritten = bytesWritten;
+			}
+		}
+		outputClose(&out);
+		if (workerStats != NULL) {
+			workerStats->linesDone = totalLines;
+			workerStats->bytesWritten = bytesWritten;
+		}
+		totalLines = 0;
+	}
   	for (i = 0; i < totalLines; i++) {
-  		printf("%s\n", linesArray[i]);
-		free(linesArray[i]);
+		if (countMode)
+			bytesWritten += printf("%7ld %s\n", lineCount(&table, linesArray[i]),
+									linesArray[i]);
+		else
+  			bytesWritten += printf("%s\n", linesArray[i]);
+
+		// Publish the progress of the output
+		if (workerStats != NULL && i % STATS_UPDATE_LINES == 0) {
+			workerStats->linesDone = i;
+			workerStats->bytesWritten = bytesWritten;
+		}
+	}
+	if (workerStats != NULL && totalLines > 0) {
+		workerStats->linesDone = totalLines;
+		workerStats->bytesWritten = bytesWritten;
 	}
 
-	// Free the array of poitners
-	free(linesArray);
+	// unmap the array of poitners and the buffer holding the lines
+	munmap(linesArray, (arrayLen + 1) * sizeof(char*));
+	munmap(fileBuffer, fileSize + 1);
+	if (uniqueMode) {
+		free(table.lines);
+		free(table.counts);
+	}
 
-	exit(0);
+	// Fail if any query selected no line
+	exit(badQueries > 0 ? 1 : 0);
 }
 
 /*
- * char **multiThreadSort(char **linesArray, int totalLines, int numThreads) --
+ * char **multiThreadSort(char **linesArray, long totalLines, int numThreads,
+ *                        int useLcp, int useKeys) --
  * Breaks linesArray indexes (0 - totalLines) into a number of ranges
  * specified by numThreads, then, using quicksort, sorts each of those
  * ranges alphabetically by the string they point to using separate threads.
  * Afterwards, merges those ranges back together using spearate threads
  * until all string poitners (0 - totalLines) are sorted.
+ * If useLcp is set, the merges use lcpMerge(), and the first round
+ * finds the common prefixes of neighbouring lines as it goes.
+ * If useKeys is set, the sorting threads also make the merge key of each
+ * line, and the merges use keyMerge().
  * Returns a pointer to the sorted array.
 */
-char **multiThreadSort(char **linesArray, int totalLines, int numThreads) {
+char **multiThreadSort(char **linesArray, long totalLines, int numThreads,
+						int useLcp, int useKeys) {
 
 	// Sort/merge variables
 	int i, result;
@@ -206,12 +1301,27 @@ char **multiThreadSort(char **linesArray, int totalLines, int numThreads) {
 	pthread_attr_init(&attr);
 	pthread_attr_setscope(&attr, PTHREAD_SCOPE_SYSTEM);
 
+	// Set up the merge key arrays, which the sorting threads fill
+	int64_t *inputKeys = NULL;
+	int64_t *outputKeys = NULL;
+	int64_t *tempKeys;
+	if (useKeys && numThreads > 1) {
+		inputKeys = malloc(totalLines * sizeof(int64_t));
+		outputKeys = malloc(totalLines * sizeof(int64_t));
+		if (inputKeys == NULL || outputKeys == NULL) {
+			fprintf(stderr, "ERROR: Out of memory!\n");
+			exit(1);
+		}
+	}
+
 	// Break up the array and sort each part
 	for (i = 0; i < numThreads; i++) {
 		paramList[i] = malloc(sizeof(struct threadParams));
 		paramList[i]->inputArray = linesArray;
+		paramList[i]->inputKeys = inputKeys;
 		paramList[i]->lower = i * totalLines / numThreads;
 		paramList[i]->upper = (i + 1) * totalLines / numThreads - 1;
+		paramList[i]->worker = i;
 
 		result = pthread_create(&threadID[i], &attr, threadQuicksort,(void *) paramList[i]);
 
@@ -236,12 +1346,26 @@ char **multiThreadSort(char **linesArray, int totalLines, int numThreads) {
 	// Set up auxiliary array for merging and
 	// swapping between two arrays
 	char** inputArray = linesArray;
-	char** outputArray = malloc(totalLines * sizeof(char*));
+	char** outputArray = allocLineArray(totalLines + 1);
 	char** temp;
 
+	// Set up the common prefix arrays, which the first round fills
+	long *inputLcp = NULL;
+	long *outputLcp = NULL;
+	long *tempLcp;
+	if (useLcp && numThreads > 1) {
+		outputLcp = malloc(totalLines * sizeof(long));
+		if (outputLcp == NULL) {
+			fprintf(stderr, "ERROR: Out of memory!\n");
+			exit(1);
+		}
+	}
+
 	// Merge until all strings are sorted
 	int numMerges = numThreads / 2;
+	int mergeLevel = 1;
 	while (numMerges > 0) {
+		statsPhase(STATS_PHASE_MERGE, mergeLevel);
 
 		// Create new threads for merging
 		for (i = 0; i < numMerges; i++) {
@@ -249,9 +1373,16 @@ char **multiThreadSort(char **linesArray, int totalLines, int numThreads) {
 			paramList[i]->inputArray = inputArray;
 			paramList[i]->outputArray = outputArray;
 			paramList[i]->lower = i * totalLines / numMerges;
-			paramList[i]->mid = ((i * totalLines / numMerges) +
-						((i + 1) * totalLines / numMerges)) / 2;
+			// mid must be the boundary between the two ranges
+			// sorted in the previous round, which is not always
+			// the average of lower and upper after rounding
+			paramList[i]->mid = (2 * i + 1) * totalLines / (2 * numMerges);
 			paramList[i]->upper = (i + 1) * totalLines / numMerges - 1;
+			paramList[i]->inputLcp = inputLcp;
+			paramList[i]->outputLcp = outputLcp;
+			paramList[i]->inputKeys = inputKeys;
+			paramList[i]->outputKeys = outputKeys;
+			paramList[i]->worker = i;
 
 			result = pthread_create(&threadID[i], &attr, threadMerge, (void *)paramList[i]);
 
@@ -278,229 +1409,5019 @@ char **multiThreadSort(char **linesArray, int totalLines, int numThreads) {
 		temp = inputArray;
 		inputArray = outputArray;
 		outputArray = temp;
+		tempKeys = inputKeys;
+		inputKeys = outputKeys;
+		outputKeys = tempKeys;
+		tempLcp = inputLcp;
+		inputLcp = outputLcp;
+		outputLcp = tempLcp;
+		if (useLcp && outputLcp == NULL) {
+			outputLcp = malloc(totalLines * sizeof(long));
+			if (outputLcp == NULL) {
+				fprintf(stderr, "ERROR: Out of memory!\n");
+				exit(1);
+			}
+		}
 
 		// Reset number of lerges left
 		numMerges = numMerges / 2;
+		mergeLevel++;
 	}
 
 	// Cleanup memory from merge operations
 	free(paramList);
-	free(outputArray);
+	free(inputLcp);
+	free(outputLcp);
+	free(inputKeys);
+	free(outputKeys);
+	munmap(outputArray, (totalLines + 1) * sizeof(char*));
 
 	// Return the sorted array
 	return inputArray;
 }
 
 /*
- * void *threadQuicksort(void *arg) -- A middleman method
- * for calling quicksort in a separate thread.
- * Sets the arguments for merge() from the struct pointer
- * specified by arg.
+ * char **multiThreadSortParts(char **linesArray, long totalLines, int numThreads,
+ *                             int numParts, long *partStarts) --
+ * Sorts linesArray indexes (0 - totalLines) for the -N mode, which writes
+ * numParts files of contiguous key ranges. Like multiThreadSort(), sorts
+ * numThreads ranges of the array with quicksort using separate threads,
+ * but instead of merging the whole ranges, cuts every range at the same
+ * splitter keys with partBounds(). Each part then gathers its pieces of
+ * every range with gatherParts() and merges them with mergeParts(), so
+ * the parts are merged independently, in parallel.
+ * Sets partStarts[p] to the index of the first line of part p, and
+ * partStarts[numParts] to totalLines.
+ * Returns a pointer to the sorted array.
 */
-void *threadQuicksort(void *arg) {
-	// Cast arg to threadParams*
+char **multiThreadSortParts(char **linesArray, long totalLines, int numThreads,
+							int numParts, long *partStarts) {
+
+	// pthread variable declarations
+	int i, result;
+	pthread_t threadID[numThreads];
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	pthread_attr_setscope(&attr, PTHREAD_SCOPE_SYSTEM);
+
+	// Break up the array and sort each part
+	for (i = 0; i < numThreads; i++) {
+		struct threadParams *params = malloc(sizeof(struct threadParams));
+		if (params == NULL) {
+			fprintf(stderr, "ERROR: Out of memory!\n");
+			exit(1);
+		}
+		params->inputArray = linesArray;
+		params->lower = i * totalLines / numThreads;
+		params->upper = (i + 1) * totalLines / numThreads - 1;
+		params->inputKeys = NULL;
+		params->worker = i;
+
+		result = pthread_create(&threadID[i], &attr, threadQuicksort, (void *) params);
+
+		if (result != 0) {
+			fprintf(stderr, "pthread_create failed, result = %d\n", result);
+			exit(1);
+		}
+	}
+
+	// Wait for all threads to exit
+	for (i = 0; i < numThreads; i++) {
+
+		result = pthread_join(threadID[i], NULL);
+
+		if ( result != 0 ) {
+			fprintf(stderr, "join with worker %ld failed, error = %d\n",
+					(long) threadID[i], result);
+			exit(1);
+		}
+	}
+
+	// Cut each sorted range into the parts, and find where each part starts
+	long *bounds = partBounds(linesArray, totalLines, numThreads, numParts);
+	int s, p;
+	for (p = 0; p <= numParts; p++) {
+		partStarts[p] = 0;
+		for (s = 0; s < numThreads; s++)
+			partStarts[p] += bounds[s * (numParts + 1) + p] - bounds[s * (numParts + 1)];
+	}
+
+	// Set up the parameters shared by the gathering and merging threads
+	char **outputArray = allocLineArray(totalLines + 1);
+	int numWorkers = numThreads < numParts ? numThreads : numParts;
+	struct partParams params[numWorkers];
+	for (i = 0; i < numWorkers; i++) {
+		params[i].inputArray = linesArray;
+		params[i].outputArray = outputArray;
+		params[i].bounds = bounds;
+		params[i].partStarts = partStarts;
+		params[i].numSlices = numThreads;
+		params[i].numParts = numParts;
+		params[i].worker = i;
+		params[i].numWorkers = numWorkers;
+	}
+
+	// Gather the pieces of each part, then merge them, each step using
+	// every thread before the next may overwrite the lines it reads
+	void *(*steps[2])(void*) = { threadGatherParts, threadMergeParts };
+	statsPhase(STATS_PHASE_MERGE, 1);
+	int step;
+	for (step = 0; step < 2; step++) {
+		for (i = 0; i < numWorkers; i++) {
+
+			result = pthread_create(&threadID[i], &attr, steps[step], (void *) &params[i]);
+
+			if (result != 0) {
+				fprintf(stderr, "pthread_create failed, result = %d\n", result);
+				exit(1);
+			}
+		}
+
+		// Wait for all threads to exit
+		for (i = 0; i < numWorkers; i++) {
+
+			result = pthread_join(threadID[i], NULL);
+
+			if ( result != 0 ) {
+				fprintf(stderr, "join with worker %ld failed, error = %d\n",
+						(long) threadID[i], result);
+				exit(1);
+			}
+		}
+	}
+	free(bounds);
+
+	// Every part took the same number of merge rounds, which leave
+	// the lines in outputArray after an even number of them
+	int numRounds = 0;
+	while ((1 << numRounds) < numThreads)
+		numRounds++;
+	if (numRounds % 2 == 1) {
+		munmap(outputArray, (totalLines + 1) * sizeof(char*));
+		return linesArray;
+	}
+	munmap(linesArray, (totalLines + 1) * sizeof(char*));
+	return outputArray;
+}
+
+/*
+ * long *partBounds(char **linesArray, long totalLines, int numSlices, int numParts) --
+ * Precondition: linesArray is made of numSlices sorted ranges, as split
+ * by multiThreadSort().
+ * Chooses numParts - 1 splitter keys from PART_SAMPLES lines per part
+ * spread evenly over each range, so the parts hold about the same number
+ * of lines, and finds where each splitter falls in each range. Lines equal
+ * to a splitter all start the part after it, so the parts do not overlap.
+ * Returns an array holding, for each range s, the numParts + 1 indexes
+ * of linesArray where its parts start and it ends, at s * (numParts + 1).
+*/
+long *partBounds(char **linesArray, long totalLines, int numSlices, int numParts) {
+
+	// Sample lines spread evenly over each range
+	long samplesPerSlice = (long) numParts * PART_SAMPLES;
+	char **samples = malloc(numSlices * samplesPerSlice * sizeof(char*));
+	long *bounds = malloc(numSlices * (numParts + 1) * sizeof(long));
+	if (samples == NULL || bounds == NULL) {
+		fprintf(stderr, "ERROR: Out of memory!\n");
+		exit(1);
+	}
+	long numSamples = 0;
+	long i;
+	int s, p;
+	for (s = 0; s < numSlices; s++) {
+		long lower = s * totalLines / numSlices;
+		long upper = (s + 1) * totalLines / numSlices;
+		for (i = 0; i < samplesPerSlice && lower < upper; i++) {
+			samples[numSamples] = linesArray[lower + i * (upper - lower) / samplesPerSlice];
+			numSamples++;
+		}
+	}
+	qsort(samples, numSamples, sizeof(char*), compareStrs);
+
+	// Find where each splitter falls in each range
+	for (s = 0; s < numSlices; s++) {
+		long *sliceBounds = bounds + s * (numParts + 1);
+		long lower = s * totalLines / numSlices;
+		long upper = (s + 1) * totalLines / numSlices;
+		sliceBounds[0] = lower;
+		for (p = 1; p < numParts; p++) {
+			if (numSamples == 0)
+				sliceBounds[p] = upper;
+			else
+				sliceBounds[p] = lowerBoundStr(linesArray, sliceBounds[p - 1], upper,
+												samples[p * numSamples / numParts]);
+		}
+		sliceBounds[numParts] = upper;
+	}
+
+	free(samples);
+	return bounds;
+}
+
+/*
+ * long lowerBoundStr(char **strArray, long lower, long upper, char *key) --
+ * Precondition: the elements lower to upper-1 of strArray are sorted.
+ * Using a binary search, returns the index of the first of them
+ * that is not less than key, or upper if there is none.
+*/
+long lowerBoundStr(char **strArray, long lower, long upper, char *key) {
+	while (lower < upper) {
+		long mid = lower + (upper - lower) / 2;
+		if (strcmp(strArray[mid], key) < 0)
+			lower = mid + 1;
+		else
+			upper = mid;
+	}
+	return lower;
+}
+
+/*
+ * void *threadGatherParts(void *arg) -- A middleman method
+ * for calling gatherParts in a separate thread.
+ * Sets the arguments for gatherParts() from the struct pointer
+ * specified by arg.
+*/
+void *threadGatherParts(void *arg) {
+	// Call gatherParts() with the given arguments
+	gatherParts((struct partParams*) arg);
+
+	// Exit thread
+	pthread_exit( NULL );
+}
+
+/*
+ * void *threadMergeParts(void *arg) -- A middleman method
+ * for calling mergeParts in a separate thread.
+ * Sets the arguments for mergeParts() from the struct pointer
+ * specified by arg.
+*/
+void *threadMergeParts(void *arg) {
+	// Call mergeParts() with the given arguments
+	mergeParts((struct partParams*) arg);
+
+	// Exit thread
+	pthread_exit( NULL );
+}
+
+/*
+ * void gatherParts(struct partParams *params) --
+ * Copies the pieces of each part handled by the worker from every sorted
+ * range of inputArray to the part's place in outputArray, one after another
+ * in the order of the ranges.
+*/
+void gatherParts(struct partParams *params) {
+	int numParts = params->numParts;
+	int s, p;
+	for (p = params->worker; p < numParts; p += params->numWorkers) {
+		long pos = params->partStarts[p];
+		for (s = 0; s < params->numSlices; s++) {
+			long *sliceBounds = params->bounds + s * (numParts + 1);
+			long len = sliceBounds[p + 1] - sliceBounds[p];
+			memcpy(params->outputArray + pos, params->inputArray + sliceBounds[p],
+					len * sizeof(char*));
+			pos += len;
+		}
+	}
+}
+
+/*
+ * void mergeParts(struct partParams *params) --
+ * Precondition: gatherParts() has run for every part.
+ * Merges the sorted pieces of each part handled by the worker in rounds,
+ * like multiThreadSort(), merging pairs of pieces from outputArray into
+ * inputArray and back. The part's place in inputArray is free to merge
+ * into once every part has been gathered.
+*/
+void mergeParts(struct partParams *params) {
+	int numParts = params->numParts;
+	int numSlices = params->numSlices;
+	long pieceStarts[numSlices + 1];
+	int s, p, width;
+	for (p = params->worker; p < numParts; p += params->numWorkers) {
+
+		// Find where the piece from each range starts in the part
+		pieceStarts[0] = params->partStarts[p];
+		for (s = 0; s < numSlices; s++) {
+			long *sliceBounds = params->bounds + s * (numParts + 1);
+			pieceStarts[s + 1] = pieceStarts[s] + sliceBounds[p + 1] - sliceBounds[p];
+		}
+		statsAttach(params->worker, pieceStarts[numSlices] - pieceStarts[0]);
+
+		// Merge pairs of pieces until the part is sorted
+		char **inputArray = params->outputArray;
+		char **outputArray = params->inputArray;
+		char **temp;
+		for (width = 1; width < numSlices; width *= 2) {
+			for (s = 0; s < numSlices; s += 2 * width)
+				merge(inputArray, outputArray, pieceStarts[s], pieceStarts[s + width],
+						pieceStarts[s + 2 * width] - 1);
+
+			// Swap input and output array pointers
+			temp = inputArray;
+			inputArray = outputArray;
+			outputArray = temp;
+		}
+	}
+}
+
+/*
+ * void writeParts(char **linesArray, long *partStarts, int numParts,
+ *                 struct lineTable *table, int numThreads, char *fileName) --
+ * Writes each of the numParts parts of the sorted linesArray, which start
+ * at the indexes in partStarts, to its own file fileName.<part>, using
+ * numThreads threads that each write whole parts. Then writes the manifest
+ * fileName.manifest, with one line per part: the name of its file, its
+ * number of lines and bytes, and its first line, which is the boundary
+ * key between it and the part before.
+ * If table is not NULL, each line is prefixed with its count as in -c.
+*/
+void writeParts(char **linesArray, long *partStarts, int numParts,
+				struct lineTable *table, int numThreads, char *fileName) {
+
+	// pthread variable declarations
+	int i, result;
+	int numWorkers = numThreads < numParts ? numThreads : numParts;
+	long partBytes[numParts];
+	struct partParams params[numWorkers];
+	pthread_t threadID[numWorkers];
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	pthread_attr_setscope(&attr, PTHREAD_SCOPE_SYSTEM);
+
+	// Write the parts, each thread taking every numWorkers'th part
+	for (i = 0; i < numWorkers; i++) {
+		params[i].outputArray = linesArray;
+		params[i].partStarts = partStarts;
+		params[i].partBytes = partBytes;
+		params[i].table = table;
+		params[i].fileName = fileName;
+		params[i].numParts = numParts;
+		params[i].worker = i;
+		params[i].numWorkers = numWorkers;
+
+		result = pthread_create(&threadID[i], &attr, threadWritePart, (void *) &params[i]);
+
+		if (result != 0) {
+			fprintf(stderr, "pthread_create failed, result = %d\n", result);
+			exit(1);
+		}
+	}
+
+	// Wait for all threads to exit
+	for (i = 0; i < numWorkers; i++) {
+
+		result = pthread_join(threadID[i], NULL);
+
+		if ( result != 0 ) {
+			fprintf(stderr, "join with worker %ld failed, error = %d\n",
+					(long) threadID[i], result);
+			exit(1);
+		}
+	}
+
+	// Write the manifest of the parts
+	char manifestName[strlen(fileName) + 16];
+	sprintf(manifestName, "%s.manifest", fileName);
+	FILE *manifest = fopen(manifestName, "w");
+	if (manifest == NULL) {
+		fprintf(stderr, "The file \'%s\' could not be opened for writing.\n", manifestName);
+		exit(1);
+	}
+	for (i = 0; i < numParts; i++) {
+		fprintf(manifest, "%s.%04d\t%ld\t%ld\t%s\n", fileName, i,
+				partStarts[i + 1] - partStarts[i], partBytes[i],
+				partStarts[i] < partStarts[i + 1] ? linesArray[partStarts[i]] : "");
+	}
+	if (fclose(manifest) != 0) {
+		perror("fclose");
+		exit(1);
+	}
+}
+
+/*
+ * void *threadWritePart(void *arg) -- A middleman method
+ * for calling writePart in a separate thread for each part
+ * handled by the worker.
+ * Sets the arguments for writePart() from the struct pointer
+ * specified by arg, and stores the size of each part in partBytes.
+*/
+void *threadWritePart(void *arg) {
+	// Cast arg to partParams*
+	struct partParams *params = (struct partParams*) arg;
+
+	// Call writePart() for each part of the worker
+	int p;
+	for (p = params->worker; p < params->numParts; p += params->numWorkers) {
+		statsAttach(params->worker, params->partStarts[p + 1] - params->partStarts[p]);
+		params->partBytes[p] = writePart(params->outputArray, params->partStarts[p],
+										params->partStarts[p + 1], params->table,
+										params->fileName, p);
+	}
+
+	// Exit thread
+	pthread_exit( NULL );
+}
+
+/*
+ * long writePart(char **linesArray, long lower, long upper,
+ *                struct lineTable *table, char *fileName, int part) --
+ * Writes the lines in linesArray indexes lower to upper-1 (inclusive)
+ * to the file fileName.<part>, as writeSlice() does.
+ * Returns the number of bytes written.
+*/
+long writePart(char **linesArray, long lower, long upper,
+				struct lineTable *table, char *fileName, int part) {
+
+	// Open the file of the part for writing
+	char partName[strlen(fileName) + 16];
+	sprintf(partName, "%s.%04d", fileName, part);
+	int fd = open(partName, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		fprintf(stderr, "The file \'%s\' could not be opened for writing.\n", partName);
+		exit(1);
+	}
+
+	writeSlice(linesArray, lower, upper, table, fd, 0);
+
+	// The end of the file is the number of bytes written
+	long numBytes = lseek(fd, 0, SEEK_END);
+	close(fd);
+	return numBytes;
+}
+
+/*
+ * void streamSort(char **linesArray, long totalLines, int numThreads,
+ *                 struct lineTable *table, struct timeval *startTime) --
+ * Sorts and prints linesArray indexes (0 - totalLines) for the -F mode,
+ * printing the smallest lines long before the rest are sorted.
+ * The calling thread runs a lazy quicksort: it only partitions the
+ * leftmost range of the array that is not sorted yet, leaving the range
+ * after each pivot for later, until the leftmost range is small enough
+ * to sort whole, then prints it and moves on to the next range.
+ * Meanwhile, numThreads - 1 helper threads take the rightmost ranges
+ * left for later and partition or sort them in the same way, so they
+ * are often sorted by the time the calling thread reaches them.
+ * Prints the time from startTime to the first line printed to stderr.
+ * If table is not NULL, each line is prefixed with its count as in -c.
+*/
+void streamSort(char **linesArray, long totalLines, int numThreads,
+				struct lineTable *table, struct timeval *startTime) {
+	if (totalLines == 0)
+		return;
+
+	// Start with the whole array as a single range left to sort
+	struct streamList list;
+	list.linesArray = linesArray;
+	list.head = newStreamRange(0, totalLines - 1, STREAM_UNSORTED);
+	list.tail = list.head;
+	list.done = 0;
+	pthread_mutex_init(&list.lock, NULL);
+	pthread_cond_init(&list.changed, NULL);
+
+	// pthread variable declarations
+	int i, result;
+	pthread_t threadID[numThreads];
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	pthread_attr_setscope(&attr, PTHREAD_SCOPE_SYSTEM);
+
+	// Start the helpers
+	for (i = 0; i < numThreads - 1; i++) {
+
+		result = pthread_create(&threadID[i], &attr, threadStreamHelper, (void *) &list);
+
+		if (result != 0) {
+			fprintf(stderr, "pthread_create failed, result = %d\n", result);
+			exit(1);
+		}
+	}
+
+	// Sort and print the leftmost range until none are left
+	int printedFirst = 0;
+	pthread_mutex_lock(&list.lock);
+	while (list.head != NULL) {
+		struct streamRange *range = list.head;
+		if (range->state == STREAM_SORTED) {
+			// Print the range, which no other thread uses any more
+			list.head = range->next;
+			if (list.head == NULL)
+				list.tail = NULL;
+			else
+				list.head->prev = NULL;
+			pthread_mutex_unlock(&list.lock);
+
+			long j;
+			for (j = range->lower; j <= range->upper; j++) {
+				if (table != NULL)
+					printf("%7ld %s\n", lineCount(table, linesArray[j]), linesArray[j]);
+				else
+					printf("%s\n", linesArray[j]);
+			}
+			fflush(stdout);
+			free(range);
+
+			// Print the time to the first line for performance testing
+			if (!printedFirst) {
+				printedFirst = 1;
+				struct timeval firstTime;
+				gettimeofday(&firstTime, NULL);
+				int seconds = firstTime.tv_sec - startTime->tv_sec;
+				int micros = firstTime.tv_usec - startTime->tv_usec;
+				if (firstTime.tv_usec < startTime->tv_usec) {
+					micros += 1000000;
+					seconds--;
+				}
+				fprintf(stderr, "first line: %d seconds, %d microseconds\n", seconds, micros);
+			}
+			pthread_mutex_lock(&list.lock);
+		}
+		else if (range->state == STREAM_UNSORTED) {
+			// Partition or sort the range in this thread
+			range->state = STREAM_SORTING;
+			pthread_mutex_unlock(&list.lock);
+			sortStreamRange(&list, range);
+			pthread_mutex_lock(&list.lock);
+		}
+		else {
+			// Wait for the helper sorting the range
+			pthread_cond_wait(&list.changed, &list.lock);
+		}
+	}
+
+	// Let the helpers know every range is printed
+	list.done = 1;
+	pthread_cond_broadcast(&list.changed);
+	pthread_mutex_unlock(&list.lock);
+
+	// Wait for all threads to exit
+	for (i = 0; i < numThreads - 1; i++) {
+
+		result = pthread_join(threadID[i], NULL);
+
+		if ( result != 0 ) {
+			fprintf(stderr, "join with worker %ld failed, error = %d\n",
+					(long) threadID[i], result);
+			exit(1);
+		}
+	}
+	pthread_mutex_destroy(&list.lock);
+	pthread_cond_destroy(&list.changed);
+}
+
+/*
+ * void *threadStreamHelper(void *arg) -- A middleman method
+ * for calling streamHelper in a separate thread.
+ * Sets the arguments for streamHelper() from the struct pointer
+ * specified by arg.
+*/
+void *threadStreamHelper(void *arg) {
+	// Call streamHelper() with the given arguments
+	streamHelper((struct streamList*) arg);
+
+	// Exit thread
+	pthread_exit( NULL );
+}
+
+/*
+ * void streamHelper(struct streamList *list) --
+ * Runs one helper of the -F mode: takes the rightmost range of list
+ * that is left to sort, which is the one the printing thread will reach
+ * last, and partitions or sorts it with sortStreamRange(), until every
+ * range is printed.
+*/
+void streamHelper(struct streamList *list) {
+	pthread_mutex_lock(&list->lock);
+	while (!list->done) {
+		// Find the rightmost range left to sort
+		struct streamRange *range = list->tail;
+		while (range != NULL && range->state != STREAM_UNSORTED)
+			range = range->prev;
+
+		if (range == NULL) {
+			// Wait for a partition to leave more ranges
+			pthread_cond_wait(&list->changed, &list->lock);
+			continue;
+		}
+		range->state = STREAM_SORTING;
+		pthread_mutex_unlock(&list->lock);
+		sortStreamRange(list, range);
+		pthread_mutex_lock(&list->lock);
+	}
+	pthread_mutex_unlock(&list->lock);
+}
+
+/*
+ * void sortStreamRange(struct streamList *list, struct streamRange *range) --
+ * Precondition: range is in list, in the STREAM_SORTING state, so no
+ * other thread uses its lines, and the lock of list is not held.
+ * Sorts the lines of range with quicksort() if there are at most
+ * STREAM_LEAF_LINES of them. Otherwise partitions them, and replaces
+ * range in list with the range before the pivot, the pivot and the
+ * range after it, the first and last left to sort.
+*/
+void sortStreamRange(struct streamList *list, struct streamRange *range) {
+	if (range->upper - range->lower < STREAM_LEAF_LINES) {
+		quicksort(list->linesArray, range->lower, range->upper);
+
+		pthread_mutex_lock(&list->lock);
+		range->state = STREAM_SORTED;
+		pthread_cond_broadcast(&list->changed);
+		pthread_mutex_unlock(&list->lock);
+		return;
+	}
+
+	long pivot = partition(list->linesArray, range->lower, range->upper);
+	struct streamRange *pivotRange = newStreamRange(pivot, pivot, STREAM_SORTED);
+	struct streamRange *upperRange = newStreamRange(pivot + 1, range->upper, STREAM_UNSORTED);
+
+	// The range before the pivot takes the place of range,
+	// followed by the pivot and the range after it
+	pthread_mutex_lock(&list->lock);
+	range->upper = pivot - 1;
+	range->state = STREAM_UNSORTED;
+	upperRange->next = range->next;
+	if (range->next == NULL)
+		list->tail = upperRange;
+	else
+		range->next->prev = upperRange;
+	upperRange->prev = pivotRange;
+	pivotRange->next = upperRange;
+	pivotRange->prev = range;
+	range->next = pivotRange;
+	pthread_cond_broadcast(&list->changed);
+	pthread_mutex_unlock(&list->lock);
+}
+
+/*
+ * struct streamRange *newStreamRange(long lower, long upper, int state) --
+ * Returns a new range of lines lower to upper (inclusive) in the given
+ * STREAM state, not linked into any list.
+*/
+struct streamRange *newStreamRange(long lower, long upper, int state) {
+	struct streamRange *range = malloc(sizeof(struct streamRange));
+	if (range == NULL) {
+		fprintf(stderr, "ERROR: Out of memory!\n");
+		exit(1);
+	}
+	range->lower = lower;
+	range->upper = upper;
+	range->state = state;
+	range->prev = NULL;
+	range->next = NULL;
+	return range;
+}
+
+/*
+ * void multiThreadTopK(char **linesArray, long totalLines, int numThreads, long topK) --
+ * Breaks linesArray indexes (0 - totalLines) into a number of ranges
+ * specified by numThreads, then, using partialSort(), finds and sorts the
+ * smallest topK lines of each range using separate threads.
+ * Afterwards, merges the sorted lines of each range together, keeping only
+ * the smallest topK, and moves them to indexes 0 - topK-1 of linesArray.
+ * The order of the remaining lines of linesArray is undefined.
+*/
+void multiThreadTopK(char **linesArray, long totalLines, int numThreads, long topK) {
+
+	// Sort/merge variables
+	int i, result;
+	long lower[numThreads];
+	long last[numThreads];
+	struct threadParams *params;
+
+	// pthread variable declarations
+	pthread_t threadID[numThreads];
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	pthread_attr_setscope(&attr, PTHREAD_SCOPE_SYSTEM);
+
+	// Break up the array and sort the smallest lines of each part
+	for (i = 0; i < numThreads; i++) {
+		lower[i] = i * totalLines / numThreads;
+		long upper = (i + 1) * totalLines / numThreads - 1;
+		last[i] = lower[i] + topK - 1;
+		if (last[i] > upper)
+			last[i] = upper;
+
+		params = malloc(sizeof(struct threadParams));
+		if (params == NULL) {
+			fprintf(stderr, "ERROR: Out of memory!\n");
+			exit(1);
+		}
+		params->inputArray = linesArray;
+		params->lower = lower[i];
+		params->mid = last[i];
+		params->upper = upper;
+
+		result = pthread_create(&threadID[i], &attr, threadPartialSort, (void *) params);
+
+		if (result != 0) {
+			fprintf(stderr, "pthread_create failed, result = %d\n", result);
+			exit(1);
+		}
+	}
+
+	// Wait for all threads to exit
+	for (i = 0; i < numThreads; i++) {
+
+		result = pthread_join(threadID[i], NULL);
+
+		if ( result != 0 ) {
+			fprintf(stderr, "join with worker %ld failed, error = %d\n",
+					(long) threadID[i], result);
+			exit(1);
+		}
+	}
+
+	// Set up two arrays big enough to merge the top lines
+	// found so far with the top lines of one more part
+	char **inputArray = malloc(2 * topK * sizeof(char*));
+	char **outputArray = malloc(2 * topK * sizeof(char*));
+	char **temp;
+	if (inputArray == NULL || outputArray == NULL) {
+		fprintf(stderr, "ERROR: Out of memory!\n");
+		exit(1);
+	}
+
+	// Start with the top lines of the first part
+	long mergedLen = last[0] - lower[0] + 1;
+	memcpy(inputArray, linesArray + lower[0], mergedLen * sizeof(char*));
+
+	// Merge in the top lines of each other part, keeping at most topK
+	for (i = 1; i < numThreads; i++) {
+		long partLen = last[i] - lower[i] + 1;
+		memcpy(inputArray + mergedLen, linesArray + lower[i], partLen * sizeof(char*));
+		merge(inputArray, outputArray, 0, mergedLen, mergedLen + partLen - 1);
+
+		mergedLen += partLen;
+		if (mergedLen > topK)
+			mergedLen = topK;
+
+		// Swap input and output array pointers
+		temp = inputArray;
+		inputArray = outputArray;
+		outputArray = temp;
+	}
+
+	// Move the top lines to the front of the array
+	memcpy(linesArray, inputArray, mergedLen * sizeof(char*));
+
+	// Cleanup memory from merge operations
+	free(inputArray);
+	free(outputArray);
+}
+
+/*
+ * void multiThreadSelect(char **strArray, long lower, long upper,
+ *                        long *targets, long numTargets, int numThreads) --
+ * Precondition: targets holds numTargets indexes between lower and upper
+ * in increasing order.
+ * Like multiSelect(), places the element that belongs at each index in
+ * targets, using up to numThreads threads. Whenever a partition leaves
+ * targets on both sides of the pivot, the side before the pivot is given
+ * to a new thread along with half of the remaining threads.
+*/
+void multiThreadSelect(char **strArray, long lower, long upper,
+						long *targets, long numTargets, int numThreads) {
+
+	// Threads created by this call (at most one per halving of numThreads)
+	pthread_t threadID[32];
+	int numCreated = 0;
+	int i, result;
+	struct selectParams *params;
+
+	// pthread variable declarations
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	pthread_attr_setscope(&attr, PTHREAD_SCOPE_SYSTEM);
+
+	while (numTargets > 0 && lower < upper) {
+
+		// Finish sequentially once there are no spare threads
+		if (numThreads <= 1) {
+			multiSelect(strArray, lower, upper, targets, numTargets);
+			break;
+		}
+
+		// Partition range
+		long pivot = partition(strArray, lower, upper);
+
+		// Split the targets into those before and after the pivot
+		long numBefore = 0;
+		while (numBefore < numTargets && targets[numBefore] < pivot)
+			numBefore++;
+		long numDone = numBefore;
+		while (numDone < numTargets && targets[numDone] == pivot)
+			numDone++;
+
+		// Select the targets before the pivot in a new thread
+		// if there are also targets after the pivot
+		if (numBefore > 0 && numDone < numTargets) {
+			params = malloc(sizeof(struct selectParams));
+			if (params == NULL) {
+				fprintf(stderr, "ERROR: Out of memory!\n");
+				exit(1);
+			}
+			params->strArray = strArray;
+			params->lower = lower;
+			params->upper = pivot - 1;
+			params->targets = targets;
+			params->numTargets = numBefore;
+			params->numThreads = numThreads / 2;
+
+			result = pthread_create(&threadID[numCreated], &attr, threadMultiSelect, (void *) params);
+
+			if (result != 0) {
+				fprintf(stderr, "pthread_create failed, result = %d\n", result);
+				exit(1);
+			}
+			numCreated++;
+			numThreads -= numThreads / 2;
+		}
+		else {
+			multiSelect(strArray, lower, pivot - 1, targets, numBefore);
+		}
+
+		// Continue with the targets after the pivot
+		targets += numDone;
+		numTargets -= numDone;
+		lower = pivot + 1;
+	}
+
+	// Wait for all threads to exit
+	for (i = 0; i < numCreated; i++) {
+
+		result = pthread_join(threadID[i], NULL);
+
+		if ( result != 0 ) {
+			fprintf(stderr, "join with worker %ld failed, error = %d\n",
+					(long) threadID[i], result);
+			exit(1);
+		}
+	}
+}
+
+/*
+ * void *threadMultiSelect(void *arg) -- A middleman method
+ * for calling multiThreadSelect in a separate thread.
+ * Sets the arguments for multiThreadSelect() from the struct pointer
+ * specified by arg.
+*/
+void *threadMultiSelect(void *arg) {
+	// Cast arg to selectParams*
+	struct selectParams *params = (struct selectParams*) arg;
+
+	// Call multiThreadSelect() with the given arguments
+	multiThreadSelect(params->strArray, params->lower, params->upper,
+			params->targets, params->numTargets, params->numThreads);
+
+	// Free params from memory
+	free(params);
+
+	// Exit thread
+	pthread_exit( NULL );
+}
+
+/*
+ * void *threadQuicksort(void *arg) -- A middleman method
+ * for calling quicksort in a separate thread.
+ * Sets the arguments for merge() from the struct pointer
+ * specified by arg.
+*/
+void *threadQuicksort(void *arg) {
+	// Cast arg to threadParams*
+	struct threadParams *params = (struct threadParams*) arg;
+
+	// Call quicksort() with the given arguments
+	statsAttach(params->worker, params->upper - params->lower + 1);
+	quicksort(params->inputArray, params->lower, params->upper);
+
+	// Make the merge keys of the sorted lines
+	long i;
+	if (params->inputKeys != NULL) {
+		for (i = params->lower; i <= params->upper; i++)
+			params->inputKeys[i] = mergeKey(params->inputArray[i]);
+	}
+
+	// Free params from memory
+	free(params);
+
+	// Exit thread
+	pthread_exit( NULL );
+}
+
+/*
+ * void *threadPartialSort(void *arg) -- A middleman method
+ * for calling partialSort in a separate thread.
+ * Sets the arguments for partialSort() from the struct pointer
+ * specified by arg.
+*/
+void *threadPartialSort(void *arg) {
+	// Cast arg to threadParams*
+	struct threadParams *params = (struct threadParams*) arg;
+
+	// Call partialSort() with the given arguments
+	partialSort(params->inputArray, params->lower, params->upper, params->mid);
+
+	// Free params from memory
+	free(params);
+
+	// Exit thread
+	pthread_exit( NULL );
+}
+
+/*
+ * void *threadMerge(void *arg) -- A middleman method
+ * for calling merge in a separate thread.
+ * Sets the arguments for merge() from the struct pointer
+ * specified by arg.
+*/
+void *threadMerge(void *arg) {
+	// Cast arg to threadParams*
+	struct threadParams *params = (struct threadParams*) arg;
+
+	// Call merge(), lcpMerge() or keyMerge() with the given arguments
+	statsAttach(params->worker, params->upper - params->lower + 1);
+	if (params->outputKeys != NULL)
+		keyMerge(params->inputKeys, params->outputKeys, params->inputArray,
+				params->outputArray, params->lower, params->mid, params->upper);
+	else if (params->outputLcp != NULL)
+		lcpMerge(params->inputArray, params->outputArray, params->inputLcp,
+				params->outputLcp, params->lower, params->mid, params->upper);
+	else
+		merge(params->inputArray, params->outputArray, params->lower, params->mid, params->upper);
+
+	// Free params from memory
+	free(params);
+
+	// Exit thread
+	pthread_exit( NULL );
+}
+
+/* void merge(char **inputArray, char **outputArray, long lower, long mid, long upper) --
+ * Precondition: The stirng pointers in the index ranges lower to mid-1 (inclusive)
+ * are sorted relative to each other in inputArray,
+ * and the stirng pointers in the index ranges mid to upper (inclusive)
+ * are sorted relative to each other in inputArray.
+ *
+ * This method copies all pointers in sorted order from each range in inputArray
+ * to the index range lower to upper (inclusive) in outputArray.
+*/
+void merge(char **inputArray, char **outputArray, long lower, long mid, long upper) {
+
+	// Set up loop variables
+	long i = lower;
+	long j = mid;
+	long k;
+
+	// Merge values
+	for (k = lower; k <= upper; k++) {
+		if (workerStats != NULL && (k - lower) % STATS_UPDATE_LINES == 0)
+			workerStats->linesDone = k - lower;
+		if (i < mid && j <= upper) {
+			if (strcmp(inputArray[i], inputArray[j]) <= 0) {
+				outputArray[k] = inputArray[i];
+				i++;
+			}
+			else {
+				outputArray[k] = inputArray[j];
+				j++;
+			}
+		}
+		else if (i >= mid) {
+			outputArray[k] = inputArray[j];
+			j++;
+		}
+		else {
+			outputArray[k] = inputArray[i];
+			i++;
+		}
+  	}
+}
+
+/* void lcpMerge(char **inputArray, char **outputArray, long *inputLcp,
+ *               long *outputLcp, long lower, long mid, long upper) --
+ * Precondition: as for merge(), and inputLcp[i] holds the length of the
+ * longest common prefix of inputArray[i-1] and inputArray[i] for every
+ * index i in either range except the first of each. If inputLcp is NULL,
+ * those prefixes are found as each line is reached instead.
+ *
+ * Merges the two ranges like merge(), but keeps the common prefix of each
+ * range's next line with the last line copied. The line sharing the longer
+ * prefix is the smaller one, and lines sharing the same prefix are only
+ * compared from where they may differ, so long shared prefixes are not
+ * read again. Fills outputLcp for lower to upper in the same way.
+*/
+void lcpMerge(char **inputArray, char **outputArray, long *inputLcp,
+				long *outputLcp, long lower, long mid, long upper) {
+
+	// Set up loop variables
+	long i = lower;
+	long j = mid;
+	long k;
+
+	// Common prefix of the next line of each range with the last line copied
+	long lcpI = 0;
+	long lcpJ = 0;
+	int takeI;
+
+	// Merge values
+	for (k = lower; k <= upper; k++) {
+		if (workerStats != NULL && (k - lower) % STATS_UPDATE_LINES == 0)
+			workerStats->linesDone = k - lower;
+		if (i < mid && j <= upper) {
+			if (lcpI != lcpJ) {
+				// The line sharing more with the last line is smaller
+				takeI = lcpI > lcpJ;
+			}
+			else {
+				// Compare from the first byte that may differ
+				long lcp = lcpI;
+				takeI = compareFrom(inputArray[i], inputArray[j], &lcp) <= 0;
+				if (takeI)
+					lcpJ = lcp;
+				else
+					lcpI = lcp;
+			}
+		}
+		else {
+			takeI = j > upper;
+		}
+
+		if (takeI) {
+			outputArray[k] = inputArray[i];
+			outputLcp[k] = lcpI;
+			i++;
+			if (i < mid)
+				lcpI = nextLcp(inputArray, inputLcp, i);
+		}
+		else {
+			outputArray[k] = inputArray[j];
+			outputLcp[k] = lcpJ;
+			j++;
+			if (j <= upper)
+				lcpJ = nextLcp(inputArray, inputLcp, j);
+		}
+  	}
+}
+
+/*
+ * long nextLcp(char **strArray, long *lcpArray, long index) --
+ * Returns the length of the longest common prefix of strArray[index-1]
+ * and strArray[index], read from lcpArray, or found by comparing the
+ * lines if lcpArray is NULL.
+*/
+long nextLcp(char **strArray, long *lcpArray, long index) {
+	long lcp = 0;
+	if (lcpArray != NULL)
+		return lcpArray[index];
+	compareFrom(strArray[index - 1], strArray[index], &lcp);
+	return lcp;
+}
+
+/*
+ * int compareFrom(char *strA, char *strB, long *lcp) --
+ * Precondition: strA and strB share their first *lcp bytes.
+ * Compares strA and strB in the same way as strcmp(), starting at
+ * byte *lcp, and sets *lcp to the length of their common prefix.
+ * Equal bytes are skipped 8 at a time while neither read crosses into
+ * another page, so reading past the end of a string never faults.
+*/
+int compareFrom(char *strA, char *strB, long *lcp) {
+	unsigned char *byteA = (unsigned char*) strA + *lcp;
+	unsigned char *byteB = (unsigned char*) strB + *lcp;
+	uint64_t wordA, wordB;
+	while (((uintptr_t) byteA & (MIN_PAGE_SIZE - 1)) <= MIN_PAGE_SIZE - sizeof(uint64_t) &&
+			((uintptr_t) byteB & (MIN_PAGE_SIZE - 1)) <= MIN_PAGE_SIZE - sizeof(uint64_t)) {
+		memcpy(&wordA, byteA, sizeof(uint64_t));
+		memcpy(&wordB, byteB, sizeof(uint64_t));
+
+		// Stop at the word holding the first difference or the end of strA
+		if (wordA != wordB ||
+				((wordA - 0x0101010101010101ULL) & ~wordA & 0x8080808080808080ULL) != 0)
+			break;
+		byteA += sizeof(uint64_t);
+		byteB += sizeof(uint64_t);
+	}
+	while (*byteA != '\0' && *byteA == *byteB) {
+		byteA++;
+		byteB++;
+	}
+	*lcp = byteA - (unsigned char*) strA;
+	return *byteA - *byteB;
+}
+
+/*
+ * void selectMergeKernel() --
+ * Chooses the kernel keyMerge() merges keys with, from the instruction
+ * sets this CPU supports: AVX2, then SSE4.2, then plain C.
+*/
+void selectMergeKernel() {
+	mergeKernel = mergeKeysScalar;
+	mergeKernelName = "scalar";
+#ifdef __x86_64__
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		mergeKernel = mergeKeysAvx2;
+		mergeKernelName = "avx2";
+	}
+	else if (__builtin_cpu_supports("sse4.2")) {
+		mergeKernel = mergeKeysSse;
+		mergeKernelName = "sse4.2";
+	}
+#endif
+}
+
+/*
+ * void selectNetworkKernel() --
+ * Chooses the kernel networkSort() runs its sorting network with:
+ * AVX2 if this CPU supports it, or else plain C.
+*/
+void selectNetworkKernel() {
+	networkKernel = networkScalar;
+#ifdef __x86_64__
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		networkKernel = networkAvx2;
+#endif
+}
+
+/*
+ * int64_t mergeKey(char *line) --
+ * Returns the merge key of line: its first 8 bytes as a big-endian
+ * number, as in prefixKey(), with the sign bit flipped so the keys
+ * order like the lines' first bytes as signed numbers.
+*/
+int64_t mergeKey(char *line) {
+	return (int64_t) (prefixKey(line) ^ 0x8000000000000000ULL);
+}
+
+/*
+ * void keyMerge(int64_t *inputKeys, int64_t *outputKeys, char **inputArray,
+ *               char **outputArray, long lower, long mid, long upper) --
+ * Precondition: as for merge(), and inputKeys holds the merge key of the
+ * line at the same index of inputArray.
+ *
+ * Merges the two ranges like merge(), but with the vector kernel chosen
+ * by selectMergeKernel(), which moves the pointers to the lines along
+ * with their keys and orders them by key alone. Each run of lines with
+ * the same key is then put in order with fixKeyTies(). Fills outputKeys
+ * for lower to upper in the same way.
+*/
+void keyMerge(int64_t *inputKeys, int64_t *outputKeys, char **inputArray,
+				char **outputArray, long lower, long mid, long upper) {
+	mergeKernel(inputKeys + lower, inputArray + lower, mid - lower,
+				inputKeys + mid, inputArray + mid, upper + 1 - mid,
+				outputKeys + lower, outputArray + lower);
+	fixKeyTies(inputKeys, outputKeys, inputArray, outputArray, lower, mid, upper);
+	if (workerStats != NULL)
+		workerStats->linesDone = upper + 1 - lower;
+}
+
+/*
+ * void fixKeyTies(int64_t *inputKeys, int64_t *outputKeys, char **inputArray,
+ *                 char **outputArray, long lower, long mid, long upper) --
+ * Precondition: outputKeys and outputArray hold the keys and lines of
+ * both ranges of inputKeys and inputArray (as for keyMerge()), in order
+ * of their keys.
+ * Each run of lines in outputArray with the same key comes from a run of
+ * lines with that key in either range of inputArray, which are already
+ * in order. Rewrites each such run with those two runs merged by
+ * comparing the lines.
+*/
+void fixKeyTies(int64_t *inputKeys, int64_t *outputKeys, char **inputArray,
+				char **outputArray, long lower, long mid, long upper) {
+	long i = lower;
+	long j = mid;
+	long k = lower;
+	while (k <= upper) {
+		int64_t key = outputKeys[k];
+		long end = k + 1;
+		while (end <= upper && outputKeys[end] == key)
+			end++;
+
+		// A line with a key of its own is already in place
+		if (end == k + 1) {
+			if (i < mid && inputKeys[i] == key)
+				i++;
+			else
+				j++;
+			k = end;
+			continue;
+		}
+
+		// Find the lines with the key in each range, and merge them
+		long firstI = i;
+		long firstJ = j;
+		while (i < mid && inputKeys[i] == key)
+			i++;
+		while (j <= upper && inputKeys[j] == key)
+			j++;
+		long a = firstI;
+		long b = firstJ;
+		for (; k < end; k++) {
+			if (b >= j || (a < i && strcmp(inputArray[a], inputArray[b]) <= 0)) {
+				outputArray[k] = inputArray[a];
+				a++;
+			}
+			else {
+				outputArray[k] = inputArray[b];
+				b++;
+			}
+		}
+	}
+}
+
+/*
+ * void mergeKeysScalar(int64_t *keysA, char **linesA, long numA,
+ *                      int64_t *keysB, char **linesB, long numB,
+ *                      int64_t *outputKeys, char **outputLines) --
+ * Merges the sorted keys keysA and keysB, and the lines along with them,
+ * into outputKeys and outputLines one key at a time, for CPUs without
+ * vector instructions.
+*/
+void mergeKeysScalar(int64_t *keysA, char **linesA, long numA,
+					int64_t *keysB, char **linesB, long numB,
+					int64_t *outputKeys, char **outputLines) {
+	mergeKeysTail(keysA, linesA, numA, keysB, linesB, numB, NULL, NULL, 0,
+					outputKeys, outputLines);
+}
+
+/*
+ * void mergeKeysTail(int64_t *keysA, char **linesA, long numA,
+ *                    int64_t *keysB, char **linesB, long numB,
+ *                    int64_t *extraKeys, char **extraLines, int numExtra,
+ *                    int64_t *outputKeys, char **outputLines) --
+ * Merges the sorted keys keysA, keysB and extraKeys, and the lines along
+ * with them, into outputKeys and outputLines one key at a time. Used to
+ * finish the vector kernels, once either input has less than a vector of
+ * keys left, with the keys still in registers as extraKeys.
+*/
+void mergeKeysTail(int64_t *keysA, char **linesA, long numA,
+					int64_t *keysB, char **linesB, long numB,
+					int64_t *extraKeys, char **extraLines, int numExtra,
+					int64_t *outputKeys, char **outputLines) {
+	long i = 0;
+	long j = 0;
+	int e = 0;
+	while (i < numA || j < numB || e < numExtra) {
+		// Take the smallest of the next key of each input
+		if (i < numA && (j >= numB || keysA[i] <= keysB[j]) &&
+				(e >= numExtra || keysA[i] <= extraKeys[e])) {
+			*outputKeys = keysA[i];
+			*outputLines = linesA[i];
+			i++;
+		}
+		else if (j < numB && (e >= numExtra || keysB[j] <= extraKeys[e])) {
+			*outputKeys = keysB[j];
+			*outputLines = linesB[j];
+			j++;
+		}
+		else {
+			*outputKeys = extraKeys[e];
+			*outputLines = extraLines[e];
+			e++;
+		}
+		outputKeys++;
+		outputLines++;
+	}
+}
+
+#ifdef __x86_64__
+
+/*
+ * void mergeKeysAvx2(int64_t *keysA, char **linesA, long numA,
+ *                    int64_t *keysB, char **linesB, long numB,
+ *                    int64_t *outputKeys, char **outputLines) --
+ * Merges the sorted keys keysA and keysB, and the lines along with them,
+ * four keys at a time without a branch per key. The four largest keys
+ * merged so far are kept in a register and merged with the next four
+ * keys of the input whose next key is smaller, using bitonicMergeAvx2(),
+ * writing out the four smallest. Needs a CPU with AVX2.
+*/
+__attribute__((target("avx2")))
+void mergeKeysAvx2(int64_t *keysA, char **linesA, long numA,
+					int64_t *keysB, char **linesB, long numB,
+					int64_t *outputKeys, char **outputLines) {
+	if (numA < 4 || numB < 4) {
+		mergeKeysTail(keysA, linesA, numA, keysB, linesB, numB, NULL, NULL, 0,
+						outputKeys, outputLines);
+		return;
+	}
+
+	__m256i lowKeys = _mm256_loadu_si256((__m256i*) keysA);
+	__m256i lowLines = _mm256_loadu_si256((__m256i*) linesA);
+	__m256i highKeys = _mm256_loadu_si256((__m256i*) keysB);
+	__m256i highLines = _mm256_loadu_si256((__m256i*) linesB);
+	long i = 4;
+	long j = 4;
+	long k = 0;
+	while (1) {
+		bitonicMergeAvx2(&lowKeys, &highKeys, &lowLines, &highLines);
+		_mm256_storeu_si256((__m256i*) (outputKeys + k), lowKeys);
+		_mm256_storeu_si256((__m256i*) (outputLines + k), lowLines);
+		k += 4;
+
+		// Load the next four keys of the input whose next key is smaller
+		if (i + 4 > numA || j + 4 > numB)
+			break;
+		if (keysA[i] <= keysB[j]) {
+			lowKeys = _mm256_loadu_si256((__m256i*) (keysA + i));
+			lowLines = _mm256_loadu_si256((__m256i*) (linesA + i));
+			i += 4;
+		}
+		else {
+			lowKeys = _mm256_loadu_si256((__m256i*) (keysB + j));
+			lowLines = _mm256_loadu_si256((__m256i*) (linesB + j));
+			j += 4;
+		}
+	}
+
+	// Finish with the keys left in the register and the inputs
+	int64_t extraKeys[4];
+	char *extraLines[4];
+	_mm256_storeu_si256((__m256i*) extraKeys, highKeys);
+	_mm256_storeu_si256((__m256i*) extraLines, highLines);
+	mergeKeysTail(keysA + i, linesA + i, numA - i, keysB + j, linesB + j, numB - j,
+					extraKeys, extraLines, 4, outputKeys + k, outputLines + k);
+}
+
+/*
+ * void bitonicMergeAvx2(__m256i *lowKeys, __m256i *highKeys,
+ *                       __m256i *lowLines, __m256i *highLines) --
+ * Precondition: lowKeys and highKeys each hold four sorted keys, and
+ * lowLines and highLines the pointers to their lines.
+ * Merges them with a bitonic merge network: highKeys is reversed so the
+ * eight keys form a bitonic sequence, and the elementwise minimum and
+ * maximum split it into the four smallest and the four largest keys,
+ * which bitonicSortAvx2() puts in order in lowKeys and highKeys.
+ * The lines are moved with the same masks as their keys.
+*/
+__attribute__((target("avx2")))
+void bitonicMergeAvx2(__m256i *lowKeys, __m256i *highKeys,
+						__m256i *lowLines, __m256i *highLines) {
+	__m256i reversedKeys = _mm256_permute4x64_epi64(*highKeys, 0x1B);
+	__m256i reversedLines = _mm256_permute4x64_epi64(*highLines, 0x1B);
+	__m256i greater = _mm256_cmpgt_epi64(*lowKeys, reversedKeys);
+	__m256i minKeys = _mm256_blendv_epi8(*lowKeys, reversedKeys, greater);
+	__m256i maxKeys = _mm256_blendv_epi8(reversedKeys, *lowKeys, greater);
+	__m256i minLines = _mm256_blendv_epi8(*lowLines, reversedLines, greater);
+	__m256i maxLines = _mm256_blendv_epi8(reversedLines, *lowLines, greater);
+	bitonicSortAvx2(&minKeys, &minLines);
+	bitonicSortAvx2(&maxKeys, &maxLines);
+	*lowKeys = minKeys;
+	*highKeys = maxKeys;
+	*lowLines = minLines;
+	*highLines = maxLines;
+}
+
+/*
+ * void bitonicSortAvx2(__m256i *keys, __m256i *lines) --
+ * Sorts four keys forming a bitonic sequence, and the pointers to their
+ * lines along with them, comparing the keys two apart and then the
+ * neighbouring keys. Each lane takes the key it is compared with if
+ * that key belongs on its side, so equal keys are never duplicated.
+*/
+__attribute__((target("avx2")))
+void bitonicSortAvx2(__m256i *keys, __m256i *lines) {
+	// Compare the keys two apart, keeping the smaller in the lower half
+	__m256i swappedKeys = _mm256_permute4x64_epi64(*keys, 0x4E);
+	__m256i swappedLines = _mm256_permute4x64_epi64(*lines, 0x4E);
+	__m256i takeSwapped = _mm256_blend_epi32(_mm256_cmpgt_epi64(*keys, swappedKeys),
+											_mm256_cmpgt_epi64(swappedKeys, *keys), 0xF0);
+	__m256i sortedKeys = _mm256_blendv_epi8(*keys, swappedKeys, takeSwapped);
+	__m256i sortedLines = _mm256_blendv_epi8(*lines, swappedLines, takeSwapped);
+
+	// Compare the neighbouring keys, keeping the smaller in the even lanes
+	swappedKeys = _mm256_permute4x64_epi64(sortedKeys, 0xB1);
+	swappedLines = _mm256_permute4x64_epi64(sortedLines, 0xB1);
+	takeSwapped = _mm256_blend_epi32(_mm256_cmpgt_epi64(sortedKeys, swappedKeys),
+									_mm256_cmpgt_epi64(swappedKeys, sortedKeys), 0xCC);
+	*keys = _mm256_blendv_epi8(sortedKeys, swappedKeys, takeSwapped);
+	*lines = _mm256_blendv_epi8(sortedLines, swappedLines, takeSwapped);
+}
+
+/*
+ * void mergeKeysSse(int64_t *keysA, char **linesA, long numA,
+ *                   int64_t *keysB, char **linesB, long numB,
+ *                   int64_t *outputKeys, char **outputLines) --
+ * Like mergeKeysAvx2(), merges the sorted keys keysA and keysB and the
+ * lines along with them, but two keys at a time, for CPUs with SSE4.2
+ * but no AVX2.
+*/
+__attribute__((target("sse4.2")))
+void mergeKeysSse(int64_t *keysA, char **linesA, long numA,
+					int64_t *keysB, char **linesB, long numB,
+					int64_t *outputKeys, char **outputLines) {
+	if (numA < 2 || numB < 2) {
+		mergeKeysTail(keysA, linesA, numA, keysB, linesB, numB, NULL, NULL, 0,
+						outputKeys, outputLines);
+		return;
+	}
+
+	__m128i lowKeys = _mm_loadu_si128((__m128i*) keysA);
+	__m128i lowLines = _mm_loadu_si128((__m128i*) linesA);
+	__m128i highKeys = _mm_loadu_si128((__m128i*) keysB);
+	__m128i highLines = _mm_loadu_si128((__m128i*) linesB);
+	long i = 2;
+	long j = 2;
+	long k = 0;
+	while (1) {
+		bitonicMergeSse(&lowKeys, &highKeys, &lowLines, &highLines);
+		_mm_storeu_si128((__m128i*) (outputKeys + k), lowKeys);
+		_mm_storeu_si128((__m128i*) (outputLines + k), lowLines);
+		k += 2;
+
+		// Load the next two keys of the input whose next key is smaller
+		if (i + 2 > numA || j + 2 > numB)
+			break;
+		if (keysA[i] <= keysB[j]) {
+			lowKeys = _mm_loadu_si128((__m128i*) (keysA + i));
+			lowLines = _mm_loadu_si128((__m128i*) (linesA + i));
+			i += 2;
+		}
+		else {
+			lowKeys = _mm_loadu_si128((__m128i*) (keysB + j));
+			lowLines = _mm_loadu_si128((__m128i*) (linesB + j));
+			j += 2;
+		}
+	}
+
+	// Finish with the keys left in the register and the inputs
+	int64_t extraKeys[2];
+	char *extraLines[2];
+	_mm_storeu_si128((__m128i*) extraKeys, highKeys);
+	_mm_storeu_si128((__m128i*) extraLines, highLines);
+	mergeKeysTail(keysA + i, linesA + i, numA - i, keysB + j, linesB + j, numB - j,
+					extraKeys, extraLines, 2, outputKeys + k, outputLines + k);
+}
+
+/*
+ * void bitonicMergeSse(__m128i *lowKeys, __m128i *highKeys,
+ *                      __m128i *lowLines, __m128i *highLines) --
+ * Precondition: lowKeys and highKeys each hold two sorted keys, and
+ * lowLines and highLines the pointers to their lines.
+ * Like bitonicMergeAvx2(), merges them into the two smallest keys in
+ * lowKeys and the two largest in highKeys, each pair then put in order.
+*/
+__attribute__((target("sse4.2")))
+void bitonicMergeSse(__m128i *lowKeys, __m128i *highKeys,
+						__m128i *lowLines, __m128i *highLines) {
+	__m128i reversedKeys = _mm_shuffle_epi32(*highKeys, 0x4E);
+	__m128i reversedLines = _mm_shuffle_epi32(*highLines, 0x4E);
+	__m128i greater = _mm_cmpgt_epi64(*lowKeys, reversedKeys);
+	__m128i keys[2], lines[2];
+	keys[0] = _mm_blendv_epi8(*lowKeys, reversedKeys, greater);
+	keys[1] = _mm_blendv_epi8(reversedKeys, *lowKeys, greater);
+	lines[0] = _mm_blendv_epi8(*lowLines, reversedLines, greater);
+	lines[1] = _mm_blendv_epi8(reversedLines, *lowLines, greater);
+
+	// Put each pair in order, keeping the smaller key in the lower lane
+	int h;
+	for (h = 0; h < 2; h++) {
+		__m128i swappedKeys = _mm_shuffle_epi32(keys[h], 0x4E);
+		__m128i swappedLines = _mm_shuffle_epi32(lines[h], 0x4E);
+		__m128i takeSwapped = _mm_blend_epi16(_mm_cmpgt_epi64(keys[h], swappedKeys),
+											_mm_cmpgt_epi64(swappedKeys, keys[h]), 0xF0);
+		keys[h] = _mm_blendv_epi8(keys[h], swappedKeys, takeSwapped);
+		lines[h] = _mm_blendv_epi8(lines[h], swappedLines, takeSwapped);
+	}
+	*lowKeys = keys[0];
+	*highKeys = keys[1];
+	*lowLines = lines[0];
+	*highLines = lines[1];
+}
+
+#endif
+
+/*
+ * void statsOpen(int numWorkers) --
+ * Creates the telemetry segment /sortstat.<pid> in shared memory for
+ * numWorkers workers, for sortStat to read while the sort runs, and
+ * arranges for statsClose() to be called at exit.
+*/
+void statsOpen(int numWorkers) {
+
+	// Create the segment, named after this process
+	char name[64];
+	sprintf(name, "/sortstat.%ld", (long) getpid());
+	int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+	if (fd < 0) {
+		fprintf(stderr, "The telemetry segment \'%s\' could not be created.\n", name);
+		exit(1);
+	}
+	if (ftruncate(fd, sizeof(struct statsSegment)) < 0) {
+		perror("ftruncate");
+		exit(1);
+	}
+
+	stats = mmap(NULL, sizeof(struct statsSegment), PROT_READ | PROT_WRITE,
+					MAP_SHARED, fd, 0);
+	if ( stats == MAP_FAILED ) {
+  		fprintf(stderr, "errno is %d\n", errno);
+  		perror("stats is MAP_FAILED ");
+  		exit(1);
+	}
+	close(fd);
+
+	// The new segment is zeroed, so only the header needs to be filled in
+	memcpy(stats->magic, STATS_MAGIC, sizeof(stats->magic));
+	stats->pid = getpid();
+	stats->numWorkers = numWorkers;
+	atexit(statsClose);
+}
+
+/*
+ * void statsClose() --
+ * Marks the sort as done in the telemetry segment and removes its name,
+ * so it is freed once sortStat stops reading it.
+*/
+void statsClose() {
+	if (stats == NULL)
+		return;
+
+	char name[64];
+	sprintf(name, "/sortstat.%ld", (long) getpid());
+	stats->phase = STATS_PHASE_DONE;
+	shm_unlink(name);
+}
+
+/*
+ * void statsPhase(int phase, int mergeLevel) --
+ * Publishes the start of phase (a STATS_PHASE) at merge level mergeLevel
+ * in the telemetry segment, and clears the counters of every worker.
+ * Does nothing if there is no telemetry segment.
+*/
+void statsPhase(int phase, int mergeLevel) {
+	if (stats == NULL)
+		return;
+
+	struct timeval now;
+	gettimeofday(&now, NULL);
+
+	int i;
+	for (i = 0; i < STATS_MAX_WORKERS; i++) {
+		stats->workers[i].linesDone = 0;
+		stats->workers[i].linesTotal = 0;
+		stats->workers[i].bytesWritten = 0;
+		stats->workers[i].phase = 0;
+	}
+	stats->phaseStart = now.tv_sec * 1000000ULL + now.tv_usec;
+	stats->mergeLevel = mergeLevel;
+	stats->phase = phase;
+}
+
+/*
+ * void statsAttach(int worker, long linesTotal) --
+ * Makes slot worker of the telemetry segment the one the calling thread
+ * updates, for linesTotal lines of the current phase.
+ * Does nothing if there is no telemetry segment.
+*/
+void statsAttach(int worker, long linesTotal) {
+	if (stats == NULL || worker >= STATS_MAX_WORKERS)
+		return;
+
+	workerStats = &stats->workers[worker];
+	workerStats->linesDone = 0;
+	workerStats->linesTotal = linesTotal;
+	workerStats->bytesWritten = 0;
+	workerStats->mergeLevel = stats->mergeLevel;
+	workerStats->phase = stats->phase;
+}
+
+/* void quicksort(char **strArray, long lower, long upper) -- Using the
+ * quicksort algorithm from CLRS, recursively sorts all elements
+ * between and including indexes upper and lower in strArray.
+ * Ranges of at most insertionCutoff lines are sorted with insertionSort(),
+ * and other ranges of at most NETWORK_SIZE lines with networkSort().
+*/
+void quicksort(char **strArray, long lower, long upper) {
+	if (upper - lower < insertionCutoff) {
+		// Small ranges are faster to sort by insertion
+		insertionSort(strArray, lower, upper);
+		if (workerStats != NULL)
+			workerStats->linesDone += upper - lower + 1;
+	}
+	else if (upper - lower < NETWORK_SIZE) {
+		// Finish the leaves of the recursion with a sorting network
+		networkSort(strArray, lower, upper);
+		if (workerStats != NULL)
+			workerStats->linesDone += upper - lower + 1;
+	}
+	else {
+		// Partition range
+		long pivot = partition(strArray, lower, upper);
+		if (workerStats != NULL)
+			workerStats->linesDone++;
+		// Call quickosrt again on each range around pivot
+  		quicksort(strArray, lower, pivot - 1);
+		quicksort(strArray, pivot + 1, upper);
+	}
+}
+
+/* void multiSelect(char **strArray, long lower, long upper, long *targets, long numTargets) --
+ * Precondition: targets holds numTargets indexes between lower and upper
+ * in increasing order.
+ * Using partition(), rearranges the elements between and including indexes
+ * lower and upper in strArray so that the element at each index in targets
+ * is the one that would be there if the range were sorted.
+ * Only the partitions that hold a target are partitioned again.
+*/
+void multiSelect(char **strArray, long lower, long upper, long *targets, long numTargets) {
+	while (numTargets > 0 && lower < upper) {
+		// Partition range
+		long pivot = partition(strArray, lower, upper);
+
+		// Split the targets into those before and after the pivot
+		long numBefore = 0;
+		while (numBefore < numTargets && targets[numBefore] < pivot)
+			numBefore++;
+		long numDone = numBefore;
+		while (numDone < numTargets && targets[numDone] == pivot)
+			numDone++;
+
+		// Select the targets before the pivot, then
+		// continue with the targets after the pivot
+		multiSelect(strArray, lower, pivot - 1, targets, numBefore);
+		targets += numDone;
+		numTargets -= numDone;
+		lower = pivot + 1;
+	}
+}
+
+/* void quickselect(char **strArray, long lower, long upper, long target) --
+ * Using partition(), rearranges the elements between and including
+ * indexes lower and upper in strArray so that the element at index
+ * target is the one that would be there if the range were sorted,
+ * with no greater element before it and no smaller element after it.
+ * Only the side of each partition that holds target is partitioned again.
+*/
+void quickselect(char **strArray, long lower, long upper, long target) {
+	while (lower < upper) {
+		// Partition range
+		long pivot = partition(strArray, lower, upper);
+		// Continue with the side of the pivot that holds target
+		if (target < pivot)
+			upper = pivot - 1;
+		else if (target > pivot)
+			lower = pivot + 1;
+		else
+			return;
+	}
+}
+
+/* void partialSort(char **strArray, long lower, long upper, long last) --
+ * Moves the smallest (last - lower + 1) elements between and including
+ * indexes lower and upper in strArray to indexes lower to last, in
+ * sorted order. The order of the remaining elements is undefined.
+*/
+void partialSort(char **strArray, long lower, long upper, long last) {
+	// Find the boundary of the prefix, then sort only the prefix
+	quickselect(strArray, lower, upper, last);
+	quicksort(strArray, lower, last);
+}
+
+/* void partition(char **strArray, long lower, long upper) --
+ * Using the partition algorithm from CLRS, partitions all
+ * elements between and including indexes lower and upper
+ * in strArray around a pivot chosen by the 'median of 3'
+ * method (implemented in selectPivot()).
+ * Returns pivot index
+*/
+long partition(char **strArray, long lower, long upper) {
+
+	//Select the optimal pivot index
+  	long pivot = selectPivot(strArray, lower, upper);
+
+	// Move pivot to the end
+  	swapStr(strArray, pivot, upper);
+
+	// Save value of pivot string for comparison
+  	char* pivotStr = strArray[upper];
+
+	// Variable to keep track of how many strings equivalent
+	// to the pivot we encounter
+	long eqLines = 0;
+
+  	long j;
+  	int strcmpRetVal;
+  	long currIndex = lower - 1;
+
+	// Move the values relative to the pivot
+  	for (j = lower; j <= upper - 1; j++) {
+  		strcmpRetVal = strcmp(strArray[j], pivotStr);
+  		if (strcmpRetVal < 0) {
+  			currIndex++;
+  			swapStr(strArray, currIndex, j);
+  		}
+  		else if (strcmpRetVal == 0) {
+			// Alternate which side equivalent lines are moved
+  			eqLines++;
+  			if (eqLines % 2 == 0) {
+  				currIndex++;
+  				swapStr(strArray, currIndex, j);
+  			}
+  		}
+  	}
+
+	// Move pivot back
+  	swapStr(strArray, currIndex + 1, upper);
+
+	// Return picot index
+  	return currIndex + 1;
+}
+
+/* selectPivot(char **strArray, long lower, long upper) --
+ * Uses the 'median of 3' approach to select
+ * (and return the index of) an optimal pivot between
+ * and including lower and upperin strArray for partitioning.
+ * Also sorts 3 of the string pointers relative to
+ * each other within the array, which will aid future sorting.
+ * If the range is 10 or smaller, simply returns upper index.
+*/
+long selectPivot(char **strArray, long lower, long upper) {
+
+	// Abort if range is too small
+ 	if (upper - lower <= 10)
+  		return upper;
+
+	// Set midpoint
+  	long mid = (upper + lower) / 2;
+
+	// Sort the three values
+  	if (strcmp(strArray[mid], strArray[lower]) < 0)
+  		swapStr(strArray, lower, mid);
+  	if (strcmp(strArray[upper], strArray[lower]) < 0)
+  		swapStr(strArray, lower, upper);
+  	if (strcmp(strArray[upper], strArray[mid]) < 0)
+  		swapStr(strArray, mid, upper);
+
+	// Return index of median value
+  	return mid;
+}
+
+/* swapStr(char **strArray, long indexA, long indexB) --
+ * Swaps the string pointers at indexA and indexB in
+ * strArray with one another.
+*/
+void swapStr(char **strArray, long indexA, long indexB) {
+	char* temp = strArray[indexA];
+  	strArray[indexA] = strArray[indexB];
+  	strArray[indexB] = temp;
+}
+
+/*
+ * void parallelQuicksort(char **strArray, long lower, long upper, int numThreads) --
+ * Like quicksort(), sorts all elements between and including indexes
+ * lower and upper in strArray, but using up to numThreads threads and
+ * without merging. Each range is partitioned by all of its threads
+ * together with parallelPartition(), then the side before the pivot is
+ * given to a new thread along with its share of the threads.
+ * Ranges smaller than PARALLEL_PARTITION_MIN, or left with a single
+ * thread, are sorted with quicksort().
+*/
+void parallelQuicksort(char **strArray, long lower, long upper, int numThreads) {
+
+	// Finish sequentially once there are no spare threads
+	if (numThreads <= 1 || upper - lower < PARALLEL_PARTITION_MIN) {
+		quicksort(strArray, lower, upper);
+		return;
+	}
+
+	// Partition range using all the threads
+	long pivot = parallelPartition(strArray, lower, upper, numThreads);
+
+	// Split the threads between the two sides in proportion to their sizes
+	int lowerThreads = (int) ((double) numThreads * (pivot - lower) /
+								(upper - lower + 1) + 0.5);
+	if (lowerThreads < 1)
+		lowerThreads = 1;
+	if (lowerThreads > numThreads - 1)
+		lowerThreads = numThreads - 1;
+
+	// pthread variable declarations
+	int result;
+	pthread_t threadID;
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	pthread_attr_setscope(&attr, PTHREAD_SCOPE_SYSTEM);
+
+	// Sort the side before the pivot in a new thread
+	struct threadParams *params = malloc(sizeof(struct threadParams));
+	if (params == NULL) {
+		fprintf(stderr, "ERROR: Out of memory!\n");
+		exit(1);
+	}
+	params->inputArray = strArray;
+	params->lower = lower;
+	params->upper = pivot - 1;
+	params->numThreads = lowerThreads;
+
+	result = pthread_create(&threadID, &attr, threadParallelQuicksort, (void *) params);
+
+	if (result != 0) {
+		fprintf(stderr, "pthread_create failed, result = %d\n", result);
+		exit(1);
+	}
+
+	// Sort the side after the pivot with the remaining threads
+	parallelQuicksort(strArray, pivot + 1, upper, numThreads - lowerThreads);
+
+	// Wait for the thread to exit
+	result = pthread_join(threadID, NULL);
+
+	if ( result != 0 ) {
+		fprintf(stderr, "join with worker %ld failed, error = %d\n",
+				(long) threadID, result);
+		exit(1);
+	}
+}
+
+/*
+ * void *threadParallelQuicksort(void *arg) -- A middleman method
+ * for calling parallelQuicksort in a separate thread.
+ * Sets the arguments for parallelQuicksort() from the struct pointer
+ * specified by arg.
+*/
+void *threadParallelQuicksort(void *arg) {
+	// Cast arg to threadParams*
+	struct threadParams *params = (struct threadParams*) arg;
+
+	// Call parallelQuicksort() with the given arguments
+	parallelQuicksort(params->inputArray, params->lower, params->upper,
+						params->numThreads);
+
+	// Free params from memory
+	free(params);
+
+	// Exit thread
+	pthread_exit( NULL );
+}
+
+/*
+ * long parallelPartition(char **strArray, long lower, long upper, int numThreads) --
+ * Like partition(), partitions all elements between and including indexes
+ * lower and upper in strArray around a pivot chosen by selectPivot(),
+ * but using numThreads threads. Each thread first partitions its own
+ * block of the range with partitionBlock(). The sizes of the blocks'
+ * lower sides give the final position of the pivot, and the lines left
+ * on the wrong side of it are then swapped into place by the threads,
+ * each taking an equal share of them with swapMisplaced().
+ * Returns pivot index
+*/
+long parallelPartition(char **strArray, long lower, long upper, int numThreads) {
+
+	// Select the optimal pivot index and move it to the end
+	long pivot = selectPivot(strArray, lower, upper);
+	swapStr(strArray, pivot, upper);
+	char *pivotStr = strArray[upper];
+
+	// pthread variable declarations
+	int i, result;
+	struct partitionParams params[numThreads];
+	pthread_t threadID[numThreads];
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	pthread_attr_setscope(&attr, PTHREAD_SCOPE_SYSTEM);
+
+	// Break up the range and partition each block
+	long numLines = upper - lower;
+	for (i = 0; i < numThreads; i++) {
+		params[i].strArray = strArray;
+		params[i].pivotStr = pivotStr;
+		params[i].lower = lower + i * numLines / numThreads;
+		params[i].upper = lower + (i + 1) * numLines / numThreads;
+
+		result = pthread_create(&threadID[i], &attr, threadPartitionBlock, (void *) &params[i]);
+
+		if (result != 0) {
+			fprintf(stderr, "pthread_create failed, result = %d\n", result);
+			exit(1);
+		}
+	}
+
+	// Wait for all threads to exit
+	for (i = 0; i < numThreads; i++) {
+
+		result = pthread_join(threadID[i], NULL);
+
+		if ( result != 0 ) {
+			fprintf(stderr, "join with worker %ld failed, error = %d\n",
+					(long) threadID[i], result);
+			exit(1);
+		}
+	}
+
+	// The pivot belongs after the lower sides of all blocks
+	long boundary = lower;
+	for (i = 0; i < numThreads; i++)
+		boundary += params[i].numSmall;
+
+	// Find the lines of each block on the wrong side of the boundary:
+	// upper-side lines before it and lower-side lines after it
+	long largeRanges[2 * numThreads];
+	long smallRanges[2 * numThreads];
+	long numMisplaced = 0;
+	for (i = 0; i < numThreads; i++) {
+		long smallEnd = params[i].lower + params[i].numSmall;
+
+		largeRanges[2 * i] = smallEnd;
+		largeRanges[2 * i + 1] = params[i].upper < boundary ? params[i].upper : boundary;
+		if (largeRanges[2 * i + 1] < smallEnd)
+			largeRanges[2 * i + 1] = smallEnd;
+
+		smallRanges[2 * i] = params[i].lower > boundary ? params[i].lower : boundary;
+		smallRanges[2 * i + 1] = smallEnd;
+		if (smallRanges[2 * i + 1] < smallRanges[2 * i])
+			smallRanges[2 * i + 1] = smallRanges[2 * i];
+
+		numMisplaced += largeRanges[2 * i + 1] - largeRanges[2 * i];
+	}
+
+	// Swap an equal share of the misplaced lines in each thread
+	for (i = 0; numMisplaced > 0 && i < numThreads; i++) {
+		params[i].largeRanges = largeRanges;
+		params[i].smallRanges = smallRanges;
+		params[i].firstRank = i * numMisplaced / numThreads;
+		params[i].lastRank = (i + 1) * numMisplaced / numThreads;
+
+		result = pthread_create(&threadID[i], &attr, threadSwapMisplaced, (void *) &params[i]);
+
+		if (result != 0) {
+			fprintf(stderr, "pthread_create failed, result = %d\n", result);
+			exit(1);
+		}
+	}
+
+	// Wait for all threads to exit
+	for (i = 0; numMisplaced > 0 && i < numThreads; i++) {
+
+		result = pthread_join(threadID[i], NULL);
+
+		if ( result != 0 ) {
+			fprintf(stderr, "join with worker %ld failed, error = %d\n",
+					(long) threadID[i], result);
+			exit(1);
+		}
+	}
+
+	// Move pivot back
+	swapStr(strArray, boundary, upper);
+
+	// Return pivot index
+	return boundary;
+}
+
+/*
+ * void *threadPartitionBlock(void *arg) -- A middleman method
+ * for calling partitionBlock in a separate thread.
+ * Sets the arguments for partitionBlock() from the struct pointer
+ * specified by arg, and stores the result in its numSmall field.
+*/
+void *threadPartitionBlock(void *arg) {
+	// Cast arg to partitionParams*
+	struct partitionParams *params = (struct partitionParams*) arg;
+
+	// Call partitionBlock() with the given arguments
+	params->numSmall = partitionBlock(params->strArray, params->lower,
+									params->upper, params->pivotStr);
+
+	// Exit thread
+	pthread_exit( NULL );
+}
+
+/*
+ * void *threadSwapMisplaced(void *arg) -- A middleman method
+ * for calling swapMisplaced in a separate thread.
+ * Sets the arguments for swapMisplaced() from the struct pointer
+ * specified by arg.
+*/
+void *threadSwapMisplaced(void *arg) {
+	// Cast arg to partitionParams*
+	struct partitionParams *params = (struct partitionParams*) arg;
+
+	// Call swapMisplaced() with the given arguments
+	swapMisplaced(params->strArray, params->largeRanges, params->smallRanges,
+					params->firstRank, params->lastRank);
+
+	// Exit thread
+	pthread_exit( NULL );
+}
+
+/*
+ * long partitionBlock(char **strArray, long lower, long upper, char *pivotStr) --
+ * Partitions the elements lower to upper-1 of strArray around pivotStr
+ * in the same way as partition(), moving the smaller elements and every
+ * other element equal to pivotStr to the start of the block.
+ * Returns the number of elements moved to the start.
+*/
+long partitionBlock(char **strArray, long lower, long upper, char *pivotStr) {
+
+	// Variable to keep track of how many strings equivalent
+	// to the pivot we encounter
+	long eqLines = 0;
+
+	long j;
+	int strcmpRetVal;
+	long currIndex = lower;
+
+	// Move the values relative to the pivot
+	for (j = lower; j < upper; j++) {
+		strcmpRetVal = strcmp(strArray[j], pivotStr);
+		if (strcmpRetVal < 0) {
+			swapStr(strArray, currIndex, j);
+			currIndex++;
+		}
+		else if (strcmpRetVal == 0) {
+			// Alternate which side equivalent lines are moved
+			eqLines++;
+			if (eqLines % 2 == 0) {
+				swapStr(strArray, currIndex, j);
+				currIndex++;
+			}
+		}
+	}
+
+	return currIndex - lower;
+}
+
+/*
+ * void swapMisplaced(char **strArray, long *largeRanges, long *smallRanges,
+ *                    long firstRank, long lastRank) --
+ * largeRanges and smallRanges each hold one [start, end) pair per block of
+ * indexes of strArray, numbering the misplaced lines on each side of the
+ * pivot in order. Swaps misplaced lines firstRank to lastRank-1 of
+ * largeRanges with the lines of the same numbers in smallRanges.
+*/
+void swapMisplaced(char **strArray, long *largeRanges, long *smallRanges,
+					long firstRank, long lastRank) {
+
+	// Start at line firstRank of each list
+	int largeIndex = 0;
+	int smallIndex = 0;
+	long largePos = largeRanges[0] + firstRank;
+	long smallPos = smallRanges[0] + firstRank;
+
+	long rank;
+	for (rank = firstRank; rank < lastRank; rank++) {
+		largePos = nextMisplaced(largeRanges, &largeIndex, largePos);
+		smallPos = nextMisplaced(smallRanges, &smallIndex, smallPos);
+		swapStr(strArray, largePos, smallPos);
+		largePos++;
+		smallPos++;
+	}
+}
+
+/*
+ * long nextMisplaced(long *ranges, int *rangeIndex, long pos) --
+ * Given a position pos counted from the start of range *rangeIndex
+ * of the [start, end) pairs in ranges, carries any part of pos past
+ * the end of that range into the following ranges.
+ * Returns the index in strArray it refers to, and sets *rangeIndex
+ * to the range that holds it.
+*/
+long nextMisplaced(long *ranges, int *rangeIndex, long pos) {
+	while (pos >= ranges[2 * *rangeIndex + 1]) {
+		long overflow = pos - ranges[2 * *rangeIndex + 1];
+		(*rangeIndex)++;
+		pos = ranges[2 * *rangeIndex] + overflow;
+	}
+	return pos;
+}
+
+/*
+ * char **readLines(char *fileName, int numThreads, int useRing, char **fileBuffer,
+ *                  long *fileSize, long *totalLines, struct offsetArray *offsets) --
+ * Reads the whole file fileName into a single buffer, breaks the buffer
+ * into numThreads byte ranges that start and end on line boundaries, and
+ * indexes the lines of each range in a separate thread.
+ * The threads first count the lines in their range; a prefix sum over the
+ * counts gives each thread the index of its first line, so the array of
+ * line pointers is allocated once at its final size and filled in a second
+ * pass without any resizing. Newlines are replaced with '\0' in place.
+ * The buffer and the array are backed by transparent huge pages.
+ * If useRing is set, the file is read with several io_uring reads in
+ * flight at once, or with read() if io_uring is not available.
+ * Sets fileBuffer to the buffer holding the lines, fileSize to its length,
+ * and totalLines to the number of lines read. The caller must unmap
+ * fileSize + 1 bytes of the buffer and totalLines + 1 entries of the array.
+ * If offsets is not NULL, the lines are stored in it as a compact
+ * offsetArray for the -C mode instead of in an array of string pointers.
+ * Returns a pointer to the array of lines, or NULL if offsets is used.
+*/
+char **readLines(char *fileName, int numThreads, int useRing, char **fileBuffer,
+					long *fileSize, long *totalLines, struct offsetArray *offsets) {
+
+	// Open file for reading
+	int fd = open(fileName, O_RDONLY);
+
+	// Exit if file does not open
+	if (fd < 0) {
+		fprintf(stderr, "The file \'%s\' does not exist.\n", fileName);
+		exit(1);
+	}
+
+	// Find the size of the file
+	struct stat fileStat;
+	if (fstat(fd, &fileStat) < 0) {
+		perror("fstat");
+		exit(1);
+	}
+	long bufferLen = fileStat.st_size;
+
+	// Create a buffer to hold the file and a final '\0', backed by
+	// huge pages since the sort reads lines from all over it
+	void *memoryBuffer = mmap(	NULL, bufferLen + 1, PROT_READ | PROT_WRITE,
+								MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+	if ( memoryBuffer == MAP_FAILED ) {
+  		fprintf(stderr, "errno is %d\n", errno);
+  		perror("memoryBuffer is MAP_FAILED ");
+  		exit(1);
+	}
+	madvise(memoryBuffer, bufferLen + 1, MADV_HUGEPAGE);
+	char *buffer = (char*) memoryBuffer;
+
+	// Read the whole file into the buffer
+	long bytesRead = 0;
+	if (useRing) {
+		long result = ringReadFile(fd, buffer, bufferLen);
+		if (result >= 0)
+			bytesRead = bufferLen = result;
+	}
+	while (bytesRead < bufferLen) {
+		ssize_t result = read(fd, buffer + bytesRead, bufferLen - bytesRead);
+		if (result < 0 && errno == EINTR)
+			continue;
+		if (result < 0) {
+			perror("read");
+			exit(1);
+		}
+		if (result == 0)
+			break;
+		bytesRead += result;
+	}
+	close(fd);
+	buffer[bytesRead] = '\0';
+
+	// pthread variable declarations
+	int i, result;
+	struct parseParams params[numThreads];
+	pthread_t threadID[numThreads];
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	pthread_attr_setscope(&attr, PTHREAD_SCOPE_SYSTEM);
+
+	// Break up the buffer and count the lines in each part
+	for (i = 0; i < numThreads; i++) {
+		params[i].buffer = buffer;
+		params[i].lower = lineBoundary(buffer, bytesRead, i * bytesRead / numThreads);
+		params[i].upper = lineBoundary(buffer, bytesRead, (i + 1) * bytesRead / numThreads);
+
+		// A single part is counted without starting a thread
+		if (numThreads == 1) {
+			params[i].numLines = countLines(buffer, params[i].lower, params[i].upper);
+			break;
+		}
+
+		result = pthread_create(&threadID[i], &attr, threadCountLines, (void *) &params[i]);
+
+		if (result != 0) {
+			fprintf(stderr, "pthread_create failed, result = %d\n", result);
+			exit(1);
+		}
+	}
+
+	// Wait for all threads to exit
+	for (i = 0; numThreads > 1 && i < numThreads; i++) {
+
+		result = pthread_join(threadID[i], NULL);
+
+		if ( result != 0 ) {
+			fprintf(stderr, "join with worker %ld failed, error = %d\n",
+					(long) threadID[i], result);
+			exit(1);
+		}
+	}
+
+	// Prefix sum of the line counts gives the first line of each part
+	long lineCount = 0;
+	for (i = 0; i < numThreads; i++) {
+		params[i].firstLine = lineCount;
+		lineCount += params[i].numLines;
+	}
+
+	// Create an array of exactly the right size to hold the lines,
+	// with offsets just wide enough for the size of the file
+	char **linesArray = NULL;
+	if (offsets != NULL) {
+		if ((uint64_t) bytesRead >= (1ULL << 40)) {
+			fprintf(stderr, "Error: -C supports files up to 1 TiB\n");
+			exit(1);
+		}
+		allocOffsetArray(offsets, lineCount + 1,
+				(uint64_t) bytesRead < (1ULL << 32) ? 4 : 5, buffer);
+	}
+	else {
+		linesArray = allocLineArray(lineCount + 1);
+	}
+
+	// Index the lines in each part of the buffer
+	for (i = 0; i < numThreads; i++) {
+		params[i].linesArray = linesArray;
+		params[i].offsets = offsets;
+
+		// A single part is indexed without starting a thread
+		if (numThreads == 1 && offsets == NULL) {
+			indexLines(buffer, params[i].lower, params[i].upper, linesArray, 0);
+			break;
+		}
+		if (numThreads == 1) {
+			indexOffsets(buffer, params[i].lower, params[i].upper, offsets, 0);
+			break;
+		}
+
+		result = pthread_create(&threadID[i], &attr, threadIndexLines, (void *) &params[i]);
+
+		if (result != 0) {
+			fprintf(stderr, "pthread_create failed, result = %d\n", result);
+			exit(1);
+		}
+	}
+
+	// Wait for all threads to exit
+	for (i = 0; numThreads > 1 && i < numThreads; i++) {
+
+		result = pthread_join(threadID[i], NULL);
+
+		if ( result != 0 ) {
+			fprintf(stderr, "join with worker %ld failed, error = %d\n",
+					(long) threadID[i], result);
+			exit(1);
+		}
+	}
+
+	// Return the buffer, its length, the line count and array of lines
+	*fileBuffer = buffer;
+	*fileSize = bytesRead;
+	*totalLines = lineCount;
+	return linesArray;
+}
+
+/*
+ * char **allocLineArray(long len) --
+ * Maps a new array of len string pointers, and asks the kernel to back
+ * it with transparent huge pages, so that filling, sorting and merging
+ * a large array takes far fewer page faults and TLB misses.
+ * The array must be released with munmap().
+ * Returns a pointer to the new array.
+*/
+char **allocLineArray(long len) {
+
+	// Map the new array
+	void *memoryBuffer = mmap(	NULL, len * sizeof(char*), PROT_READ | PROT_WRITE,
+								MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+	if ( memoryBuffer == MAP_FAILED ) {
+  		fprintf(stderr, "errno is %d\n", errno);
+  		perror("memoryBuffer is MAP_FAILED ");
+  		exit(1);
+	}
+
+	// Huge pages are only a hint, so ignore failure
+	madvise(memoryBuffer, len * sizeof(char*), MADV_HUGEPAGE);
+
+	// Return new array
+	return (char**) memoryBuffer;
+}
+
+/*
+ * long lineBoundary(char *buffer, long bufferLen, long pos) --
+ * Returns the index of the first line that starts at or after
+ * index pos in buffer, or bufferLen if there is no such line.
+*/
+long lineBoundary(char *buffer, long bufferLen, long pos) {
+
+	// The ends of the buffer are always boundaries
+	if (pos <= 0)
+		return 0;
+	if (pos >= bufferLen)
+		return bufferLen;
+
+	// pos already starts a line
+	if (buffer[pos - 1] == '\n')
+		return pos;
+
+	// Otherwise skip to the start of the next line
+	char *newline = memchr(buffer + pos, '\n', bufferLen - pos);
+	if (newline == NULL)
+		return bufferLen;
+	return newline - buffer + 1;
+}
+
+/*
+ * void *threadCountLines(void *arg) -- A middleman method
+ * for calling countLines in a separate thread.
+ * Sets the arguments for countLines() from the struct pointer
+ * specified by arg, and stores the result in its numLines field.
+*/
+void *threadCountLines(void *arg) {
+	// Cast arg to parseParams*
+	struct parseParams *params = (struct parseParams*) arg;
+
+	// Call countLines() with the given arguments
+	params->numLines = countLines(params->buffer, params->lower, params->upper);
+
+	// Exit thread
+	pthread_exit( NULL );
+}
+
+/*
+ * void *threadIndexLines(void *arg) -- A middleman method
+ * for calling indexLines in a separate thread.
+ * Sets the arguments for indexLines() from the struct pointer
+ * specified by arg.
+*/
+void *threadIndexLines(void *arg) {
+	// Cast arg to parseParams*
+	struct parseParams *params = (struct parseParams*) arg;
+
+	// Call indexLines() or indexOffsets() with the given arguments
+	if (params->offsets != NULL)
+		indexOffsets(params->buffer, params->lower, params->upper,
+				params->offsets, params->firstLine);
+	else
+		indexLines(params->buffer, params->lower, params->upper,
+				params->linesArray, params->firstLine);
+
+	// Exit thread
+	pthread_exit( NULL );
+}
+
+/*
+ * long countLines(char *buffer, long lower, long upper) --
+ * Precondition: lower is the start of a line in buffer.
+ * Returns the number of lines that start between index lower
+ * and upper-1 (inclusive) in buffer. Newlines are found with
+ * memchr(), which scans many bytes at a time.
+*/
+long countLines(char *buffer, long lower, long upper) {
+	char *curr = buffer + lower;
+	char *end = buffer + upper;
+	char *newline;
+	long numLines = 0;
+
+	// Count one line per newline, plus a final unterminated line
+	while (curr < end) {
+		numLines++;
+		newline = memchr(curr, '\n', end - curr);
+		if (newline == NULL)
+			break;
+		curr = newline + 1;
+	}
+
+	return numLines;
+}
+
+/*
+ * void indexLines(char *buffer, long lower, long upper, char **linesArray, long firstLine) --
+ * Precondition: lower is the start of a line in buffer.
+ * Replaces each newline between index lower and upper-1 (inclusive) in buffer
+ * with '\0', and stores a pointer to each line that starts in that range in
+ * linesArray, beginning at index firstLine.
+*/
+void indexLines(char *buffer, long lower, long upper, char **linesArray, long firstLine) {
+	char *curr = buffer + lower;
+	char *end = buffer + upper;
+	char *newline;
+	long lineIndex = firstLine;
+
+	// Terminate each line and add its pointer to the array
+	while (curr < end) {
+		linesArray[lineIndex] = curr;
+		lineIndex++;
+		newline = memchr(curr, '\n', end - curr);
+		if (newline == NULL)
+			break;
+		*newline = '\0';
+		curr = newline + 1;
+	}
+}
+
+/*
+ * long uniqueLines(char **linesArray, long totalLines, struct lineTable *table) --
+ * Counts how many times each distinct line occurs in linesArray using
+ * a hash table, and moves the first occurrence of each distinct line
+ * to the front of linesArray, so that only distinct lines are sorted.
+ * Sets up table so the counts can be found afterwards with lineCount().
+ * Returns the number of distinct lines.
+*/
+long uniqueLines(char **linesArray, long totalLines, struct lineTable *table) {
+
+	// Size the table to a power of 2 at least twice the number of lines
+	unsigned long tableLen = 2;
+	while (tableLen < 2 * (unsigned long) totalLines)
+		tableLen *= 2;
+	table->lines = calloc(tableLen, sizeof(char*));
+	table->counts = calloc(tableLen, sizeof(long));
+	table->mask = tableLen - 1;
+
+	// Check for unsuccessful calloc
+	if (table->lines == NULL || table->counts == NULL) {
+		fprintf(stderr, "ERROR: Out of memory!\n");
+		exit(1);
+	}
+
+	// Count each line, keeping the first occurrence of each one
+	long i;
+	long numDistinct = 0;
+	unsigned long slot;
+	for (i = 0; i < totalLines; i++) {
+		slot = findLine(table, linesArray[i]);
+		if (table->lines[slot] == NULL) {
+			table->lines[slot] = linesArray[i];
+			linesArray[numDistinct] = linesArray[i];
+			numDistinct++;
+		}
+		table->counts[slot]++;
+	}
+
+	return numDistinct;
+}
+
+/*
+ * long lineCount(struct lineTable *table, char *line) --
+ * Returns the number of times line occurred in the lines
+ * given to uniqueLines() when table was set up.
+*/
+long lineCount(struct lineTable *table, char *line) {
+	return table->counts[findLine(table, line)];
+}
+
+/*
+ * unsigned long findLine(struct lineTable *table, char *line) --
+ * Returns the slot of table that holds line, or the empty
+ * slot where line belongs if it is not in the table yet.
+ * Collisions are resolved by linear probing.
+*/
+unsigned long findLine(struct lineTable *table, char *line) {
+	unsigned long slot = hashStr(line) & table->mask;
+	while (table->lines[slot] != NULL && strcmp(table->lines[slot], line) != 0)
+		slot = (slot + 1) & table->mask;
+	return slot;
+}
+
+/*
+ * unsigned long hashStr(char *str) --
+ * Returns the 64-bit FNV-1a hash of str.
+*/
+unsigned long hashStr(char *str) {
+	unsigned long hash = 14695981039346656037UL;
+	while (*str != '\0') {
+		hash ^= (unsigned char) *str;
+		hash *= 1099511628211UL;
+		str++;
+	}
+	return hash;
+}
+
+/*
+ * int parseQueries(char *queryList, char ***queries) --
+ * Splits the comma-separated list of ranks and percentiles given
+ * with -q (for example "1,100,p50,p99.9") into separate strings.
+ * Sets queries to a new array of those strings.
+ * Returns the number of queries.
+*/
+int parseQueries(char *queryList, char ***queries) {
+
+	// Count the queries so the array can be sized once
+	int numQueries = 1;
+	char *curr;
+	for (curr = queryList; *curr != '\0'; curr++) {
+		if (*curr == ',')
+			numQueries++;
+	}
+
+	*queries = malloc(numQueries * sizeof(char*));
+	if (*queries == NULL) {
+		fprintf(stderr, "ERROR: Out of memory!\n");
+		exit(1);
+	}
+
+	// Split the list in place at each comma
+	int i = 0;
+	char *query = strtok(queryList, ",");
+	while (query != NULL) {
+		(*queries)[i] = query;
+		i++;
+		query = strtok(NULL, ",");
+	}
+
+	return i;
+}
+
+/*
+ * long queryIndex(char *query, long totalLines) --
+ * Returns the index in a sorted array of totalLines lines selected by query.
+ * A query of the form 'pN' is a percentile, using the nearest-rank method;
+ * a percentile of more than 2 plain digits has an implied decimal point
+ * after the second digit, so p999 is the 99.9th percentile.
+ * Any other query is a 1-based rank.
+ * Returns -1 if query is not valid or selects no line.
+*/
+long queryIndex(char *query, long totalLines) {
+	char *end;
+
+	if (totalLines <= 0)
+		return -1;
+
+	// Percentile queries
+	if (query[0] == 'p') {
+		double percentile = strtod(query + 1, &end);
+		if (end == query + 1 || *end != '\0' || !isfinite(percentile))
+			return -1;
+		if (percentile > 100 && strspn(query + 1, "0123456789") == strlen(query + 1)) {
+			while (percentile >= 100)
+				percentile /= 10;
+		}
+		if (percentile < 0 || percentile > 100)
+			return -1;
+
+		// Nearest rank: the smallest line with at least
+		// percentile% of the lines at or below it
+		double exactRank = percentile / 100 * totalLines;
+		long rank = (long) exactRank;
+		if (rank < exactRank)
+			rank++;
+		if (rank < 1)
+			rank = 1;
+		return rank - 1;
+	}
+
+	// Rank queries
+	long rank = strtol(query, &end, 10);
+	if (end == query || *end != '\0' || rank < 1 || rank > totalLines)
+		return -1;
+	return rank - 1;
+}
+
+/*
+ * int compareLongs(const void *a, const void *b) --
+ * Comparison function for sorting an array of longs with qsort().
+*/
+int compareLongs(const void *a, const void *b) {
+	long longA = *(const long*) a;
+	long longB = *(const long*) b;
+	return (longA > longB) - (longA < longB);
+}
+
+/*
+ * void mergeWithFile(char **linesArray, long totalLines, char *baseFileName) --
+ * Precondition: the lines of the file baseFileName are sorted,
+ * and the string pointers in linesArray indexes 0 to totalLines-1 are sorted.
+ * Prints the lines of the file and of linesArray together in sorted order.
+ * The file is read one line at a time from start to end, so it is never
+ * held in memory and is never sorted again. As in merge(), a line from the
+ * file is printed before an equal line from linesArray.
+*/
+void mergeWithFile(char **linesArray, long totalLines, char *baseFileName) {
+
+	// Open file for reading
+	FILE *baseFile = fopen(baseFileName, "r");
+
+	// Exit if file does not open
+	if (baseFile == NULL) {
+		fprintf(stderr, "The file \'%s\' does not exist.\n", baseFileName);
+		exit(1);
+	}
+
+	// The file is only read sequentially, so read it in large blocks
+	posix_fadvise(fileno(baseFile), 0, 0, POSIX_FADV_SEQUENTIAL);
+	setvbuf(baseFile, NULL, _IOFBF, 1 << 20);
+
+	// Declare variables for our file-reading loop
+	char *buf = NULL;
+	size_t bufLen = 0;
+	ssize_t lineLen;
+	long j = 0;
+
+	// Merge values
+	while ((lineLen = getline(&buf, &bufLen, baseFile)) != EOF) {
+
+		// Remove final newline characters to standardize lines
+		if (lineLen > 0 && buf[lineLen - 1] == '\n') {
+			buf[lineLen - 1] = '\0';
+		}
+
+		// Print the lines of the array that come before this line
+		while (j < totalLines && strcmp(linesArray[j], buf) < 0) {
+			printf("%s\n", linesArray[j]);
+			j++;
+		}
+
+		printf("%s\n", buf);
+	}
+
+	// Print the lines of the array after the end of the file
+	while (j < totalLines) {
+		printf("%s\n", linesArray[j]);
+		j++;
+	}
+
+	// Cleanup memory from file input
+	free(buf);
+	fclose(baseFile);
+}
+
+/*
+ * void writeIndex(char **linesArray, long totalLines, char *indexFileName) --
+ * Writes a binary index of the sorted lines in linesArray indexes 0 to
+ * totalLines-1 to the file indexFileName, so that sortLookup can search
+ * the sorted output without reading or sorting it again.
+ * The index is an indexHeader followed by one indexEntry per line,
+ * in the byte order of this machine.
+*/
+void writeIndex(char **linesArray, long totalLines, char *indexFileName) {
+
+	// Open index file for writing
+	FILE *indexFile = fopen(indexFileName, "w");
+
+	// Exit if file does not open
+	if (indexFile == NULL) {
+		fprintf(stderr, "The index file \'%s\' cannot be created.\n", indexFileName);
+		exit(1);
+	}
+
+	// Leave room for the header, which needs the total output size
+	struct indexHeader header;
+	memset(&header, 0, sizeof(header));
+	fwrite(&header, sizeof(header), 1, indexFile);
+
+	// Write the output offset and prefix of each line
+	struct indexEntry entry;
+	uint64_t offset = 0;
+	long i;
+	for (i = 0; i < totalLines; i++) {
+		entry.offset = offset;
+		strncpy(entry.prefix, linesArray[i], INDEX_PREFIX_LEN);
+		fwrite(&entry, sizeof(entry), 1, indexFile);
+
+		// Each line is printed followed by a newline
+		offset += strlen(linesArray[i]) + 1;
+	}
+
+	// Write the header at the start of the file
+	memcpy(header.magic, INDEX_MAGIC, sizeof(header.magic));
+	header.numLines = totalLines;
+	header.dataSize = offset;
+	rewind(indexFile);
+	fwrite(&header, sizeof(header), 1, indexFile);
+
+	// Exit if any write failed
+	if (ferror(indexFile) || fclose(indexFile) != 0) {
+		fprintf(stderr, "Error: could not write the index file \'%s\'\n", indexFileName);
+		exit(1);
+	}
+}
+
+/*
+ * void sortCompact(char *fileName, int numThreads) --
+ * Sorts and prints the lines of fileName like main() does, but indexes
+ * the lines with a compact offsetArray of 4 or 5 bytes per line instead
+ * of an array of 8-byte string pointers, using the -C mode versions of
+ * the sort and merge functions.
+*/
+void sortCompact(char *fileName, int numThreads) {
+
+	// Read and index all lines from the file as compact offsets
+	char *fileBuffer;
+	long fileSize;
+	long totalLines;
+	struct offsetArray offsets;
+	readLines(fileName, numThreads, 0, &fileBuffer, &fileSize, &totalLines, &offsets);
+
+	/* Keep track of start time for
+	 * sort runtime calculation */
+	struct timeval startTime, endTime;
+	int seconds, micros;
+	gettimeofday(&startTime, NULL);
+
+	// Sort the array
+	struct offsetArray *sortedOffsets = &offsets;
+	if (totalLines >= numThreads) {
+		// Sort the array using threaded quicksort
+		sortedOffsets = multiThreadSortOffsets(&offsets, totalLines, numThreads);
+	}
+	else {
+		// Sort the array using sequential quicksort
+		quicksortOffsets(&offsets, 0, totalLines - 1);
+	}
+
+	/* Print runtime info to stderr for performance testing */
+	gettimeofday(&endTime, NULL);
+	seconds = endTime.tv_sec  - startTime.tv_sec;
+	micros  = endTime.tv_usec - startTime.tv_usec;
+	if ( endTime.tv_usec < startTime.tv_usec ) {
+		micros += 1000000;
+		seconds--;
+	}
+	fprintf(stderr, "runtime: %d seconds, %d microseconds\n", seconds, micros);
+
+	// Print page fault counts to stderr for performance testing
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	fprintf(stderr, "page faults: %ld minor, %ld major\n",
+			usage.ru_minflt, usage.ru_majflt);
+
+	// Print all lines of the array in order
+	long i;
+	for (i = 0; i < totalLines; i++) {
+		printf("%s\n", offsetLine(sortedOffsets, i));
+	}
+
+	// unmap the array of offsets and the buffer holding the lines
+	munmap(sortedOffsets->data, (totalLines + 1) * sortedOffsets->width);
+	munmap(fileBuffer, fileSize + 1);
+}
+
+/*
+ * struct offsetArray *multiThreadSortOffsets(struct offsetArray *offsets,
+ *                                            long totalLines, int numThreads) --
+ * The -C mode version of multiThreadSort(): sorts the lines
+ * referenced by offsets indexes (0 - totalLines) in separate threads,
+ * then merges the sorted ranges back together in separate threads.
+ * Returns a pointer to the sorted array, which is either offsets or a
+ * new array of the same size; the other array is unmapped.
+*/
+struct offsetArray *multiThreadSortOffsets(struct offsetArray *offsets,
+											long totalLines, int numThreads) {
+
+	// Sort/merge variables
+	int i, result;
+	struct threadParams *params;
+
+	// pthread variable declarations
+	pthread_t threadID[numThreads];
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	pthread_attr_setscope(&attr, PTHREAD_SCOPE_SYSTEM);
+
+	// Set up auxiliary array for merging and
+	// swapping between two arrays
+	struct offsetArray *auxOffsets = malloc(sizeof(struct offsetArray));
+	if (auxOffsets == NULL) {
+		fprintf(stderr, "ERROR: Out of memory!\n");
+		exit(1);
+	}
+	allocOffsetArray(auxOffsets, totalLines + 1, offsets->width, offsets->buffer);
+	struct offsetArray *inputOffsets = offsets;
+	struct offsetArray *outputOffsets = auxOffsets;
+	struct offsetArray *temp;
+
+	// Break up the array and sort each part
+	for (i = 0; i < numThreads; i++) {
+		params = malloc(sizeof(struct threadParams));
+		if (params == NULL) {
+			fprintf(stderr, "ERROR: Out of memory!\n");
+			exit(1);
+		}
+		params->inputOffsets = inputOffsets;
+		params->lower = i * totalLines / numThreads;
+		params->upper = (i + 1) * totalLines / numThreads - 1;
+
+		result = pthread_create(&threadID[i], &attr, threadQuicksortOffsets, (void *) params);
+
+		if (result != 0) {
+			fprintf(stderr, "pthread_create failed, result = %d\n", result);
+			exit(1);
+		}
+	}
+
+	// Wait for all threads to exit
+	for (i = 0; i < numThreads; i++) {
+
+		result = pthread_join(threadID[i], NULL);
+
+		if ( result != 0 ) {
+			fprintf(stderr, "join with worker %ld failed, error = %d\n",
+					(long) threadID[i], result);
+			exit(1);
+		}
+	}
+
+	// Merge until all lines are sorted
+	int numMerges = numThreads / 2;
+	while (numMerges > 0) {
+
+		// Create new threads for merging
+		for (i = 0; i < numMerges; i++) {
+			params = malloc(sizeof(struct threadParams));
+			if (params == NULL) {
+				fprintf(stderr, "ERROR: Out of memory!\n");
+				exit(1);
+			}
+			params->inputOffsets = inputOffsets;
+			params->outputOffsets = outputOffsets;
+			params->lower = i * totalLines / numMerges;
+			params->mid = (2 * i + 1) * totalLines / (2 * numMerges);
+			params->upper = (i + 1) * totalLines / numMerges - 1;
+
+			result = pthread_create(&threadID[i], &attr, threadMergeOffsets, (void *) params);
+
+			if (result != 0) {
+				fprintf(stderr, "pthread_create failed, result = %d\n", result);
+				exit(1);
+			}
+		}
+
+		// Wait for all threads to exit
+		for (i = 0; i < numMerges; i++) {
+
+			result = pthread_join(threadID[i], NULL);
+
+			if ( result != 0 ) {
+				fprintf(stderr, "join with worker %ld failed, error = %d\n",
+						(long) threadID[i], result);
+				exit(1);
+			}
+		}
+
+		// Swap input and output array pointers
+		temp = inputOffsets;
+		inputOffsets = outputOffsets;
+		outputOffsets = temp;
+
+		// Reset number of merges left
+		numMerges = numMerges / 2;
+	}
+
+	// Cleanup memory from merge operations, keeping the
+	// struct that was passed in for the sorted array
+	munmap(outputOffsets->data, (totalLines + 1) * outputOffsets->width);
+	if (inputOffsets == auxOffsets) {
+		offsets->data = auxOffsets->data;
+	}
+	free(auxOffsets);
+
+	// Return the sorted array
+	return offsets;
+}
+
+/*
+ * void *threadQuicksortOffsets(void *arg) -- A middleman method
+ * for calling quicksortOffsets in a separate thread.
+ * Sets the arguments for quicksortOffsets() from the struct pointer
+ * specified by arg.
+*/
+void *threadQuicksortOffsets(void *arg) {
+	// Cast arg to threadParams*
+	struct threadParams *params = (struct threadParams*) arg;
+
+	// Call quicksortOffsets() with the given arguments
+	quicksortOffsets(params->inputOffsets, params->lower, params->upper);
+
+	// Free params from memory
+	free(params);
+
+	// Exit thread
+	pthread_exit( NULL );
+}
+
+/*
+ * void *threadMergeOffsets(void *arg) -- A middleman method
+ * for calling mergeOffsets in a separate thread.
+ * Sets the arguments for mergeOffsets() from the struct pointer
+ * specified by arg.
+*/
+void *threadMergeOffsets(void *arg) {
+	// Cast arg to threadParams*
 	struct threadParams *params = (struct threadParams*) arg;
 
-	// Call merge() with the given arguments
-	quicksort(params->inputArray, params->lower, params->upper);
+	// Call mergeOffsets() with the given arguments
+	mergeOffsets(params->inputOffsets, params->outputOffsets,
+			params->lower, params->mid, params->upper);
+
+	// Free params from memory
+	free(params);
+
+	// Exit thread
+	pthread_exit( NULL );
+}
+
+/* void mergeOffsets(struct offsetArray *inputOffsets, struct offsetArray *outputOffsets,
+ *                   long lower, long mid, long upper) --
+ * The -C mode version of merge(): copies the offsets in inputOffsets
+ * indexes lower to upper (inclusive) to outputOffsets in sorted order,
+ * given that indexes lower to mid-1 and mid to upper are each sorted.
+*/
+void mergeOffsets(struct offsetArray *inputOffsets, struct offsetArray *outputOffsets,
+					long lower, long mid, long upper) {
+
+	// Set up loop variables
+	long i = lower;
+	long j = mid;
+	long k;
+
+	// Merge values
+	for (k = lower; k <= upper; k++) {
+		if (i < mid && j <= upper) {
+			if (strcmp(offsetLine(inputOffsets, i), offsetLine(inputOffsets, j)) <= 0) {
+				setOffset(outputOffsets, k, getOffset(inputOffsets, i));
+				i++;
+			}
+			else {
+				setOffset(outputOffsets, k, getOffset(inputOffsets, j));
+				j++;
+			}
+		}
+		else if (i >= mid) {
+			setOffset(outputOffsets, k, getOffset(inputOffsets, j));
+			j++;
+		}
+		else {
+			setOffset(outputOffsets, k, getOffset(inputOffsets, i));
+			i++;
+		}
+	}
+}
+
+/* void quicksortOffsets(struct offsetArray *offsets, long lower, long upper) --
+ * The -C mode version of quicksort(): recursively sorts the
+ * offsets between and including indexes lower and upper by
+ * the lines they refer to.
+*/
+void quicksortOffsets(struct offsetArray *offsets, long lower, long upper) {
+	if (lower < upper) {
+		// Partition range
+		long pivot = partitionOffsets(offsets, lower, upper);
+		// Call quicksort again on each range around pivot
+		quicksortOffsets(offsets, lower, pivot - 1);
+		quicksortOffsets(offsets, pivot + 1, upper);
+	}
+}
+
+/* long partitionOffsets(struct offsetArray *offsets, long lower, long upper) --
+ * The -C mode version of partition(): partitions the offsets between
+ * and including indexes lower and upper around a 'median of 3' pivot.
+ * Returns pivot index
+*/
+long partitionOffsets(struct offsetArray *offsets, long lower, long upper) {
+
+	//Select the optimal pivot index
+	long pivot = selectPivotOffsets(offsets, lower, upper);
+
+	// Move pivot to the end
+	swapOffsets(offsets, pivot, upper);
+
+	// Save value of pivot string for comparison
+	char *pivotStr = offsetLine(offsets, upper);
+
+	// Variable to keep track of how many strings equivalent
+	// to the pivot we encounter
+	long eqLines = 0;
+
+	long j;
+	int strcmpRetVal;
+	long currIndex = lower - 1;
+
+	// Move the values relative to the pivot
+	for (j = lower; j <= upper - 1; j++) {
+		strcmpRetVal = strcmp(offsetLine(offsets, j), pivotStr);
+		if (strcmpRetVal < 0) {
+			currIndex++;
+			swapOffsets(offsets, currIndex, j);
+		}
+		else if (strcmpRetVal == 0) {
+			// Alternate which side equivalent lines are moved
+			eqLines++;
+			if (eqLines % 2 == 0) {
+				currIndex++;
+				swapOffsets(offsets, currIndex, j);
+			}
+		}
+	}
+
+	// Move pivot back
+	swapOffsets(offsets, currIndex + 1, upper);
+
+	// Return pivot index
+	return currIndex + 1;
+}
+
+/* long selectPivotOffsets(struct offsetArray *offsets, long lower, long upper) --
+ * The -C mode version of selectPivot(): returns the index of the
+ * 'median of 3' between and including lower and upper, or upper
+ * if the range is 10 or smaller.
+*/
+long selectPivotOffsets(struct offsetArray *offsets, long lower, long upper) {
+
+	// Abort if range is too small
+	if (upper - lower <= 10)
+		return upper;
+
+	// Set midpoint
+	long mid = (upper + lower) / 2;
+
+	// Sort the three values
+	if (strcmp(offsetLine(offsets, mid), offsetLine(offsets, lower)) < 0)
+		swapOffsets(offsets, lower, mid);
+	if (strcmp(offsetLine(offsets, upper), offsetLine(offsets, lower)) < 0)
+		swapOffsets(offsets, lower, upper);
+	if (strcmp(offsetLine(offsets, upper), offsetLine(offsets, mid)) < 0)
+		swapOffsets(offsets, mid, upper);
+
+	// Return index of median value
+	return mid;
+}
+
+/* void swapOffsets(struct offsetArray *offsets, long indexA, long indexB) --
+ * Swaps the offsets at indexA and indexB in offsets with one another.
+*/
+void swapOffsets(struct offsetArray *offsets, long indexA, long indexB) {
+	uint64_t temp = getOffset(offsets, indexA);
+	setOffset(offsets, indexA, getOffset(offsets, indexB));
+	setOffset(offsets, indexB, temp);
+}
+
+/*
+ * uint64_t getOffset(struct offsetArray *offsets, long index) --
+ * Returns the offset stored at index in offsets. Offsets are stored in
+ * the low-order bytes first, as on the little-endian machines this runs on.
+*/
+uint64_t getOffset(struct offsetArray *offsets, long index) {
+	unsigned char *entry = offsets->data + index * offsets->width;
+
+	// Fixed-size copies compile to single loads
+	if (offsets->width == 4) {
+		uint32_t offset;
+		memcpy(&offset, entry, 4);
+		return offset;
+	}
+	uint64_t offset = 0;
+	memcpy(&offset, entry, 5);
+	return offset;
+}
+
+/*
+ * void setOffset(struct offsetArray *offsets, long index, uint64_t offset) --
+ * Stores offset at index in offsets.
+*/
+void setOffset(struct offsetArray *offsets, long index, uint64_t offset) {
+	unsigned char *entry = offsets->data + index * offsets->width;
+
+	if (offsets->width == 4) {
+		uint32_t shortOffset = offset;
+		memcpy(entry, &shortOffset, 4);
+	}
+	else {
+		memcpy(entry, &offset, 5);
+	}
+}
+
+/*
+ * char *offsetLine(struct offsetArray *offsets, long index) --
+ * Returns a pointer to the line referred to by the offset at index in offsets.
+*/
+char *offsetLine(struct offsetArray *offsets, long index) {
+	return offsets->buffer + getOffset(offsets, index);
+}
+
+/*
+ * void allocOffsetArray(struct offsetArray *offsets, long len, int width, char *buffer) --
+ * Sets up offsets as a new array of len offsets of width bytes into buffer,
+ * mapped and backed by transparent huge pages like allocLineArray().
+ * The array must be released by unmapping len * width bytes of its data.
+*/
+void allocOffsetArray(struct offsetArray *offsets, long len, int width, char *buffer) {
+
+	// Map the new array
+	void *memoryBuffer = mmap(	NULL, len * width, PROT_READ | PROT_WRITE,
+								MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+	if ( memoryBuffer == MAP_FAILED ) {
+  		fprintf(stderr, "errno is %d\n", errno);
+  		perror("memoryBuffer is MAP_FAILED ");
+  		exit(1);
+	}
+
+	// Huge pages are only a hint, so ignore failure
+	madvise(memoryBuffer, len * width, MADV_HUGEPAGE);
+
+	offsets->data = (unsigned char*) memoryBuffer;
+	offsets->width = width;
+	offsets->buffer = buffer;
+}
+
+/*
+ * void indexOffsets(char *buffer, long lower, long upper,
+ *                   struct offsetArray *offsets, long firstLine) --
+ * The -C mode version of indexLines(): terminates each line that starts
+ * between index lower and upper-1 (inclusive) in buffer with '\0', and
+ * stores its offset in offsets, beginning at index firstLine.
+*/
+void indexOffsets(char *buffer, long lower, long upper,
+					struct offsetArray *offsets, long firstLine) {
+	char *curr = buffer + lower;
+	char *end = buffer + upper;
+	char *newline;
+	long lineIndex = firstLine;
+
+	// Terminate each line and add its offset to the array
+	while (curr < end) {
+		setOffset(offsets, lineIndex, curr - buffer);
+		lineIndex++;
+		newline = memchr(curr, '\n', end - curr);
+		if (newline == NULL)
+			break;
+		*newline = '\0';
+		curr = newline + 1;
+	}
+}
+
+#ifdef HAVE_IO_URING
+
+/*
+ * int ringSetup(struct ioRing *ring, unsigned entries) --
+ * Creates an io_uring instance with room for entries requests
+ * and maps its submission and completion queues into ring.
+ * Returns 0 on success, or -1 if io_uring is not available or cannot
+ * read and write, in which case the caller falls back to read() and write().
+*/
+int ringSetup(struct ioRing *ring, unsigned entries) {
+	struct io_uring_params setup;
+	memset(&setup, 0, sizeof(setup));
+
+	// Create the ring; old kernels and sandboxes may refuse
+	ring->fd = syscall(__NR_io_uring_setup, entries, &setup);
+	if (ring->fd < 0)
+		return -1;
+	if (ringProbe(ring->fd) < 0) {
+		close(ring->fd);
+		return -1;
+	}
+
+	// Map the submission queue, its array of entries, and the completion queue
+	ring->sqLen = setup.sq_off.array + setup.sq_entries * sizeof(unsigned);
+	ring->cqLen = setup.cq_off.cqes + setup.cq_entries * sizeof(struct io_uring_cqe);
+	ring->sqesLen = setup.sq_entries * sizeof(struct io_uring_sqe);
+	ring->sqPtr = mmap(NULL, ring->sqLen, PROT_READ | PROT_WRITE,
+						MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+	ring->cqPtr = mmap(NULL, ring->cqLen, PROT_READ | PROT_WRITE,
+						MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+	ring->sqes = mmap(NULL, ring->sqesLen, PROT_READ | PROT_WRITE,
+						MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+	if (ring->sqPtr == MAP_FAILED || ring->cqPtr == MAP_FAILED ||
+			ring->sqes == MAP_FAILED) {
+		close(ring->fd);
+		return -1;
+	}
+
+	char *sq = (char*) ring->sqPtr;
+	char *cq = (char*) ring->cqPtr;
+	ring->sqHead = (unsigned*) (sq + setup.sq_off.head);
+	ring->sqTail = (unsigned*) (sq + setup.sq_off.tail);
+	ring->sqMask = (unsigned*) (sq + setup.sq_off.ring_mask);
+	ring->sqArray = (unsigned*) (sq + setup.sq_off.array);
+	ring->cqHead = (unsigned*) (cq + setup.cq_off.head);
+	ring->cqTail = (unsigned*) (cq + setup.cq_off.tail);
+	ring->cqMask = (unsigned*) (cq + setup.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe*) (cq + setup.cq_off.cqes);
+	return 0;
+}
+
+/*
+ * int ringProbe(int ringFd) --
+ * Asks the kernel which operations the ring ringFd supports.
+ * Kernels 5.1 to 5.5 create rings but fail IORING_OP_READ and
+ * IORING_OP_WRITE; they also lack the probe, so it fails there too.
+ * Returns 0 if both operations are supported, or -1 if not.
+*/
+int ringProbe(int ringFd) {
+	int numOps = IORING_OP_WRITE + 1;
+	int probeLen = sizeof(struct io_uring_probe) + numOps * sizeof(struct io_uring_probe_op);
+	struct io_uring_probe *probe = calloc(1, probeLen);
+	if (probe == NULL)
+		return -1;
+
+	int result = -1;
+	if (syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_PROBE, probe, numOps) == 0 &&
+			probe->ops_len > IORING_OP_WRITE &&
+			(probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED) &&
+			(probe->ops[IORING_OP_WRITE].flags & IO_URING_OP_SUPPORTED))
+		result = 0;
+	free(probe);
+	return result;
+}
+
+/*
+ * void ringClose(struct ioRing *ring) --
+ * Unmaps the queues of ring and closes it.
+*/
+void ringClose(struct ioRing *ring) {
+	munmap(ring->sqes, ring->sqesLen);
+	munmap(ring->cqPtr, ring->cqLen);
+	munmap(ring->sqPtr, ring->sqLen);
+	close(ring->fd);
+}
+
+/*
+ * void ringSubmit(struct ioRing *ring, int opcode, int fd, char *buf,
+ *                 unsigned len, long offset, unsigned long userData) --
+ * Queues a read or write (opcode IORING_OP_READ or IORING_OP_WRITE)
+ * of len bytes between buf and fd at offset, or at the current file
+ * position if offset is -1, and hands it to the kernel.
+ * userData is returned with the request's completion.
+*/
+void ringSubmit(struct ioRing *ring, int opcode, int fd, char *buf,
+				unsigned len, long offset, unsigned long userData) {
+
+	// Fill in the next submission queue entry
+	unsigned tail = *ring->sqTail;
+	unsigned index = tail & *ring->sqMask;
+	struct io_uring_sqe *sqe = &ring->sqes[index];
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = opcode;
+	sqe->fd = fd;
+	sqe->addr = (unsigned long) buf;
+	sqe->len = len;
+	sqe->off = offset;
+	sqe->user_data = userData;
+	ring->sqArray[index] = index;
+
+	// Publish the entry before the kernel can see the new tail
+	__atomic_store_n(ring->sqTail, tail + 1, __ATOMIC_RELEASE);
+
+	// Submit it without waiting for completion
+	while (syscall(__NR_io_uring_enter, ring->fd, 1, 0, 0, NULL, 0) < 0) {
+		if (errno != EINTR && errno != EAGAIN) {
+			perror("io_uring_enter");
+			exit(1);
+		}
+	}
+}
+
+/*
+ * int ringReap(struct ioRing *ring, unsigned long *userData) --
+ * Waits for the next request on ring to complete, and sets userData
+ * to the value it was submitted with.
+ * Returns the result of the request: the number of bytes transferred,
+ * or a negative errno value.
+*/
+int ringReap(struct ioRing *ring, unsigned long *userData) {
+	unsigned head = *ring->cqHead;
+
+	// Wait until the kernel posts a completion
+	while (head == __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE)) {
+		if (syscall(__NR_io_uring_enter, ring->fd, 0, 1,
+					IORING_ENTER_GETEVENTS, NULL, 0) < 0 && errno != EINTR) {
+			perror("io_uring_enter");
+			exit(1);
+		}
+	}
+
+	// Take the completion and hand its slot back to the kernel
+	struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cqMask];
+	*userData = cqe->user_data;
+	int result = cqe->res;
+	__atomic_store_n(ring->cqHead, head + 1, __ATOMIC_RELEASE);
+	return result;
+}
+
+#else
+
+/*
+ * Without the io_uring headers, ringSetup() always fails so the callers
+ * fall back to read() and write(), and the rest are never reached.
+*/
+int ringSetup(struct ioRing *ring, unsigned entries) {
+	return -1;
+}
+
+int ringProbe(int ringFd) {
+	return -1;
+}
+
+void ringClose(struct ioRing *ring) {
+}
+
+void ringSubmit(struct ioRing *ring, int opcode, int fd, char *buf,
+				unsigned len, long offset, unsigned long userData) {
+}
+
+int ringReap(struct ioRing *ring, unsigned long *userData) {
+	return -ENOSYS;
+}
+
+#endif
+
+/*
+ * long ringReadFile(int fd, char *buffer, long len) --
+ * Reads the first len bytes of the file fd into buffer using io_uring,
+ * keeping IO_QUEUE_DEPTH reads of IO_CHUNK_SIZE bytes in flight so the
+ * device always has work queued.
+ * Returns the number of bytes read, which is less than len if the file
+ * ended early, or -1 if io_uring is not available.
+*/
+long ringReadFile(int fd, char *buffer, long len) {
+	struct ioRing ring;
+	if (ringSetup(&ring, IO_QUEUE_DEPTH) < 0)
+		return -1;
+
+	// Each slot holds the part of its chunk that is still to be read
+	long slotOffset[IO_QUEUE_DEPTH];
+	long slotLen[IO_QUEUE_DEPTH];
+	long nextOffset = 0;
+	long endOfFile = len;
+	int inFlight = 0;
+	int slot;
+
+	// Start a read of the next chunk in each slot
+	for (slot = 0; slot < IO_QUEUE_DEPTH && nextOffset < len; slot++) {
+		slotOffset[slot] = nextOffset;
+		slotLen[slot] = len - nextOffset < IO_CHUNK_SIZE ? len - nextOffset : IO_CHUNK_SIZE;
+		nextOffset += slotLen[slot];
+		ringSubmit(&ring, IORING_OP_READ, fd, buffer + slotOffset[slot],
+					slotLen[slot], slotOffset[slot], slot);
+		inFlight++;
+	}
+
+	// Refill each slot as its read completes
+	while (inFlight > 0) {
+		unsigned long userData;
+		int result = ringReap(&ring, &userData);
+		slot = userData;
+		inFlight--;
+
+		if (result == -EINTR || result == -EAGAIN) {
+			// Retry the same read
+			result = 0;
+		}
+		else if (result < 0) {
+			errno = -result;
+			perror("read");
+			exit(1);
+		}
+		else if (result == 0) {
+			// The file is shorter than when it was opened
+			if (slotOffset[slot] < endOfFile)
+				endOfFile = slotOffset[slot];
+			continue;
+		}
+		slotOffset[slot] += result;
+		slotLen[slot] -= result;
+
+		// Finish a short read, or move on to the next chunk
+		if (slotLen[slot] == 0 && nextOffset < len) {
+			slotOffset[slot] = nextOffset;
+			slotLen[slot] = len - nextOffset < IO_CHUNK_SIZE ? len - nextOffset : IO_CHUNK_SIZE;
+			nextOffset += slotLen[slot];
+		}
+		if (slotLen[slot] > 0) {
+			ringSubmit(&ring, IORING_OP_READ, fd, buffer + slotOffset[slot],
+						slotLen[slot], slotOffset[slot], slot);
+			inFlight++;
+		}
+	}
+
+	ringClose(&ring);
+	return endOfFile;
+}
+
+/*
+ * void outputOpen(struct outputStream *out, int useRing) --
+ * Sets up out to write to standard output in IO_CHUNK_SIZE chunks,
+ * using io_uring if useRing is set and it is available, or else
+ * plain write() calls. Any output buffered by printf() is flushed first.
+ * If standard output is a regular file, up to IO_QUEUE_DEPTH writes are
+ * kept in flight at their own offsets; otherwise, such as for a pipe or
+ * a file opened with O_APPEND (where Linux ignores the offsets), one
+ * write at a time is kept in flight so the output stays in order.
+*/
+void outputOpen(struct outputStream *out, int useRing) {
+	fflush(stdout);
+
+	// Create a buffer for each write that may be in flight
+	int slot;
+	for (slot = 0; slot < IO_QUEUE_DEPTH; slot++) {
+		out->buffers[slot] = malloc(IO_CHUNK_SIZE);
+		if (out->buffers[slot] == NULL) {
+			fprintf(stderr, "ERROR: Out of memory!\n");
+			exit(1);
+		}
+		out->busy[slot] = 0;
+	}
+	out->current = 0;
+	out->fill = 0;
+	out->inFlight = 0;
+
+	// Write at explicit offsets if standard output can seek and is not appending
+	struct stat outStat;
+	int outFlags = fcntl(STDOUT_FILENO, F_GETFL);
+	out->offset = -1;
+	if (fstat(STDOUT_FILENO, &outStat) == 0 && S_ISREG(outStat.st_mode) &&
+			outFlags >= 0 && !(outFlags & O_APPEND))
+		out->offset = lseek(STDOUT_FILENO, 0, SEEK_CUR);
+	out->maxInFlight = out->offset >= 0 ? IO_QUEUE_DEPTH : 1;
+
+	out->useRing = useRing && ringSetup(&out->ring, IO_QUEUE_DEPTH) == 0;
+}
+
+/*
+ * void outputWrite(struct outputStream *out, char *data, long len) --
+ * Copies len bytes of data to out, writing each buffer as it fills.
+*/
+void outputWrite(struct outputStream *out, char *data, long len) {
+	while (len > 0) {
+		long space = IO_CHUNK_SIZE - out->fill;
+		long copyLen = len < space ? len : space;
+		memcpy(out->buffers[out->current] + out->fill, data, copyLen);
+		out->fill += copyLen;
+		data += copyLen;
+		len -= copyLen;
+
+		if (out->fill == IO_CHUNK_SIZE)
+			outputFlush(out);
+	}
+}
+
+/*
+ * void outputFlush(struct outputStream *out) --
+ * Starts writing the current buffer of out, then moves on to the next
+ * buffer, waiting for its earlier write to finish if it is still in flight.
+ * Without io_uring, the buffer is written with write() before returning.
+*/
+void outputFlush(struct outputStream *out) {
+	if (out->fill == 0)
+		return;
+
+	if (!out->useRing) {
+		// Write the buffer synchronously
+		char *data = out->buffers[out->current];
+		long len = out->fill;
+		while (len > 0) {
+			ssize_t result = write(STDOUT_FILENO, data, len);
+			if (result < 0 && errno == EINTR)
+				continue;
+			if (result < 0) {
+				perror("write");
+				exit(1);
+			}
+			data += result;
+			len -= result;
+		}
+		out->fill = 0;
+		return;
+	}
+
+	// Start the write, then claim the offset it covers
+	int slot = out->current;
+	out->busy[slot] = 1;
+	out->slotData[slot] = out->buffers[slot];
+	out->slotLen[slot] = out->fill;
+	out->slotOffset[slot] = out->offset;
+	ringSubmit(&out->ring, IORING_OP_WRITE, STDOUT_FILENO, out->slotData[slot],
+				out->slotLen[slot], out->slotOffset[slot], slot);
+	out->inFlight++;
+	if (out->offset >= 0)
+		out->offset += out->fill;
+
+	// Move to the next buffer once it is free
+	out->current = (out->current + 1) % IO_QUEUE_DEPTH;
+	out->fill = 0;
+	while (out->busy[out->current] || out->inFlight >= out->maxInFlight)
+		outputReap(out);
+}
+
+/*
+ * void outputReap(struct outputStream *out) --
+ * Waits for one write of out to complete, and starts it again
+ * for the remaining bytes if it was cut short.
+*/
+void outputReap(struct outputStream *out) {
+	unsigned long userData;
+	int result = ringReap(&out->ring, &userData);
+	int slot = userData;
+
+	if (result == -EINTR || result == -EAGAIN) {
+		// Retry the same write
+		result = 0;
+	}
+	else if (result < 0) {
+		errno = -result;
+		perror("write");
+		exit(1);
+	}
+	out->slotData[slot] += result;
+	out->slotLen[slot] -= result;
+	if (out->slotOffset[slot] >= 0)
+		out->slotOffset[slot] += result;
+
+	if (out->slotLen[slot] > 0) {
+		// Write the rest of the buffer
+		ringSubmit(&out->ring, IORING_OP_WRITE, STDOUT_FILENO, out->slotData[slot],
+					out->slotLen[slot], out->slotOffset[slot], slot);
+	}
+	else {
+		out->busy[slot] = 0;
+		out->inFlight--;
+	}
+}
+
+/*
+ * void outputClose(struct outputStream *out) --
+ * Writes anything left in out, waits for all its writes to
+ * finish, and frees its buffers.
+*/
+void outputClose(struct outputStream *out) {
+	outputFlush(out);
+
+	if (out->useRing) {
+		while (out->inFlight > 0)
+			outputReap(out);
+		ringClose(&out->ring);
+
+		// Writes at explicit offsets do not move the file position
+		if (out->offset >= 0)
+			lseek(STDOUT_FILENO, out->offset, SEEK_SET);
+	}
+
+	int slot;
+	for (slot = 0; slot < IO_QUEUE_DEPTH; slot++)
+		free(out->buffers[slot]);
+}
+
+/*
+ * void writeOutputFile(char **linesArray, long totalLines, struct lineTable *table,
+ *                      int numThreads, char *fileName) --
+ * Writes the sorted lines in linesArray indexes (0 - totalLines) to the
+ * file fileName using numThreads threads, each writing its own slice.
+ * The threads first measure the bytes of their slice; a prefix sum over
+ * the sizes gives each slice its offset in the file, which is allocated
+ * at its final size before the threads pwrite() their slices at once.
+ * If table is not NULL, each line is prefixed with its count as in -c.
+*/
+void writeOutputFile(char **linesArray, long totalLines, struct lineTable *table,
+						int numThreads, char *fileName) {
+
+	// Open the output file for writing
+	int fd = open(fileName, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		fprintf(stderr, "The file \'%s\' could not be opened for writing.\n", fileName);
+		exit(1);
+	}
+
+	// pthread variable declarations
+	int i, result;
+	struct writeParams params[numThreads];
+	pthread_t threadID[numThreads];
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	pthread_attr_setscope(&attr, PTHREAD_SCOPE_SYSTEM);
+
+	// Break up the array and measure the size of each slice
+	for (i = 0; i < numThreads; i++) {
+		params[i].linesArray = linesArray;
+		params[i].table = table;
+		params[i].fd = fd;
+		params[i].worker = i;
+		params[i].lower = i * totalLines / numThreads;
+		params[i].upper = (i + 1) * totalLines / numThreads;
+
+		// A single slice is measured without starting a thread
+		if (numThreads == 1) {
+			params[i].numBytes = sliceSize(linesArray, params[i].lower,
+										params[i].upper, table);
+			break;
+		}
+
+		result = pthread_create(&threadID[i], &attr, threadSliceSize, (void *) &params[i]);
+
+		if (result != 0) {
+			fprintf(stderr, "pthread_create failed, result = %d\n", result);
+			exit(1);
+		}
+	}
+
+	// Wait for all threads to exit
+	for (i = 0; numThreads > 1 && i < numThreads; i++) {
+
+		result = pthread_join(threadID[i], NULL);
+
+		if ( result != 0 ) {
+			fprintf(stderr, "join with worker %ld failed, error = %d\n",
+					(long) threadID[i], result);
+			exit(1);
+		}
+	}
+
+	// Prefix sum of the slice sizes gives the offset of each slice
+	long fileSize = 0;
+	for (i = 0; i < numThreads; i++) {
+		params[i].offset = fileSize;
+		fileSize += params[i].numBytes;
+	}
+
+	// Allocate the whole file up front, where the file system supports it
+	if (fileSize > 0 && fallocate(fd, 0, 0, fileSize) < 0 &&
+			errno != EOPNOTSUPP && errno != ENOSYS) {
+		perror("fallocate");
+		exit(1);
+	}
+
+	// Write each slice at its offset
+	for (i = 0; i < numThreads; i++) {
+
+		// A single slice is written without starting a thread
+		if (numThreads == 1) {
+			statsAttach(0, params[i].upper - params[i].lower);
+			writeSlice(linesArray, params[i].lower, params[i].upper,
+						table, fd, params[i].offset);
+			break;
+		}
+
+		result = pthread_create(&threadID[i], &attr, threadWriteSlice, (void *) &params[i]);
+
+		if (result != 0) {
+			fprintf(stderr, "pthread_create failed, result = %d\n", result);
+			exit(1);
+		}
+	}
+
+	// Wait for all threads to exit
+	for (i = 0; numThreads > 1 && i < numThreads; i++) {
+
+		result = pthread_join(threadID[i], NULL);
+
+		if ( result != 0 ) {
+			fprintf(stderr, "join with worker %ld failed, error = %d\n",
+					(long) threadID[i], result);
+			exit(1);
+		}
+	}
+
+	close(fd);
+}
+
+/*
+ * void *threadSliceSize(void *arg) -- A middleman method
+ * for calling sliceSize in a separate thread.
+ * Sets the arguments for sliceSize() from the struct pointer
+ * specified by arg, and stores the result in its numBytes field.
+*/
+void *threadSliceSize(void *arg) {
+	// Cast arg to writeParams*
+	struct writeParams *params = (struct writeParams*) arg;
+
+	// Call sliceSize() with the given arguments
+	params->numBytes = sliceSize(params->linesArray, params->lower,
+								params->upper, params->table);
+
+	// Exit thread
+	pthread_exit( NULL );
+}
+
+/*
+ * void *threadWriteSlice(void *arg) -- A middleman method
+ * for calling writeSlice in a separate thread.
+ * Sets the arguments for writeSlice() from the struct pointer
+ * specified by arg.
+*/
+void *threadWriteSlice(void *arg) {
+	// Cast arg to writeParams*
+	struct writeParams *params = (struct writeParams*) arg;
+
+	// Call writeSlice() with the given arguments
+	statsAttach(params->worker, params->upper - params->lower);
+	writeSlice(params->linesArray, params->lower, params->upper,
+				params->table, params->fd, params->offset);
+
+	// Exit thread
+	pthread_exit( NULL );
+}
+
+/*
+ * long sliceSize(char **linesArray, long lower, long upper, struct lineTable *table) --
+ * Returns the number of bytes that the lines in linesArray indexes
+ * lower to upper-1 (inclusive) take in the output, including their
+ * newlines and, if table is not NULL, their count prefixes.
+*/
+long sliceSize(char **linesArray, long lower, long upper, struct lineTable *table) {
+	long numBytes = 0;
+	long i;
+
+	for (i = lower; i < upper; i++) {
+		if (table != NULL)
+			numBytes += snprintf(NULL, 0, "%7ld ", lineCount(table, linesArray[i]));
+		numBytes += strlen(linesArray[i]) + 1;
+	}
+
+	return numBytes;
+}
+
+/*
+ * void writeSlice(char **linesArray, long lower, long upper,
+ *                 struct lineTable *table, int fd, long offset) --
+ * Writes the lines in linesArray indexes lower to upper-1 (inclusive)
+ * to the file fd starting at offset, in the same format measured by
+ * sliceSize(), copying them into a buffer that is written with pwrite()
+ * each time it fills.
+*/
+void writeSlice(char **linesArray, long lower, long upper,
+				struct lineTable *table, int fd, long offset) {
+
+	// Create a buffer to collect the lines
+	char *buffer = malloc(IO_CHUNK_SIZE);
+	if (buffer == NULL) {
+		fprintf(stderr, "ERROR: Out of memory!\n");
+		exit(1);
+	}
+	long fill = 0;
+	char countStr[32];
+
+	long i;
+	for (i = lower; i < upper; i++) {
+		// Pieces of the line to write: its count, its text and a newline
+		char *pieces[3];
+		long pieceLens[3];
+		int numPieces = 0;
+		if (table != NULL) {
+			pieces[numPieces] = countStr;
+			pieceLens[numPieces] = sprintf(countStr, "%7ld ",
+											lineCount(table, linesArray[i]));
+			numPieces++;
+		}
+		pieces[numPieces] = linesArray[i];
+		pieceLens[numPieces] = strlen(linesArray[i]);
+		numPieces++;
+		pieces[numPieces] = "\n";
+		pieceLens[numPieces] = 1;
+		numPieces++;
+
+		// Copy each piece, writing the buffer whenever it is full
+		int p;
+		for (p = 0; p < numPieces; p++) {
+			char *data = pieces[p];
+			long len = pieceLens[p];
+			while (len > 0) {
+				long space = IO_CHUNK_SIZE - fill;
+				long copyLen = len < space ? len : space;
+				memcpy(buffer + fill, data, copyLen);
+				fill += copyLen;
+				data += copyLen;
+				len -= copyLen;
+
+				if (fill == IO_CHUNK_SIZE) {
+					pwriteAll(fd, buffer, fill, offset);
+					offset += fill;
+					fill = 0;
+
+					// Publish the progress of the slice
+					if (workerStats != NULL) {
+						workerStats->linesDone = i - lower;
+						workerStats->bytesWritten += IO_CHUNK_SIZE;
+					}
+				}
+			}
+		}
+	}
+
+	// Write what is left in the buffer
+	pwriteAll(fd, buffer, fill, offset);
+	free(buffer);
+	if (workerStats != NULL) {
+		workerStats->linesDone = upper - lower;
+		workerStats->bytesWritten += fill;
+	}
+}
+
+/*
+ * void pwriteAll(int fd, char *data, long len, long offset) --
+ * Writes len bytes of data to the file fd at offset,
+ * retrying until all of them are written.
+*/
+void pwriteAll(int fd, char *data, long len, long offset) {
+	while (len > 0) {
+		ssize_t result = pwrite(fd, data, len, offset);
+		if (result < 0 && errno == EINTR)
+			continue;
+		if (result < 0) {
+			perror("pwrite");
+			exit(1);
+		}
+		data += result;
+		len -= result;
+		offset += result;
+	}
+}
+
+/*
+ * int autoReadThreads() --
+ * Returns the number of threads to read the file with in auto mode:
+ * the largest power of 2 (max 16) that is no more than the number of
+ * online processors.
+*/
+int autoReadThreads() {
+	long numCpus = sysconf(_SC_NPROCESSORS_ONLN);
+	int numThreads = 1;
+	while (numThreads * 2 <= numCpus && numThreads < 16)
+		numThreads *= 2;
+	return numThreads;
+}
+
+/*
+ * void autoTune(char **linesArray, long totalLines, long fileSize,
+ *               int maxThreads, int parallelMode, struct autoConfig *config) --
+ * Samples AUTO_SAMPLE_SIZE evenly spaced lines of linesArray and reads
+ * the processor, cache and NUMA topology of the machine, then sets
+ * config to the engine, number of threads (at most maxThreads) and
+ * insertion sort cutoff to sort with. Prints the decision and the
+ * measurements behind it to stderr, naming parallelQuicksort() as the
+ * threaded engine if parallelMode (-P) is set.
+*/
+void autoTune(char **linesArray, long totalLines, long fileSize,
+				int maxThreads, int parallelMode, struct autoConfig *config) {
+
+	// Read the machine topology
+	long numCpus = sysconf(_SC_NPROCESSORS_ONLN);
+	long cacheSize = sysconf(_SC_LEVEL2_CACHE_SIZE);
+	int numNodes = numaNodes();
+
+	// Take evenly spaced lines, with the line after each one
+	long numSamples = totalLines - 1 < AUTO_SAMPLE_SIZE ? totalLines - 1 : AUTO_SAMPLE_SIZE;
+	if (numSamples < 0)
+		numSamples = 0;
+	char **sample = malloc((numSamples + 1) * sizeof(char*));
+	if (sample == NULL) {
+		fprintf(stderr, "ERROR: Out of memory!\n");
+		exit(1);
+	}
+	long i;
+	long inOrder = 0;
+	long totalLen = 0;
+	long maxLen = 0;
+	for (i = 0; i < numSamples; i++) {
+		long index = i * (totalLines - 1) / numSamples;
+		sample[i] = linesArray[index];
+
+		// Presortedness: how often a line is not greater than the next
+		if (strcmp(linesArray[index], linesArray[index + 1]) <= 0)
+			inOrder++;
+
+		// Line length distribution
+		long len = strlen(sample[i]);
+		totalLen += len;
+		if (len > maxLen)
+			maxLen = len;
+	}
+
+	// Duplicates and common prefixes show up as neighbours in the sorted sample
+	qsort(sample, numSamples, sizeof(char*), compareStrs);
+	long duplicates = 0;
+	long totalPrefix = 0;
+	for (i = 1; i < numSamples; i++) {
+		long prefix = 0;
+		while (sample[i][prefix] != '\0' && sample[i][prefix] == sample[i - 1][prefix])
+			prefix++;
+		if (sample[i][prefix] == sample[i - 1][prefix])
+			duplicates++;
+		totalPrefix += prefix;
+	}
+	free(sample);
+
+	double sortedRatio = numSamples > 0 ? (double) inOrder / numSamples : 1.0;
+	double dupRatio = numSamples > 1 ? (double) duplicates / (numSamples - 1) : 0.0;
+	double meanPrefix = numSamples > 1 ? (double) totalPrefix / (numSamples - 1) : 0.0;
+	double meanLen = numSamples > 0 ? (double) totalLen / numSamples : 0.0;
+	char *reason;
+
+	// Long common prefixes make the sorting network's prefix keys tie,
+	// so sort small ranges with insertion sort on the whole string instead
+	config->cutoff = meanPrefix < AUTO_LONG_PREFIX ? 0 : NETWORK_SIZE;
+
+	// Largest useful number of threads: one per processor (max 16), but
+	// beyond 8 only when there are NUMA nodes with memory bandwidth to spare,
+	// and never fewer than AUTO_LINES_PER_THREAD lines per thread
+	long threadLimit = numNodes > 1 ? 16 : 8;
+	if (threadLimit > maxThreads)
+		threadLimit = maxThreads;
+	int numThreads = 1;
+	while (numThreads * 2 <= threadLimit &&
+			numThreads * 2 * AUTO_LINES_PER_THREAD <= totalLines)
+		numThreads *= 2;
+
+	if (numSamples > 0 && inOrder == numSamples && isSorted(linesArray, totalLines)) {
+		// Nothing to do if the whole input is in order
+		config->engine = AUTO_ENGINE_NONE;
+		config->numThreads = 1;
+		reason = "input is already sorted";
+	}
+	else if (totalLines * (long) sizeof(char*) + fileSize <= cacheSize) {
+		// Thread start-up costs more than it saves when one core's cache holds the data
+		config->engine = AUTO_ENGINE_SEQUENTIAL;
+		config->numThreads = 1;
+		reason = "lines and array fit in the L2 cache";
+	}
+	else if (numThreads == 1) {
+		config->engine = AUTO_ENGINE_SEQUENTIAL;
+		config->numThreads = 1;
+		reason = numCpus > 1 ? "too few lines to split between threads"
+							: "only one processor is online";
+	}
+	else {
+		config->engine = AUTO_ENGINE_THREADS;
+		config->numThreads = numThreads;
+		reason = "enough lines and processors to sort in parallel";
+	}
+
+	// Log the decision and the measurements behind it
+	fprintf(stderr, "auto: %s with %d thread%s, insertion sort cutoff %ld (%s)\n",
+			config->engine == AUTO_ENGINE_NONE ? "no sort" :
+			config->engine == AUTO_ENGINE_SEQUENTIAL ? "sequential quicksort" :
+			parallelMode ? "parallelQuicksort" : "multiThreadSort", config->numThreads,
+			config->numThreads == 1 ? "" : "s", config->cutoff, reason);
+	fprintf(stderr, "auto: %ld lines, %ld bytes; sample of %ld: %.1f%% in order, "
+			"%.1f%% duplicates, common prefix %.1f, line length mean %.1f max %ld\n",
+			totalLines, fileSize, numSamples, 100 * sortedRatio, 100 * dupRatio,
+			meanPrefix, meanLen, maxLen);
+	fprintf(stderr, "auto: %ld processors, %d NUMA node%s, %ldK L2 cache\n",
+			numCpus, numNodes, numNodes == 1 ? "" : "s", cacheSize / 1024);
+}
+
+/*
+ * int numaNodes() --
+ * Returns the number of NUMA nodes listed in sysfs, or 1 if there are none.
+*/
+int numaNodes() {
+	int numNodes = 0;
+	char path[64];
+	while (numNodes < 1024) {
+		snprintf(path, sizeof(path), "/sys/devices/system/node/node%d", numNodes);
+		if (access(path, F_OK) != 0)
+			break;
+		numNodes++;
+	}
+	return numNodes > 0 ? numNodes : 1;
+}
+
+/*
+ * int isSorted(char **strArray, long totalLines) --
+ * Returns 1 if the strings in strArray indexes (0 - totalLines)
+ * are in sorted order, or 0 if not.
+*/
+int isSorted(char **strArray, long totalLines) {
+	long i;
+	for (i = 1; i < totalLines; i++) {
+		if (strcmp(strArray[i - 1], strArray[i]) > 0)
+			return 0;
+	}
+	return 1;
+}
+
+/*
+ * int compareStrs(const void *a, const void *b) --
+ * Compares the strings pointed to by a and b, for use with qsort().
+*/
+int compareStrs(const void *a, const void *b) {
+	return strcmp(*(char* const*) a, *(char* const*) b);
+}
+
+/* void insertionSort(char **strArray, long lower, long upper) --
+ * Sorts strArray between and including indexes lower and upper
+ * with insertion sort, which beats quicksort on small ranges.
+*/
+void insertionSort(char **strArray, long lower, long upper) {
+	long i, j;
+	for (i = lower + 1; i <= upper; i++) {
+		char *line = strArray[i];
+		for (j = i; j > lower && strcmp(strArray[j - 1], line) > 0; j--)
+			strArray[j] = strArray[j - 1];
+		strArray[j] = line;
+	}
+}
+
+/*
+ * void sortBatch(char *batchFileName, int numThreads) --
+ * Sorts every input file listed in batchFileName into its output file.
+ * Files of at least BATCH_SPLIT_BYTES are sorted one at a time, each
+ * split between numThreads threads as in a normal run. Smaller files
+ * are too small to split, so numThreads workers each take whole files,
+ * largest first, until none are left.
+ * Prints the number of files and the files sorted per second to stderr.
+*/
+void sortBatch(char *batchFileName, int numThreads) {
+
+	// Read the list of files, largest first
+	struct batchJob *jobs;
+	long numJobs = parseBatchFile(batchFileName, &jobs);
+	qsort(jobs, numJobs, sizeof(struct batchJob), compareJobSizes);
+	long numLarge = 0;
+	while (numLarge < numJobs && jobs[numLarge].size >= BATCH_SPLIT_BYTES)
+		numLarge++;
+
+	/* Keep track of start time for
+	 * sort runtime calculation */
+	struct timeval startTime, endTime;
+	int seconds, micros;
+	gettimeofday(&startTime, NULL);
+
+	// Sort the large files with all threads
+	long i;
+	for (i = 0; i < numLarge; i++)
+		sortFile(jobs[i].inputFile, jobs[i].outputFile, numThreads);
+
+	// pthread variable declarations
+	int result;
+	pthread_t threadID[numThreads];
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	pthread_attr_setscope(&attr, PTHREAD_SCOPE_SYSTEM);
+
+	// Share the small files between the workers
+	struct batchParams params;
+	params.jobs = jobs;
+	params.numJobs = numJobs;
+	params.nextJob = numLarge;
+	pthread_mutex_init(&params.lock, NULL);
+	for (i = 0; i < numThreads; i++) {
+
+		result = pthread_create(&threadID[i], &attr, threadBatchWorker, (void *) &params);
+
+		if (result != 0) {
+			fprintf(stderr, "pthread_create failed, result = %d\n", result);
+			exit(1);
+		}
+	}
+
+	// Wait for all threads to exit
+	for (i = 0; i < numThreads; i++) {
+
+		result = pthread_join(threadID[i], NULL);
+
+		if ( result != 0 ) {
+			fprintf(stderr, "join with worker %ld failed, error = %d\n",
+					(long) threadID[i], result);
+			exit(1);
+		}
+	}
+	pthread_mutex_destroy(&params.lock);
+
+	/* Print runtime info to stderr for performance testing */
+	gettimeofday(&endTime, NULL);
+	seconds = endTime.tv_sec  - startTime.tv_sec;
+	micros  = endTime.tv_usec - startTime.tv_usec;
+	if ( endTime.tv_usec < startTime.tv_usec ) {
+		micros += 1000000;
+		seconds--;
+	}
+	fprintf(stderr, "runtime: %d seconds, %d microseconds\n", seconds, micros);
+	double totalSeconds = seconds + micros / 1000000.0;
+	fprintf(stderr, "batch: %ld files (%ld split between threads), %.1f files per second\n",
+			numJobs, numLarge, totalSeconds > 0 ? numJobs / totalSeconds : 0.0);
+
+	// Free the list of files
+	for (i = 0; i < numJobs; i++) {
+		free(jobs[i].inputFile);
+		free(jobs[i].outputFile);
+	}
+	free(jobs);
+}
+
+/*
+ * void *threadBatchWorker(void *arg) --
+ * Runs one worker of the batch mode: takes the next file from the
+ * batchParams specified by arg and sorts it, until none are left.
+*/
+void *threadBatchWorker(void *arg) {
+	// Cast arg to batchParams*
+	struct batchParams *params = (struct batchParams*) arg;
+
+	while (1) {
+		// Take the next file
+		pthread_mutex_lock(&params->lock);
+		long job = params->nextJob;
+		params->nextJob++;
+		pthread_mutex_unlock(&params->lock);
+		if (job >= params->numJobs)
+			break;
+
+		// Sort it in this thread alone
+		sortFile(params->jobs[job].inputFile, params->jobs[job].outputFile, 1);
+	}
+
+	// Exit thread
+	pthread_exit( NULL );
+}
+
+/*
+ * void sortFile(char *inputFile, char *outputFile, int numThreads) --
+ * Reads, sorts and writes the lines of inputFile to outputFile,
+ * using numThreads threads for every step.
+*/
+void sortFile(char *inputFile, char *outputFile, int numThreads) {
+	char *fileBuffer;
+	long fileSize;
+	long totalLines;
+	char **linesArray = readLines(inputFile, numThreads, 0, &fileBuffer,
+									&fileSize, &totalLines, NULL);
+
+	if (numThreads > 1 && totalLines >= numThreads)
+		linesArray = multiThreadSort(linesArray, totalLines, numThreads, 0, 0);
+	else
+		quicksort(linesArray, 0, totalLines - 1);
+
+	writeOutputFile(linesArray, totalLines, NULL, numThreads, outputFile);
+
+	munmap(linesArray, (totalLines + 1) * sizeof(char*));
+	munmap(fileBuffer, fileSize + 1);
+}
+
+/*
+ * long parseBatchFile(char *batchFileName, struct batchJob **jobs) --
+ * Reads the file batchFileName, where each non-empty line holds an input
+ * file and an output file separated by spaces or tabs, and sets jobs to a
+ * new array of the files and their sizes.
+ * Exits if a line is malformed or an input file does not exist, before
+ * any file is sorted.
+ * Returns the number of jobs.
+*/
+long parseBatchFile(char *batchFileName, struct batchJob **jobs) {
+
+	// Open file for reading
+	FILE *batchFile = fopen(batchFileName, "r");
+
+	// Exit if file does not open
+	if (batchFile == NULL) {
+		fprintf(stderr, "The file \'%s\' does not exist.\n", batchFileName);
+		exit(1);
+	}
+
+	long jobsLen = INIT_BATCH_SZ;
+	long numJobs = 0;
+	*jobs = malloc(jobsLen * sizeof(struct batchJob));
+	char *buf = NULL;
+	size_t bufLen = 0;
+	long lineNum = 0;
+	while (*jobs != NULL && getline(&buf, &bufLen, batchFile) != EOF) {
+		lineNum++;
+
+		// Split the line into the input and output file
+		char *savePtr;
+		char *inputFile = strtok_r(buf, " \t\n", &savePtr);
+		char *outputFile = strtok_r(NULL, " \t\n", &savePtr);
+		if (inputFile == NULL)
+			continue;
+		if (outputFile == NULL || strtok_r(NULL, " \t\n", &savePtr) != NULL) {
+			fprintf(stderr, "Error: line %ld of \'%s\' must hold an input and an output file\n",
+					lineNum, batchFileName);
+			exit(1);
+		}
+
+		// Find the size of the input file
+		struct stat fileStat;
+		if (stat(inputFile, &fileStat) < 0) {
+			fprintf(stderr, "The file \'%s\' does not exist.\n", inputFile);
+			exit(1);
+		}
+
+		// Grow the array if it is full
+		if (numJobs == jobsLen) {
+			jobsLen *= 2;
+			*jobs = realloc(*jobs, jobsLen * sizeof(struct batchJob));
+			if (*jobs == NULL)
+				break;
+		}
+		(*jobs)[numJobs].inputFile = strdup(inputFile);
+		(*jobs)[numJobs].outputFile = strdup(outputFile);
+		(*jobs)[numJobs].size = fileStat.st_size;
+		numJobs++;
+	}
+	if (*jobs == NULL) {
+		fprintf(stderr, "ERROR: Out of memory!\n");
+		exit(1);
+	}
+	free(buf);
+	fclose(batchFile);
+
+	return numJobs;
+}
+
+/*
+ * int compareJobSizes(const void *a, const void *b) --
+ * Compares the batchJobs pointed to by a and b, for use with qsort(),
+ * so that larger input files come first.
+*/
+int compareJobSizes(const void *a, const void *b) {
+	long sizeA = ((const struct batchJob*) a)->size;
+	long sizeB = ((const struct batchJob*) b)->size;
+	return (sizeA < sizeB) - (sizeA > sizeB);
+}
+
+/*
+ * void mergeFiles(char **fileNames, int numFiles, int numThreads, char *outputFileName) --
+ * Merges the numFiles already-sorted files in fileNames into one sorted
+ * output, without sorting them again, and writes it to outputFileName,
+ * or to standard output if outputFileName is NULL.
+ * The files are mapped and streamed through a k-way merge.
+ * When the output is a regular file, numThreads is more than 1 and the
+ * input is at least MERGE_SPLIT_BYTES, the key space is split into one
+ * range per thread using splitter lines sampled from the inputs. Each
+ * thread merges its range of every file and writes it with pwrite() at
+ * its own offset in the output. Otherwise, one thread merges everything.
+*/
+void mergeFiles(char **fileNames, int numFiles, int numThreads, char *outputFileName) {
+
+	/* Keep track of start time for
+	 * merge runtime calculation */
+	struct timeval startTime, endTime;
+	int seconds, micros;
+	gettimeofday(&startTime, NULL);
+
+	// Map each input file
+	char **data = malloc(numFiles * sizeof(char*));
+	long *sizes = malloc(numFiles * sizeof(long));
+	if (data == NULL || sizes == NULL) {
+		fprintf(stderr, "ERROR: Out of memory!\n");
+		exit(1);
+	}
+	long totalBytes = 0;
+	int f;
+	for (f = 0; f < numFiles; f++) {
+		data[f] = mapSortedFile(fileNames[f], &sizes[f]);
+		totalBytes += sizes[f];
+	}
+
+	// Open the output, and find where writing starts if it is a regular file
+	int fd = STDOUT_FILENO;
+	if (outputFileName != NULL) {
+		fd = open(outputFileName, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (fd < 0) {
+			fprintf(stderr, "The file \'%s\' could not be opened for writing.\n",
+					outputFileName);
+			exit(1);
+		}
+	}
+	else {
+		fflush(stdout);
+	}
+	struct stat outStat;
+	long baseOffset = -1;
+	if (fstat(fd, &outStat) == 0 && S_ISREG(outStat.st_mode))
+		baseOffset = lseek(fd, 0, SEEK_CUR);
+
+	// Only split the merge if the ranges can be written in parallel
+	int numRanges = numThreads;
+	if (baseOffset < 0 || totalBytes < MERGE_SPLIT_BYTES)
+		numRanges = 1;
+
+	// Find where each range starts in each file: the first
+	// line that is not less than the range's splitter
+	char ***bounds = malloc((numRanges + 1) * sizeof(char**));
+	if (bounds == NULL) {
+		fprintf(stderr, "ERROR: Out of memory!\n");
+		exit(1);
+	}
+	struct mergeLine *splitters = chooseSplitters(data, sizes, numFiles, numRanges);
+	int r;
+	for (r = 0; r <= numRanges; r++) {
+		bounds[r] = malloc(numFiles * sizeof(char*));
+		if (bounds[r] == NULL) {
+			fprintf(stderr, "ERROR: Out of memory!\n");
+			exit(1);
+		}
+		for (f = 0; f < numFiles; f++) {
+			if (r == 0)
+				bounds[r][f] = data[f];
+			else if (r == numRanges)
+				bounds[r][f] = data[f] + sizes[f];
+			else
+				bounds[r][f] = data[f] + lowerBoundLine(data[f], sizes[f],
+												&splitters[r - 1]);
+		}
+	}
+	free(splitters);
+
+	// Prefix sum of the range sizes gives the offset of each range
+	struct mergeParams params[numRanges];
+	long offset = baseOffset;
+	for (r = 0; r < numRanges; r++) {
+		params[r].starts = bounds[r];
+		params[r].ends = bounds[r + 1];
+		params[r].numFiles = numFiles;
+		params[r].fd = fd;
+		params[r].offset = offset;
+		if (offset >= 0) {
+			for (f = 0; f < numFiles; f++) {
+				offset += params[r].ends[f] - params[r].starts[f];
+
+				// A last line without a newline is given one
+				if (params[r].ends[f] > params[r].starts[f] &&
+						params[r].ends[f][-1] != '\n')
+					offset++;
+			}
+		}
+	}
+
+	if (numRanges == 1) {
+		// Merge everything in this thread
+		mergeRange(params[0].starts, params[0].ends, numFiles, fd, params[0].offset);
+	}
+	else {
+		// pthread variable declarations
+		int result;
+		pthread_t threadID[numRanges];
+		pthread_attr_t attr;
+		pthread_attr_init(&attr);
+		pthread_attr_setscope(&attr, PTHREAD_SCOPE_SYSTEM);
+
+		// Merge each range in a separate thread
+		for (r = 0; r < numRanges; r++) {
+
+			result = pthread_create(&threadID[r], &attr, threadMergeRange, (void *) &params[r]);
+
+			if (result != 0) {
+				fprintf(stderr, "pthread_create failed, result = %d\n", result);
+				exit(1);
+			}
+		}
+
+		// Wait for all threads to exit
+		for (r = 0; r < numRanges; r++) {
+
+			result = pthread_join(threadID[r], NULL);
+
+			if ( result != 0 ) {
+				fprintf(stderr, "join with worker %ld failed, error = %d\n",
+						(long) threadID[r], result);
+				exit(1);
+			}
+		}
+	}
+
+	// Writes at explicit offsets do not move the file position
+	if (baseOffset >= 0)
+		lseek(fd, offset, SEEK_SET);
+	if (outputFileName != NULL)
+		close(fd);
+
+	/* Print runtime info to stderr for performance testing */
+	gettimeofday(&endTime, NULL);
+	seconds = endTime.tv_sec  - startTime.tv_sec;
+	micros  = endTime.tv_usec - startTime.tv_usec;
+	if ( endTime.tv_usec < startTime.tv_usec ) {
+		micros += 1000000;
+		seconds--;
+	}
+	fprintf(stderr, "runtime: %d seconds, %d microseconds\n", seconds, micros);
+	fprintf(stderr, "merge: %d files, %ld bytes, %d range%s\n", numFiles, totalBytes,
+			numRanges, numRanges == 1 ? "" : "s in parallel");
+
+	// Unmap the files and free the range bounds
+	for (f = 0; f < numFiles; f++) {
+		if (data[f] != NULL)
+			munmap(data[f], sizes[f]);
+	}
+	for (r = 0; r <= numRanges; r++)
+		free(bounds[r]);
+	free(bounds);
+	free(data);
+	free(sizes);
+}
+
+/*
+ * void *threadMergeRange(void *arg) -- A middleman method
+ * for calling mergeRange in a separate thread.
+ * Sets the arguments for mergeRange() from the struct pointer
+ * specified by arg.
+*/
+void *threadMergeRange(void *arg) {
+	// Cast arg to mergeParams*
+	struct mergeParams *params = (struct mergeParams*) arg;
+
+	// Call mergeRange() with the given arguments
+	mergeRange(params->starts, params->ends, params->numFiles,
+				params->fd, params->offset);
+
+	// Exit thread
+	pthread_exit( NULL );
+}
+
+/*
+ * void mergeRange(char **starts, char **ends, int numFiles, int fd, long offset) --
+ * Merges the sorted lines from starts[f] to ends[f] of each of numFiles
+ * files, and writes them to fd at offset, or at its current position if
+ * offset is -1. This is merge() for any number of runs: the run whose
+ * line is smallest is kept at the top of a binary heap of cursors, its
+ * line is copied to the output and the cursor moves on to its next line.
+ * Each cursor asks the kernel to read ahead of it, so the files are read
+ * while the merge runs.
+*/
+void mergeRange(char **starts, char **ends, int numFiles, int fd, long offset) {
+
+	// Create a cursor for each run that is not empty
+	struct mergeCursor *cursors = malloc(numFiles * sizeof(struct mergeCursor));
+	struct mergeCursor **heap = malloc(numFiles * sizeof(struct mergeCursor*));
+	char *buffer = malloc(IO_CHUNK_SIZE);
+	if (cursors == NULL || heap == NULL || buffer == NULL) {
+		fprintf(stderr, "ERROR: Out of memory!\n");
+		exit(1);
+	}
+	int heapSize = 0;
+	int f;
+	for (f = 0; f < numFiles; f++) {
+		if (starts[f] >= ends[f])
+			continue;
+		cursors[f].next = starts[f];
+		cursors[f].end = ends[f];
+		cursors[f].file = f;
+		cursors[f].readAhead = (char*) ((uintptr_t) starts[f] & ~(uintptr_t) 4095);
+		advanceCursor(&cursors[f]);
+		heap[heapSize] = &cursors[f];
+		heapSize++;
+	}
+
+	// Build the heap
+	int i;
+	for (i = heapSize / 2 - 1; i >= 0; i--)
+		siftDown(heap, heapSize, i);
 
-	// Free params from memory
-	free(params);
+	// Copy out the smallest line until every run is empty
+	long fill = 0;
+	while (heapSize > 0) {
+		struct mergeCursor *top = heap[0];
 
-	// Exit thread
-	pthread_exit( NULL );
+		// Write the buffer if the line and its newline do not fit
+		if (fill + top->line.len + 1 > IO_CHUNK_SIZE) {
+			offset = writeBuffer(fd, buffer, fill, offset);
+			fill = 0;
+		}
+		if (top->line.len + 1 > IO_CHUNK_SIZE) {
+			// Write a very long line directly
+			offset = writeBuffer(fd, top->line.str, top->line.len, offset);
+			offset = writeBuffer(fd, "\n", 1, offset);
+		}
+		else {
+			memcpy(buffer + fill, top->line.str, top->line.len);
+			buffer[fill + top->line.len] = '\n';
+			fill += top->line.len + 1;
+		}
+
+		// Move the cursor on, dropping it when its run is empty
+		if (top->next < top->end) {
+			advanceCursor(top);
+		}
+		else {
+			heapSize--;
+			heap[0] = heap[heapSize];
+		}
+		siftDown(heap, heapSize, 0);
+	}
+	writeBuffer(fd, buffer, fill, offset);
+
+	free(buffer);
+	free(heap);
+	free(cursors);
 }
 
 /*
- * void *threadMerge(void *arg) -- A middleman method
- * for calling merge in a separate thread.
- * Sets the arguments for merge() from the struct pointer
- * specified by arg.
+ * void advanceCursor(struct mergeCursor *cursor) --
+ * Moves cursor on to the line starting at its next pointer, and asks the
+ * kernel to read the next IO_CHUNK_SIZE bytes of the file once the cursor
+ * comes within IO_CHUNK_SIZE of the part that was last asked for.
 */
-void *threadMerge(void *arg) {
-	// Cast arg to threadParams*
-	struct threadParams *params = (struct threadParams*) arg;
+void advanceCursor(struct mergeCursor *cursor) {
+	char *newline = memchr(cursor->next, '\n', cursor->end - cursor->next);
+	char *lineEnd = newline == NULL ? cursor->end : newline;
+	cursor->line.str = cursor->next;
+	cursor->line.len = lineEnd - cursor->next;
+	cursor->next = newline == NULL ? cursor->end : newline + 1;
 
-	// Call merge() with the given arguments
-	merge(params->inputArray, params->outputArray, params->lower, params->mid, params->upper);
+	// Keep the read-ahead one chunk in front of the merge
+	if (cursor->readAhead < cursor->end && cursor->next + IO_CHUNK_SIZE > cursor->readAhead) {
+		madvise(cursor->readAhead, IO_CHUNK_SIZE, MADV_WILLNEED);
+		cursor->readAhead += IO_CHUNK_SIZE;
+	}
+}
 
-	// Free params from memory
-	free(params);
+/*
+ * void siftDown(struct mergeCursor **heap, int heapSize, int index) --
+ * Moves the cursor at index down the binary heap until no cursor below
+ * it has a smaller line. Equal lines are ordered by file, so lines from
+ * earlier files come first.
+*/
+void siftDown(struct mergeCursor **heap, int heapSize, int index) {
+	while (1) {
+		int smallest = index;
+		int child;
+		for (child = 2 * index + 1; child <= 2 * index + 2 && child < heapSize; child++) {
+			int result = compareMergeLines(&heap[child]->line, &heap[smallest]->line);
+			if (result < 0 || (result == 0 && heap[child]->file < heap[smallest]->file))
+				smallest = child;
+		}
+		if (smallest == index)
+			return;
 
-	// Exit thread
-	pthread_exit( NULL );
+		struct mergeCursor *temp = heap[index];
+		heap[index] = heap[smallest];
+		heap[smallest] = temp;
+		index = smallest;
+	}
 }
 
-/* void merge(char **inputArray, char **outputArray, int lower, int mid, int upper) --
- * Precondition: The stirng pointers in the index ranges lower to mid-1 (inclusive)
- * are sorted relative to each other in inputArray,
- * and the stirng pointers in the index ranges mid to upper (inclusive)
- * are sorted relative to each other in inputArray.
- *
- * This method copies all pointers in sorted order from each range in inputArray
- * to the index range lower to upper (inclusive) in outputArray.
+/*
+ * int compareMergeLines(struct mergeLine *a, struct mergeLine *b) --
+ * Compares the lines a and b, which are not '\0' terminated,
+ * in the same order as strcmp().
 */
-void merge(char **inputArray, char **outputArray, int lower, int mid, int upper) {
+int compareMergeLines(struct mergeLine *a, struct mergeLine *b) {
+	long len = a->len < b->len ? a->len : b->len;
+	int result = memcmp(a->str, b->str, len);
+	if (result != 0)
+		return result;
+	return (a->len > b->len) - (a->len < b->len);
+}
 
-	// Set up loop variables
-	int i = lower;
-	int j = mid;
-	int k;
+/*
+ * struct mergeLine *chooseSplitters(char **data, long *sizes, int numFiles, int numRanges) --
+ * Samples MERGE_SAMPLES lines spread evenly over each of the numFiles files
+ * in data, sorts the samples, and picks numRanges - 1 of them at even
+ * intervals to split the merge into numRanges ranges of similar size.
+ * Returns a new array of the splitters.
+*/
+struct mergeLine *chooseSplitters(char **data, long *sizes, int numFiles, int numRanges) {
+	struct mergeLine *samples = malloc(numFiles * MERGE_SAMPLES * sizeof(struct mergeLine));
+	struct mergeLine *splitters = malloc(numRanges * sizeof(struct mergeLine));
+	if (samples == NULL || splitters == NULL) {
+		fprintf(stderr, "ERROR: Out of memory!\n");
+		exit(1);
+	}
 
-	// Merge values
-	for (k = lower; k <= upper; k++) {
-		if (i < mid && j <= upper) {
-			if (strcmp(inputArray[i], inputArray[j]) <= 0) {
-				outputArray[k] = inputArray[i];
-				i++;
-			}
-			else {
-				outputArray[k] = inputArray[j];
-				j++;
-			}
-		}
-		else if (i >= mid) {
-			outputArray[k] = inputArray[j];
-			j++;
-		}
-		else {
-			outputArray[k] = inputArray[i];
-			i++;
+	// Take the line at or after evenly spaced offsets in each file
+	long numSamples = 0;
+	int f, s;
+	for (f = 0; f < numFiles && numRanges > 1; f++) {
+		for (s = 0; s < MERGE_SAMPLES; s++) {
+			long start = lineBoundary(data[f], sizes[f], s * sizes[f] / MERGE_SAMPLES);
+			if (start >= sizes[f])
+				break;
+			char *newline = memchr(data[f] + start, '\n', sizes[f] - start);
+			samples[numSamples].str = data[f] + start;
+			samples[numSamples].len = (newline == NULL ? data[f] + sizes[f] : newline)
+										- samples[numSamples].str;
+			numSamples++;
 		}
-  	}
+	}
+
+	// Pick splitters at even intervals of the sorted samples; there is
+	// always a sample, since only inputs of MERGE_SPLIT_BYTES are split
+	qsort(samples, numSamples, sizeof(struct mergeLine), compareSamples);
+	int r;
+	for (r = 1; r < numRanges; r++)
+		splitters[r - 1] = samples[r * numSamples / numRanges];
+
+	free(samples);
+	return splitters;
 }
 
-/* void quicksort(char **strArray, int lower, int upper) -- Using the
- * quicksort algorithm from CLRS, recursively sorts all elements
- * between and including indexes upper and lower in strArray.
+/*
+ * int compareSamples(const void *a, const void *b) --
+ * Compares the mergeLines pointed to by a and b, for use with qsort().
 */
-void quicksort(char **strArray, int lower, int upper) {
-	if (lower < upper) {
-		// Partition range
-		int pivot = partition(strArray, lower, upper);
-		// Call quickosrt again on each range around pivot
-  		quicksort(strArray, lower, pivot - 1);
-		quicksort(strArray, pivot + 1, upper);
+int compareSamples(const void *a, const void *b) {
+	return compareMergeLines((struct mergeLine*) a, (struct mergeLine*) b);
+}
+
+/*
+ * long lowerBoundLine(char *data, long size, struct mergeLine *key) --
+ * Using a binary search over the byte offsets of the sorted lines in
+ * data, returns the offset of the first line that is not less than key,
+ * or size if there is none.
+*/
+long lowerBoundLine(char *data, long size, struct mergeLine *key) {
+	long lower = 0;
+	long upper = size;
+
+	// lower and upper are always line starts, and the answer is between them
+	while (lower < upper) {
+		long start = lineBoundary(data, size, lower + (upper - lower) / 2);
+		if (start >= upper)
+			start = lower;
+
+		char *newline = memchr(data + start, '\n', size - start);
+		struct mergeLine line;
+		line.str = data + start;
+		line.len = (newline == NULL ? data + size : newline) - line.str;
+
+		if (compareMergeLines(&line, key) < 0)
+			lower = newline == NULL ? size : newline - data + 1;
+		else
+			upper = start;
 	}
+
+	return lower;
 }
 
-/* void partition(char **strArray, int lower, int upper) --
- * Using the partition algorithm from CLRS, partitions all
- * elements between and including indexes lower and upper
- * in strArray around a pivot chosen by the 'median of 3'
- * method (implemented in selectPivot()).
- * Returns pivot index
+/*
+ * char *mapSortedFile(char *fileName, long *fileSize) --
+ * Maps the whole file fileName into memory for reading, tells the kernel
+ * it will be read in order, and sets fileSize to its size in bytes.
+ * Returns a pointer to the mapped file, or NULL if the file is empty.
 */
-int partition(char **strArray, int lower, int upper) {
+char *mapSortedFile(char *fileName, long *fileSize) {
 
-	//Select the optimal pivot index
-  	int pivot = selectPivot(strArray, lower, upper);
+	// Open file for reading
+	int fd = open(fileName, O_RDONLY);
 
-	// Move pivot to the end
-  	swapStr(strArray, pivot, upper);
+	// Exit if file does not open
+	if (fd < 0) {
+		fprintf(stderr, "The file \'%s\' does not exist.\n", fileName);
+		exit(1);
+	}
 
-	// Save value of pivot string for comparison
-  	char* pivotStr = strArray[upper];
+	// Find the size of the file
+	struct stat fileStat;
+	if (fstat(fd, &fileStat) < 0) {
+		perror("fstat");
+		exit(1);
+	}
+	*fileSize = fileStat.st_size;
 
-	// Variable to keep track of how many strings equivalent
-	// to the pivot we encounter
-	int eqLines = 0;
+	// Empty files cannot be mapped
+	if (*fileSize == 0) {
+		close(fd);
+		return NULL;
+	}
 
-  	int j;
-  	int strcmpRetVal;
-  	int currIndex = lower - 1;
+	void *memoryBuffer = mmap(NULL, *fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+	if ( memoryBuffer == MAP_FAILED ) {
+		fprintf(stderr, "errno is %d\n", errno);
+		perror("memoryBuffer is MAP_FAILED ");
+		exit(1);
+	}
+	madvise(memoryBuffer, *fileSize, MADV_SEQUENTIAL);
+	close(fd);
 
-	// Move the values relative to the pivot
-  	for (j = lower; j <= upper - 1; j++) {
-  		strcmpRetVal = strcmp(strArray[j], pivotStr);
-  		if (strcmpRetVal < 0) {
-  			currIndex++;
-  			swapStr(strArray, currIndex, j);
-  		}
-  		else if (strcmpRetVal == 0) {
-			// Alternate which side equivalent lines are moved
-  			eqLines++;
-  			if (eqLines % 2 == 0) {
-  				currIndex++;
-  				swapStr(strArray, currIndex, j);
-  			}
-  		}
-  	}
+	return (char*) memoryBuffer;
+}
 
-	// Move pivot back
-  	swapStr(strArray, currIndex + 1, upper);
+/*
+ * long writeBuffer(int fd, char *data, long len, long offset) --
+ * Writes all len bytes of data to fd at offset, or at the current
+ * position of fd if offset is -1.
+ * Returns the offset after the data, or -1 if offset was -1.
+*/
+long writeBuffer(int fd, char *data, long len, long offset) {
+	if (offset >= 0) {
+		pwriteAll(fd, data, len, offset);
+		return offset + len;
+	}
 
-	// Return picot index
-  	return currIndex + 1;
+	while (len > 0) {
+		ssize_t result = write(fd, data, len);
+		if (result < 0 && errno == EINTR)
+			continue;
+		if (result < 0) {
+			perror("write");
+			exit(1);
+		}
+		data += result;
+		len -= result;
+	}
+	return -1;
 }
 
-/* selectPivot(char **strArray, int lower, int upper) --
- * Uses the 'median of 3' approach to select
- * (and return the index of) an optimal pivot between
- * and including lower and upperin strArray for partitioning.
- * Also sorts 3 of the string pointers relative to
- * each other within the array, which will aid future sorting.
- * If the range is 10 or smaller, simply returns upper index.
+/*
+ * char **makeSortKeys(char **linesArray, long totalLines, int numThreads) --
+ * Replaces each line in linesArray indexes (0 - totalLines) with its
+ * strxfrm() key for the current LC_COLLATE locale, computing the keys
+ * in numThreads threads, so that sorting the keys with strcmp() puts the
+ * lines in locale order. Each key is stored in its thread's block right
+ * after a pointer to its line, which restoreLines() uses to put the
+ * lines back after sorting.
+ * Returns a new array of the numThreads key blocks.
 */
-int selectPivot(char **strArray, int lower, int upper) {
+char **makeSortKeys(char **linesArray, long totalLines, int numThreads) {
 
-	// Abort if range is too small
- 	if (upper - lower <= 10)
-  		return upper;
+	// pthread variable declarations
+	int i, result;
+	struct keyParams params[numThreads];
+	pthread_t threadID[numThreads];
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	pthread_attr_setscope(&attr, PTHREAD_SCOPE_SYSTEM);
 
-	// Set midpoint
-  	int mid = (upper + lower) / 2;
+	// Break up the array and compute the keys of each part
+	for (i = 0; i < numThreads; i++) {
+		params[i].linesArray = linesArray;
+		params[i].lower = i * totalLines / numThreads;
+		params[i].upper = (i + 1) * totalLines / numThreads;
 
-	// Sort the three values
-  	if (strcmp(strArray[mid], strArray[lower]) < 0)
-  		swapStr(strArray, lower, mid);
-  	if (strcmp(strArray[upper], strArray[lower]) < 0)
-  		swapStr(strArray, lower, upper);
-  	if (strcmp(strArray[upper], strArray[mid]) < 0)
-  		swapStr(strArray, mid, upper);
+		// A single part is computed without starting a thread
+		if (numThreads == 1) {
+			params[i].keyBlock = makeKeys(linesArray, params[i].lower, params[i].upper);
+			break;
+		}
 
-	// Return index of median value
-  	return mid;
+		result = pthread_create(&threadID[i], &attr, threadMakeKeys, (void *) &params[i]);
+
+		if (result != 0) {
+			fprintf(stderr, "pthread_create failed, result = %d\n", result);
+			exit(1);
+		}
+	}
+
+	// Wait for all threads to exit
+	for (i = 0; numThreads > 1 && i < numThreads; i++) {
+
+		result = pthread_join(threadID[i], NULL);
+
+		if ( result != 0 ) {
+			fprintf(stderr, "join with worker %ld failed, error = %d\n",
+					(long) threadID[i], result);
+			exit(1);
+		}
+	}
+
+	// Return the blocks so they can be freed after sorting
+	char **keyBlocks = malloc(numThreads * sizeof(char*));
+	if (keyBlocks == NULL) {
+		fprintf(stderr, "ERROR: Out of memory!\n");
+		exit(1);
+	}
+	for (i = 0; i < numThreads; i++)
+		keyBlocks[i] = params[i].keyBlock;
+	return keyBlocks;
 }
 
-/* swapStr(char **strArray, int indexA, int indexB) --
- * Swaps the string pointers at indexA and indexB in
- * strArray with one another.
+/*
+ * void *threadMakeKeys(void *arg) -- A middleman method
+ * for calling makeKeys in a separate thread.
+ * Sets the arguments for makeKeys() from the struct pointer
+ * specified by arg, and stores the result in its keyBlock field.
 */
-void swapStr(char **strArray, int indexA, int indexB) {
-	char* temp = strArray[indexA];
-  	strArray[indexA] = strArray[indexB];
-  	strArray[indexB] = temp;
+void *threadMakeKeys(void *arg) {
+	// Cast arg to keyParams*
+	struct keyParams *params = (struct keyParams*) arg;
+
+	// Call makeKeys() with the given arguments
+	params->keyBlock = makeKeys(params->linesArray, params->lower, params->upper);
+
+	// Exit thread
+	pthread_exit( NULL );
 }
 
 /*
- * extendArray(char **oldArray, int oldLen, int newLen) --
- * Accepts a character pointer array (oldArray) of length oldLen,
- * creates a new, bigger array with the size newLen, and
- * copies all elements from oldArray to the new array.
- * Returns a pointer to the new array.
- * Returns NULL if memory allocation fails for the new array.
+ * char *makeKeys(char **linesArray, long lower, long upper) --
+ * Replaces the lines in linesArray indexes lower to upper-1 (inclusive)
+ * with their strxfrm() keys. The keys are measured first so that they
+ * all fit in one block, where each key follows a pointer to its line
+ * and is padded so the next pointer is aligned.
+ * Returns the block, which must be freed once the keys are no longer used.
 */
-char **extendArray(char **oldArray, int oldLen, int newLen) {
+char *makeKeys(char **linesArray, long lower, long upper) {
+	long i;
 
-	// Create new bigger array
-	char **newArray = malloc(newLen * sizeof(char*));
-	// Return NULL if malloc fails
-	if (newArray == NULL) {
-		// malloc() failed. Return NULL
-		return NULL;
+	// Measure the keys
+	size_t blockLen = 0;
+	for (i = lower; i < upper; i++)
+		blockLen += keyEntryLen(strxfrm(NULL, linesArray[i], 0));
+
+	char *keyBlock = malloc(blockLen > 0 ? blockLen : 1);
+	if (keyBlock == NULL) {
+		fprintf(stderr, "ERROR: Out of memory!\n");
+		exit(1);
 	}
 
-	//Copy all values over
-  	int i;
-  	for (i = 0; i < oldLen; i++)
-  	{
-  		newArray[i] = oldArray[i];
-  	}
+	// Store each line pointer followed by the key, and point the array at the key
+	char *entry = keyBlock;
+	for (i = lower; i < upper; i++) {
+		size_t keyLen = strxfrm(NULL, linesArray[i], 0);
+		memcpy(entry, &linesArray[i], sizeof(char*));
+		strxfrm(entry + sizeof(char*), linesArray[i], keyLen + 1);
+		linesArray[i] = entry + sizeof(char*);
+		entry += keyEntryLen(keyLen);
+	}
 
-	// Free old array
-  	free(oldArray);
+	return keyBlock;
+}
 
-	// Return new array
-  	return newArray;
+/*
+ * size_t keyEntryLen(size_t keyLen) --
+ * Returns the bytes taken in a key block by a key of keyLen bytes:
+ * its line pointer, the key and its '\0', rounded up to a pointer.
+*/
+size_t keyEntryLen(size_t keyLen) {
+	size_t len = sizeof(char*) + keyLen + 1;
+	return (len + sizeof(char*) - 1) & ~(sizeof(char*) - 1);
+}
+
+/*
+ * void restoreLines(char **linesArray, long totalLines, char **keyBlocks, int numBlocks) --
+ * Replaces each key in linesArray indexes (0 - totalLines) with the line
+ * it was made from, keeping the sorted order, then frees the numBlocks
+ * blocks of keys in keyBlocks.
+*/
+void restoreLines(char **linesArray, long totalLines, char **keyBlocks, int numBlocks) {
+	long i;
+	for (i = 0; i < totalLines; i++)
+		memcpy(&linesArray[i], linesArray[i] - sizeof(char*), sizeof(char*));
+
+	int b;
+	for (b = 0; b < numBlocks; b++)
+		free(keyBlocks[b]);
+	free(keyBlocks);
+}
+
+/* void networkSort(char **strArray, long lower, long upper) --
+ * Sorts strArray between and including indexes lower and upper, a range
+ * of at most NETWORK_SIZE strings, with a sorting network over prefix
+ * keys: the first 8 bytes of each string, read as a big-endian number,
+ * order the strings like strcmp() does unless they are equal.
+ * The network, run by the kernel selectNetworkKernel() chose, is
+ * branch-free, so the leaves of quicksort do not pay for mispredicted
+ * branches. Runs of equal keys from strings longer than the prefix are
+ * then sorted on the rest of the string.
+*/
+void networkSort(char **strArray, long lower, long upper) {
+	int n = upper - lower + 1;
+	if (n < 2)
+		return;
+
+	// Load the keys and the string pointers
+	uint64_t keys[NETWORK_SIZE];
+	uintptr_t ptrs[NETWORK_SIZE];
+	int i, j;
+	for (i = 0; i < n; i++) {
+		keys[i] = prefixKey(strArray[lower + i]);
+		ptrs[i] = (uintptr_t) strArray[lower + i];
+	}
+
+	networkKernel(keys, ptrs, n);
+
+	// Sort runs of equal keys whose strings go on past the prefix
+	for (i = 0; i < n; i = j) {
+		for (j = i + 1; j < n && keys[j] == keys[i]; j++)
+			;
+		if (j - i > 1 && (keys[i] & 0xFF) != 0)
+			suffixSort(ptrs, i, j - 1);
+	}
+
+	// Store the sorted pointers
+	for (i = 0; i < n; i++)
+		strArray[lower + i] = (char*) ptrs[i];
+}
+
+/* void networkScalar(uint64_t *keys, uintptr_t *ptrs, int n) --
+ * Sorts the n keys in keys, at most NETWORK_SIZE, and the pointers in
+ * ptrs along with them, with Batcher's network in networkPairs, swapping
+ * with masks instead of branches. Comparators reaching past the end of
+ * a smaller range are skipped, which leaves the rest of the network a
+ * valid network for that size.
+*/
+void networkScalar(uint64_t *keys, uintptr_t *ptrs, int n) {
+	int i;
+	for (i = 0; i < NETWORK_PAIRS; i++) {
+		int a = networkPairs[i][0];
+		int b = networkPairs[i][1];
+		if (b >= n)
+			continue;
+		uint64_t mask = -(uint64_t) (keys[b] < keys[a]);
+		uint64_t keyDiff = (keys[a] ^ keys[b]) & mask;
+		uintptr_t ptrDiff = (ptrs[a] ^ ptrs[b]) & (uintptr_t) mask;
+		keys[a] ^= keyDiff;
+		keys[b] ^= keyDiff;
+		ptrs[a] ^= ptrDiff;
+		ptrs[b] ^= ptrDiff;
+	}
+}
+
+#ifdef __x86_64__
+
+/* void networkAvx2(uint64_t *keys, uintptr_t *ptrs, int n) --
+ * Like networkScalar(), sorts the n keys in keys and the pointers in ptrs
+ * along with them, but with a bitonic network over four registers of four
+ * keys. Flipping the sign bit lets AVX2's signed compare order the keys,
+ * and the unused lanes of a smaller range hold the largest key, so they
+ * sort to the end. Keys that are already the largest key would tie with
+ * those lanes, so such ranges use networkScalar() instead.
+ * Needs a CPU with AVX2.
+*/
+__attribute__((target("avx2")))
+void networkAvx2(uint64_t *keys, uintptr_t *ptrs, int n) {
+	int64_t signedKeys[NETWORK_SIZE];
+	uintptr_t paddedPtrs[NETWORK_SIZE];
+	int i;
+	for (i = 0; i < n; i++) {
+		signedKeys[i] = (int64_t) (keys[i] ^ 0x8000000000000000ULL);
+		if (signedKeys[i] == INT64_MAX) {
+			networkScalar(keys, ptrs, n);
+			return;
+		}
+		paddedPtrs[i] = ptrs[i];
+	}
+	for (; i < NETWORK_SIZE; i++) {
+		signedKeys[i] = INT64_MAX;
+		paddedPtrs[i] = 0;
+	}
+
+	__m256i keyRows[4], ptrRows[4];
+	for (i = 0; i < 4; i++) {
+		keyRows[i] = _mm256_loadu_si256((__m256i*) (signedKeys + 4 * i));
+		ptrRows[i] = _mm256_loadu_si256((__m256i*) (paddedPtrs + 4 * i));
+	}
+
+	// Sort each column of the four rows, then transpose so each row is sorted
+	compareExchangeAvx2(&keyRows[0], &keyRows[1], &ptrRows[0], &ptrRows[1]);
+	compareExchangeAvx2(&keyRows[2], &keyRows[3], &ptrRows[2], &ptrRows[3]);
+	compareExchangeAvx2(&keyRows[0], &keyRows[2], &ptrRows[0], &ptrRows[2]);
+	compareExchangeAvx2(&keyRows[1], &keyRows[3], &ptrRows[1], &ptrRows[3]);
+	compareExchangeAvx2(&keyRows[1], &keyRows[2], &ptrRows[1], &ptrRows[2]);
+	transposeAvx2(keyRows);
+	transposeAvx2(ptrRows);
+
+	// Merge the rows into two sorted runs of eight
+	bitonicMergeAvx2(&keyRows[0], &keyRows[1], &ptrRows[0], &ptrRows[1]);
+	bitonicMergeAvx2(&keyRows[2], &keyRows[3], &ptrRows[2], &ptrRows[3]);
+
+	// Merge the runs: reversing the second makes the sixteen keys bitonic,
+	// and comparing keys eight then four apart leaves four bitonic rows
+	__m256i highKeys = _mm256_permute4x64_epi64(keyRows[3], 0x1B);
+	__m256i highPtrs = _mm256_permute4x64_epi64(ptrRows[3], 0x1B);
+	keyRows[3] = _mm256_permute4x64_epi64(keyRows[2], 0x1B);
+	ptrRows[3] = _mm256_permute4x64_epi64(ptrRows[2], 0x1B);
+	keyRows[2] = highKeys;
+	ptrRows[2] = highPtrs;
+	compareExchangeAvx2(&keyRows[0], &keyRows[2], &ptrRows[0], &ptrRows[2]);
+	compareExchangeAvx2(&keyRows[1], &keyRows[3], &ptrRows[1], &ptrRows[3]);
+	compareExchangeAvx2(&keyRows[0], &keyRows[1], &ptrRows[0], &ptrRows[1]);
+	compareExchangeAvx2(&keyRows[2], &keyRows[3], &ptrRows[2], &ptrRows[3]);
+	for (i = 0; i < 4; i++) {
+		bitonicSortAvx2(&keyRows[i], &ptrRows[i]);
+		_mm256_storeu_si256((__m256i*) (signedKeys + 4 * i), keyRows[i]);
+		_mm256_storeu_si256((__m256i*) (paddedPtrs + 4 * i), ptrRows[i]);
+	}
+
+	for (i = 0; i < n; i++) {
+		keys[i] = (uint64_t) signedKeys[i] ^ 0x8000000000000000ULL;
+		ptrs[i] = paddedPtrs[i];
+	}
+}
+
+/* void compareExchangeAvx2(__m256i *lowKeys, __m256i *highKeys,
+ *                          __m256i *lowPtrs, __m256i *highPtrs) --
+ * Compares the keys in each lane of lowKeys and highKeys, leaving the
+ * smaller in lowKeys and the larger in highKeys, and moves the pointers
+ * in lowPtrs and highPtrs with the same mask.
+*/
+__attribute__((target("avx2")))
+void compareExchangeAvx2(__m256i *lowKeys, __m256i *highKeys,
+							__m256i *lowPtrs, __m256i *highPtrs) {
+	__m256i greater = _mm256_cmpgt_epi64(*lowKeys, *highKeys);
+	__m256i minKeys = _mm256_blendv_epi8(*lowKeys, *highKeys, greater);
+	__m256i minPtrs = _mm256_blendv_epi8(*lowPtrs, *highPtrs, greater);
+	*highKeys = _mm256_blendv_epi8(*highKeys, *lowKeys, greater);
+	*highPtrs = _mm256_blendv_epi8(*highPtrs, *lowPtrs, greater);
+	*lowKeys = minKeys;
+	*lowPtrs = minPtrs;
+}
+
+/* void transposeAvx2(__m256i *rows) --
+ * Transposes the four rows of four 64-bit lanes in rows, so that
+ * row i then holds lane i of each of the old rows.
+*/
+__attribute__((target("avx2")))
+void transposeAvx2(__m256i *rows) {
+	__m256i evens01 = _mm256_unpacklo_epi64(rows[0], rows[1]);
+	__m256i odds01 = _mm256_unpackhi_epi64(rows[0], rows[1]);
+	__m256i evens23 = _mm256_unpacklo_epi64(rows[2], rows[3]);
+	__m256i odds23 = _mm256_unpackhi_epi64(rows[2], rows[3]);
+	rows[0] = _mm256_permute2x128_si256(evens01, evens23, 0x20);
+	rows[1] = _mm256_permute2x128_si256(odds01, odds23, 0x20);
+	rows[2] = _mm256_permute2x128_si256(evens01, evens23, 0x31);
+	rows[3] = _mm256_permute2x128_si256(odds01, odds23, 0x31);
+}
+
+#endif
+
+/* void suffixSort(uintptr_t *ptrs, int lower, int upper) --
+ * Sorts the strings in ptrs between and including indexes lower and
+ * upper, which share their first 8 bytes, by the rest of each string,
+ * using insertion sort since such runs are short.
+*/
+void suffixSort(uintptr_t *ptrs, int lower, int upper) {
+	int i, j;
+	for (i = lower + 1; i <= upper; i++) {
+		uintptr_t line = ptrs[i];
+		for (j = i; j > lower && strcmp((char*) ptrs[j - 1] + 8, (char*) line + 8) > 0; j--)
+			ptrs[j] = ptrs[j - 1];
+		ptrs[j] = line;
+	}
+}
+
+/* uint64_t prefixKey(char *str) --
+ * Returns the first 8 bytes of str as a big-endian number, padded with
+ * zeros after the end of the string, so that keys compare like strcmp()
+ * on the strings' first 8 bytes.
+*/
+uint64_t prefixKey(char *str) {
+	uint64_t key = 0;
+	int i;
+	for (i = 0; i < 8 && str[i] != '\0'; i++)
+		key |= (uint64_t) (unsigned char) str[i] << (56 - 8 * i);
+	return key;
 }